@@ -1118,12 +1118,9 @@ static int Bmsrv_send_modify_update(Dsh *sh, char *url)
  */
 static int Bmsrv_send_modify_answer(Dsh *sh, char *url)
 {
-   char *d_cmd;
    int st;
 
-   d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page", url);
-   st = a_Dpip_dsh_write_str(sh, 1, d_cmd);
-   dFree(d_cmd);
+   st = a_Dpip_dsh_start_send_page(sh, 1, url);
    if (st != 0)
       return 1;
 
@@ -1580,7 +1577,7 @@ static int send_bm_page(Dsh *sh)
 static int Bmsrv_parse_token(Dsh *sh, char *Buf)
 {
    static char *msg1=NULL, *msg2=NULL, *msg3=NULL;
-   char *cmd, *d_cmd, *url, *title, *msg;
+   char *cmd, *url, *title, *msg;
    size_t BufSize;
    int st;
 
@@ -1658,10 +1655,8 @@ static int Bmsrv_parse_token(Dsh *sh, char *Buf)
       }
 
 
-      d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page", url);
+      st = a_Dpip_dsh_start_send_page(sh, 1, url);
       dFree(url);
-      st = a_Dpip_dsh_write_str(sh, 1, d_cmd);
-      dFree(d_cmd);
       if (st != 0)
          return 1;
 
@@ -163,12 +163,8 @@ char *a_Url_decode_hex_str(const char *str, size_t *p_sz)
 static void send_decoded_data(const char *url, const char *mime_type,
                               unsigned char *data, size_t data_sz)
 {
-   char *d_cmd;
-
    /* Send dpip tag */
-   d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page", url);
-   a_Dpip_dsh_write_str(sh, 1, d_cmd);
-   dFree(d_cmd);
+   a_Dpip_dsh_start_send_page(sh, 1, url);
 
    /* Send HTTP header. */
    a_Dpip_dsh_write_str(sh, 0, "Content-type: ");
@@ -182,7 +178,6 @@ static void send_decoded_data(const char *url, const char *mime_type,
 static void send_failure_message(const char *url, const char *mime_type,
                                  unsigned char *data, size_t data_sz)
 {
-   char *d_cmd;
    char buf[1024];
 
    const char *msg =
@@ -193,9 +188,7 @@ static void send_failure_message(const char *url, const char *mime_type,
    const char *msg_mime_type="text/html";
 
    /* Send dpip tag */
-   d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page", url);
-   a_Dpip_dsh_write_str(sh, 1, d_cmd);
-   dFree(d_cmd);
+   a_Dpip_dsh_start_send_page(sh, 1, url);
 
    /* Send HTTP header. */
    a_Dpip_dsh_write_str(sh, 0, "Content-type: ");
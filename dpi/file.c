@@ -409,15 +409,12 @@ static void File_info2html(ClientInfo *client, FileInfo *finfo, int n)
 static void File_send_dir(ClientInfo *client)
 {
    int n;
-   char *d_cmd, *Hdirname, *Udirname, *HUdirname;
+   char *Hdirname, *Udirname, *HUdirname;
    DilloDir *Ddir = client->d_dir;
 
    if (client->state == st_start) {
       /* Send DPI command */
-      d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page",
-                               client->orig_url);
-      a_Dpip_dsh_write_str(client->sh, 1, d_cmd);
-      dFree(d_cmd);
+      a_Dpip_dsh_start_send_page(client->sh, 1, client->orig_url);
       client->state = st_dpip;
 
    } else if (client->state == st_dpip) {
@@ -568,7 +565,6 @@ static void File_prepare_send_error_page(ClientInfo *client, int res,
 static void File_send_error_page(ClientInfo *client)
 {
    const char *status;
-   char *d_cmd;
    Dstr *body = dStr_sized_new(128);
 
    if (client->err_code == EACCES) {
@@ -584,10 +580,7 @@ static void File_send_error_page(ClientInfo *client)
    dStr_append(body, dStrerror(client->err_code));
 
    /* Send DPI command */
-   d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page",
-                            client->orig_url);
-   a_Dpip_dsh_write_str(client->sh, 0, d_cmd);
-   dFree(d_cmd);
+   a_Dpip_dsh_start_send_page(client->sh, 0, client->orig_url);
 
    a_Dpip_dsh_printf(client->sh, 0,
                      "HTTP/1.1 %s\r\n"
@@ -695,16 +688,13 @@ static int File_send_file(ClientInfo *client)
 
    const char *ct;
    const char *unknown_type = "application/octet-stream";
-   char buf[LBUF], *d_cmd, *name;
+   char buf[LBUF], *name;
    int st, st2, namelen;
    bool_t gzipped = FALSE;
 
    if (client->state == st_start) {
       /* Send DPI command */
-      d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page",
-                               client->orig_url);
-      a_Dpip_dsh_write_str(client->sh, 1, d_cmd);
-      dFree(d_cmd);
+      a_Dpip_dsh_start_send_page(client->sh, 1, client->orig_url);
       client->state = st_dpip;
 
    } else if (client->state == st_dpip) {
@@ -171,7 +171,6 @@ int main(void)
    Dsh *sh;
    int data_size;
    char *dpip_tag, *cmd = NULL, *cmd2 = NULL, *url = NULL, *size_str = NULL;
-   char *d_cmd;
 
    _MSG("starting...\n");
    //sleep(20);
@@ -208,9 +207,7 @@ int main(void)
 
    /* Start sending our answer.
     * (You can read the comments for DPIP API functions in dpip/dpip.c) */
-   d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page", url);
-   a_Dpip_dsh_write_str(sh, 0, d_cmd);
-   dFree(d_cmd);
+   a_Dpip_dsh_start_send_page(sh, 0, url);
    dFree(dpip_tag);
 
    dpip_tag = a_Dpip_dsh_read_token(sh, 1);
@@ -36,7 +36,12 @@
 
 #include "../dpip/dpip.h"
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #define QUEUE 5
+#define MAX_EVENTS 32
 
 volatile sig_atomic_t caught_sigchld = 0;
 char *SharedKey = NULL;
@@ -480,8 +485,8 @@ int fill_services_list(struct dp *attlist, int numdpis, Dlist **services_list)
 
       _MSG("dpid: service=%s, path=%s\n", service, path);
 
-      /* ignore dpi_dir silently */
-      if (strcmp(service, "dpi_dir") == 0)
+      /* ignore dpi_dir and prefork silently */
+      if (strcmp(service, "dpi_dir") == 0 || strcmp(service, "prefork") == 0)
          continue;
 
       s = dNew(struct service, 1);
@@ -510,6 +515,37 @@ int fill_services_list(struct dp *attlist, int numdpis, Dlist **services_list)
    return (dList_length(*services_list));
 }
 
+/*! Get the list of server dpis to start in advance from dpidrc
+ * e.g. prefork=file bookmarks
+ * \Return
+ * the (space or comma separated) list on success, NULL if there's none
+ */
+char *get_prefork_list(void)
+{
+   FILE *In;
+   char *dpidrc, *line, *name, *value, *list = NULL;
+
+   dpidrc = dStrconcat(dGethomedir(), "/", dotDILLO_DPIDRC, NULL);
+   if (access(dpidrc, F_OK) == -1) {
+      dFree(dpidrc);
+      dpidrc = dStrdup(DPIDRC_SYS);
+   }
+
+   if ((In = fopen(dpidrc, "r")) != NULL) {
+      for (;(line = dGetline(In)) != NULL; dFree(line)) {
+         if (dParser_parse_rc_line(&line, &name, &value) == 0 &&
+             strcmp(name, "prefork") == 0) {
+            dFree(list);
+            list = dStrdup(value);
+         }
+      }
+      fclose(In);
+   }
+   dFree(dpidrc);
+
+   return list;
+}
+
 /*
  * Return a socket file descriptor
  * (useful to set socket options in a uniform way)
@@ -601,6 +637,87 @@ int save_comm_keys(int srs_port)
    return ret;
 }
 
+/*! Start with an empty set of watched sockets.
+ * epoll is used when available, select otherwise.
+ */
+void init_watched_sockets(void)
+{
+   FD_ZERO(&sock_set);
+#ifdef HAVE_SYS_EPOLL_H
+   if (epoll_fd != -1)
+      dClose(epoll_fd);
+   if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+      ERRMSG("init_watched_sockets", "epoll_create1", errno);
+#else
+   epoll_fd = -1;
+#endif
+}
+
+/*! Watch a socket for incoming connections
+ */
+void watch_socket(int fd)
+{
+   FD_SET(fd, &sock_set);
+#ifdef HAVE_SYS_EPOLL_H
+   if (epoll_fd != -1) {
+      struct epoll_event ev;
+
+      memset(&ev, 0, sizeof(ev));
+      ev.events = EPOLLIN;
+      ev.data.fd = fd;
+      if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+         ERRMSG("watch_socket", "epoll_ctl", errno);
+   }
+#endif
+}
+
+/*! Stop watching a socket
+ */
+void unwatch_socket(int fd)
+{
+   FD_CLR(fd, &sock_set);
+#ifdef HAVE_SYS_EPOLL_H
+   if (epoll_fd != -1)
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
+/*! Wait for connections on the watched sockets.
+ * \Return
+ * \li Number of ready sockets (stored in ready_fds)
+ * \li 0 on timeout (in seconds)
+ * \li -1 on error (errno is set)
+ */
+int wait_for_sockets(int *ready_fds, int max_fds, int timeout)
+{
+   int fd, i, n;
+   fd_set selected_set;
+   struct timeval select_timeout;
+
+#ifdef HAVE_SYS_EPOLL_H
+   if (epoll_fd != -1) {
+      struct epoll_event ev[MAX_EVENTS];
+
+      n = epoll_wait(epoll_fd, ev, MIN(max_fds, MAX_EVENTS), timeout * 1000);
+      for (i = 0; i < n; ++i)
+         ready_fds[i] = ev[i].data.fd;
+      return n;
+   }
+#endif
+
+   select_timeout.tv_sec = timeout;
+   select_timeout.tv_usec = 0;
+   selected_set = sock_set;
+   n = select(FD_SETSIZE, &selected_set, NULL, NULL, &select_timeout);
+   for (fd = 0, i = 0; n > 0 && fd < FD_SETSIZE && i < max_fds; ++fd) {
+      if (FD_ISSET(fd, &selected_set)) {
+         ready_fds[i++] = fd;
+         --n;
+      }
+   }
+   return (n == -1) ? -1 : i;
+}
+
 /*! Initialise the service request socket (IDS)
  * \Return:
  * \li Number of sockets (1 == success)
@@ -610,14 +727,14 @@ int init_ids_srs_socket()
 {
    int srs_port, ret = -1;
 
-   FD_ZERO(&sock_set);
+   init_watched_sockets();
 
    if ((srs_fd = bind_socket_fd(DPID_BASE_PORT, &srs_port)) != -1) {
       /* create the shared secret */
       SharedKey = a_Misc_mksecret(8);
       /* save port number and SharedKey */
       if (save_comm_keys(srs_port) != -1) {
-         FD_SET(srs_fd, &sock_set);
+         watch_socket(srs_fd);
          ret = 1;
       }
    }
@@ -637,7 +754,7 @@ int init_dpi_socket(struct dp *dpi_attr)
    if ((s_fd = bind_socket_fd(DPID_BASE_PORT, &port)) != -1) {
       dpi_attr->sock_fd = s_fd;
       dpi_attr->port = port;
-      FD_SET(s_fd, &sock_set);
+      watch_socket(s_fd);
       ret = 1;
    }
 
@@ -645,7 +762,7 @@ int init_dpi_socket(struct dp *dpi_attr)
 }
 
 /*! Setup sockets for the plugins and add them to
- * the set of sockets (sock_set) watched by select.
+ * the set of sockets (sock_set) watched by the main loop.
  * \Return
  * \li Number of sockets on success
  * \li -1 on failure
@@ -689,7 +806,7 @@ void handle_sigchld(void)
    for (i = 0; i < numdpis; i++) {
       if (waitpid(dpi_attr_list[i].pid, &status, WNOHANG) > 0) {
          dpi_attr_list[i].pid = 1;
-         FD_SET(dpi_attr_list[i].sock_fd, &sock_set);
+         watch_socket(dpi_attr_list[i].sock_fd);
          numsocks++;
       }
    }
@@ -782,7 +899,7 @@ void ignore_dpi_sockets(struct dp *dpi_attr_list, int numdpis)
    int i;
 
    for (i = 0; i < numdpis; i++) {
-      FD_CLR(dpi_attr_list[i].sock_fd, &sock_set);
+      unwatch_socket(dpi_attr_list[i].sock_fd);
       dClose(dpi_attr_list[i].sock_fd);
    }
 }
@@ -802,8 +919,8 @@ int register_all_cmd()
    services_list = NULL;
    numdpis = 0;
    numsocks = 1;                /* the srs socket */
-   FD_ZERO(&sock_set);
-   FD_SET(srs_fd, &sock_set);
+   init_watched_sockets();
+   watch_socket(srs_fd);
    numdpis = register_all(&dpi_attr_list);
    fill_services_list(dpi_attr_list, numdpis, &services_list);
    numsocks = init_all_dpi_sockets(dpi_attr_list);
@@ -63,6 +63,9 @@ Dlist *services_list;
 /*! Set of sockets watched for connections */
 fd_set sock_set;
 
+/*! epoll instance watching sock_set (-1 when select is used) */
+int epoll_fd;
+
 /*! Set to 1 by the SIGCHLD handler dpi_sigchld */
 extern volatile sig_atomic_t caught_sigchld;
 
@@ -86,6 +89,16 @@ int register_all(struct dp **attlist);
 
 int fill_services_list(struct dp *attlist, int numdpis, Dlist **services_list);
 
+void init_watched_sockets(void);
+
+void watch_socket(int fd);
+
+void unwatch_socket(int fd);
+
+int wait_for_sockets(int *ready_fds, int max_fds, int timeout);
+
+char *get_prefork_list(void);
+
 int init_ids_srs_socket();
 
 int init_dpi_socket(struct dp *dpi_attr);
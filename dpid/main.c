@@ -19,6 +19,7 @@
 #include <unistd.h>      /* for ckd_write */
 #include <stdlib.h>      /* for exit */
 #include <assert.h>      /* for assert */
+#include <fcntl.h>       /* for fcntl */
 #include <sys/stat.h>    /* for umask */
 
 #include "dpid_common.h"
@@ -30,7 +31,10 @@
 #include "../dlib/dlib.h"
 #include "../dpip/dpip.h"
 
+#define MAX_READY 32
+
 sigset_t mask_sigchld;
+static sigset_t mask_none;
 
 
 /* Start a dpi filter plugin after accepting the pending connection
@@ -109,6 +113,68 @@ static void start_server_plugin(struct dp dpi_attr)
    }
 }
 
+/*! Start a dpi server plugin and stop watching its socket
+ * (the plugin takes it over until it exits)
+ */
+static void start_server(int i)
+{
+   numsocks--;
+   assert(numsocks >= 0);
+   unwatch_socket(dpi_attr_list[i].sock_fd);
+   if ((dpi_attr_list[i].pid = fork()) == -1) {
+      ERRMSG("main", "fork", errno);
+      /* exit(1); */
+   } else if (dpi_attr_list[i].pid == 0) {
+      /* child */
+      (void) sigprocmask(SIG_SETMASK, &mask_none, NULL);
+      start_server_plugin(dpi_attr_list[i]);
+   }
+}
+
+/*! Start the server plugins in dpidrc's prefork list, so they're
+ * already accepting connections when the first request comes.
+ */
+static void prefork_servers(void)
+{
+   int i;
+   char *list, *p, *id;
+
+   if ((list = get_prefork_list()) == NULL)
+      return;
+
+   for (p = list; (id = dStrsep(&p, " ,")); ) {
+      for (i = 0; *id && i < numdpis; i++) {
+         if (!dpi_attr_list[i].filter && dpi_attr_list[i].pid == 1 &&
+             strcmp(dpi_attr_list[i].id, id) == 0) {
+            _MSG("prefork: %s\n", dpi_attr_list[i].path);
+            start_server(i);
+            break;
+         }
+      }
+   }
+   dFree(list);
+}
+
+/*! Get the pipe FD dpid's starter left us (if any), to tell it
+ * when we're ready to serve.
+ * \Return
+ * the FD, or -1 if there's none
+ */
+static int get_ready_fd(void)
+{
+   char *str, *tail;
+   int fd = -1;
+
+   if ((str = getenv("DPID_READY_FD")) != NULL) {
+      fd = strtol(str, &tail, 10);
+      if (*tail || fd < 3 || fcntl(fd, F_GETFD) == -1)
+         fd = -1;
+      /* don't pass it to our plugins */
+      unsetenv("DPID_READY_FD");
+   }
+   return fd;
+}
+
 /*!
  * Read service request from sock
  * \Return
@@ -206,14 +272,13 @@ static int get_open_max(void)
  */
 int main(void)
 {
-   int i, n = 0, open_max;
+   int i, k, n = 0, open_max, ready_fd;
+   int ready[MAX_READY];
    int dpid_idle_timeout = 60 * 60; /* default, in seconds */
-   struct timeval select_timeout;
-   sigset_t mask_none;
-   fd_set selected_set;
 
    dpi_attr_list = NULL;
    services_list = NULL;
+   epoll_fd = -1;
    //daemon(0,0); /* Use 0,1 for feedback */
    /* TODO: call setsid() ?? */
 
@@ -223,10 +288,14 @@ int main(void)
    /* TODO: make dpid work on any directory. */
    // chdir("/");
 
-   /* close inherited file descriptors */
+   /* close inherited file descriptors (but the readiness pipe) */
+   ready_fd = get_ready_fd();
    open_max = get_open_max();
    for (i = 3; i < open_max; i++)
-      dClose(i);
+      if (i != ready_fd)
+         dClose(i);
+   if (ready_fd != -1)
+      fcntl(ready_fd, F_SETFD, FD_CLOEXEC | fcntl(ready_fd, F_GETFD));
 
    /* this sleep used to unmask a race condition */
    // sleep(2);
@@ -275,6 +344,11 @@ int main(void)
    (void) sigemptyset(&mask_none);
    (void) sigprocmask(SIG_SETMASK, &mask_none, NULL);
 
+   /* Sockets are listening: let our starter know right away */
+   if (ready_fd != -1)
+      dClose(ready_fd);
+   prefork_servers();
+
    printf("dpid started\n");
 /* Start main loop */
    while (1) {
@@ -285,11 +359,8 @@ int main(void)
             caught_sigchld = 0;
          }
          (void) sigprocmask(SIG_UNBLOCK, &mask_sigchld, NULL);
-         select_timeout.tv_sec = dpid_idle_timeout;
-         select_timeout.tv_usec = 0;
-         selected_set = sock_set;
-         n = select(FD_SETSIZE, &selected_set, NULL, NULL, &select_timeout);
-         if (n == 0) { /* select timed out, try to exit */
+         n = wait_for_sockets(ready, MAX_READY, dpid_idle_timeout);
+         if (n == 0) { /* timed out, try to exit */
             /* BUG: This is a workaround for dpid not to exit when the
              * downloads server is active. The proper way to handle it is with
              * a dpip command that asks the server whether it's busy.
@@ -304,97 +375,90 @@ int main(void)
       } while (n == -1 && errno == EINTR);
 
       if (n == -1) {
-         ERRMSG("main", "select", errno);
+         ERRMSG("main", "wait_for_sockets", errno);
          exit(1);
       }
-      /* If the service req socket is selected then service the req. */
-      if (FD_ISSET(srs_fd, &selected_set)) {
-         int sock_fd;
-         socklen_t sin_sz;
-         struct sockaddr_in sin;
-         char *req = NULL;
-
-         --n;
-         assert(n >= 0);
-         sin_sz = (socklen_t) sizeof(sin);
-         sock_fd = accept(srs_fd, (struct sockaddr *)&sin, &sin_sz);
-         if (sock_fd == -1) {
-            ERRMSG("main", "accept", errno);
-            MSG_ERR("accept on srs socket failed\n");
-            MSG_ERR("service pending connections, and continue\n");
-         } else {
-            int command;
-            Dsh *sh;
-
-            sh = a_Dpip_dsh_new(sock_fd, sock_fd, 1024);
+
+      for (k = 0; k < n; k++) {
+         /* If the service req socket is ready then service the req. */
+         if (ready[k] == srs_fd) {
+            int sock_fd;
+            socklen_t sin_sz;
+            struct sockaddr_in sin;
+            char *req = NULL;
+
+            sin_sz = (socklen_t) sizeof(sin);
+            sock_fd = accept(srs_fd, (struct sockaddr *)&sin, &sin_sz);
+            if (sock_fd == -1) {
+               ERRMSG("main", "accept", errno);
+               MSG_ERR("accept on srs socket failed\n");
+               MSG_ERR("service pending connections, and continue\n");
+            } else {
+               int command;
+               Dsh *sh;
+
+               sh = a_Dpip_dsh_new(sock_fd, sock_fd, 1024);
 read_next:
-            req = get_request(sh);
-            command = get_command(sh, req);
-            switch (command) {
-            case AUTH_CMD:
-               if (a_Dpip_check_auth(req) != -1) {
-                  dFree(req);
-                  goto read_next;
+               req = get_request(sh);
+               command = get_command(sh, req);
+               switch (command) {
+               case AUTH_CMD:
+                  if (a_Dpip_check_auth(req) != -1) {
+                     dFree(req);
+                     goto read_next;
+                  }
+                  break;
+               case BYE_CMD:
+                  stop_active_dpis(dpi_attr_list, numdpis);
+                  //cleanup();
+                  exit(0);
+                  break;
+               case CHECK_SERVER_CMD:
+                  send_sockport(sock_fd, req, dpi_attr_list);
+                  break;
+               case REGISTER_ALL_CMD:
+                  register_all_cmd();
+                  prefork_servers();
+                  /* the ready list refers to the old sockets */
+                  n = k + 1;
+                  break;
+               case UNKNOWN_CMD:
+                  {
+                  char *d_cmd = a_Dpip_build_cmd("cmd=%s msg=%s",
+                                                 "DpiError", "Unknown command");
+                  (void) CKD_WRITE(sock_fd, d_cmd);
+                  dFree(d_cmd);
+                  ERRMSG("main", "Unknown command", 0);
+                  MSG_ERR(" for request: %s\n", req);
+                  break;
+                  }
+               case -1:
+                  _ERRMSG("main", "get_command failed", 0);
+                  break;
                }
-               break;
-            case BYE_CMD:
-               stop_active_dpis(dpi_attr_list, numdpis);
-               //cleanup();
-               exit(0);
-               break;
-            case CHECK_SERVER_CMD:
-               send_sockport(sock_fd, req, dpi_attr_list);
-               break;
-            case REGISTER_ALL_CMD:
-               register_all_cmd();
-               break;
-            case UNKNOWN_CMD:
-               {
-               char *d_cmd = a_Dpip_build_cmd("cmd=%s msg=%s",
-                                              "DpiError", "Unknown command");
-               (void) CKD_WRITE(sock_fd, d_cmd);
-               dFree(d_cmd);
-               ERRMSG("main", "Unknown command", 0);
-               MSG_ERR(" for request: %s\n", req);
-               break;
-               }
-            case -1:
-               _ERRMSG("main", "get_command failed", 0);
-               break;
+               if (req)
+                  free(req);
+               a_Dpip_dsh_close(sh);
+               a_Dpip_dsh_free(sh);
             }
-            if (req)
-               free(req);
-            a_Dpip_dsh_close(sh);
-            a_Dpip_dsh_free(sh);
+            continue;
          }
-      }
 
-      /* While there's a request on one of the plugin sockets
-       * find the matching plugin and start it. */
-      for (i = 0; n > 0 && i < numdpis; i++) {
-         if (FD_ISSET(dpi_attr_list[i].sock_fd, &selected_set)) {
-            --n;
-            assert(n >= 0);
-
-            if (dpi_attr_list[i].filter) {
-               /* start a dpi filter plugin and continue watching its socket
-                * for new connections */
-               (void) sigprocmask(SIG_SETMASK, &mask_none, NULL);
-               start_filter_plugin(dpi_attr_list[i]);
-            } else {
-               /* start a dpi server plugin but don't wait for new connections
-                * on its socket */
-               numsocks--;
-               assert(numsocks >= 0);
-               FD_CLR(dpi_attr_list[i].sock_fd, &sock_set);
-               if ((dpi_attr_list[i].pid = fork()) == -1) {
-                  ERRMSG("main", "fork", errno);
-                  /* exit(1); */
-               } else if (dpi_attr_list[i].pid == 0) {
-                  /* child */
+         /* If there's a request on one of the plugin sockets
+          * find the matching plugin and start it. */
+         for (i = 0; i < numdpis; i++) {
+            if (dpi_attr_list[i].sock_fd == ready[k]) {
+               if (dpi_attr_list[i].filter) {
+                  /* start a dpi filter plugin and continue watching its
+                   * socket for new connections */
                   (void) sigprocmask(SIG_SETMASK, &mask_none, NULL);
-                  start_server_plugin(dpi_attr_list[i]);
+                  start_filter_plugin(dpi_attr_list[i]);
+               } else {
+                  /* start a dpi server plugin but don't wait for new
+                   * connections on its socket */
+                  start_server(i);
                }
+               break;
             }
          }
       }
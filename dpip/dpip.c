@@ -27,6 +27,7 @@
 
 #define DPIP_TAG_END            " '>"
 #define DPIP_MODE_SWITCH_TAG    "cmd='start_send_page' "
+#define DPIP_IOV_MAX            16
 #define MSG_ERR(...)            fprintf(stderr, "[dpip]: " __VA_ARGS__)
 
 /*
@@ -232,6 +233,40 @@ int a_Dpip_check_auth(const char *auth_tag)
    return ret;
 }
 
+/*
+ * Decode the payload size from a binary frame header.
+ */
+int a_Dpip_frame_size(const char *hdr)
+{
+   const uchar_t *p = (const uchar_t *)hdr;
+
+   return (int)(((uint_t)p[0] << 24) | ((uint_t)p[1] << 16) |
+                ((uint_t)p[2] << 8) | (uint_t)p[3]);
+}
+
+/*
+ * Encode a binary frame header for a payload of 'size' bytes.
+ */
+static void Dpip_frame_hdr(char *hdr, int size)
+{
+   hdr[0] = (char)((size >> 24) & 0xff);
+   hdr[1] = (char)((size >> 16) & 0xff);
+   hdr[2] = (char)((size >> 8) & 0xff);
+   hdr[3] = (char)(size & 0xff);
+}
+
+/*
+ * Check whether a tag asks for binary framing.
+ */
+static int Dpip_tag_wants_bin(const char *tag, size_t tagsize)
+{
+   char *framing = a_Dpip_get_attr_l(tag, tagsize, "framing");
+   int ret = (framing && strcmp(framing, "bin") == 0);
+
+   dFree(framing);
+   return ret;
+}
+
 /* --------------------------------------------------------------------------
  * Dpip socket API ----------------------------------------------------------
  */
@@ -255,16 +290,30 @@ Dsh *a_Dpip_dsh_new(int fd_in, int fd_out, int flush_sz)
    if (fcntl(dsh->fd_in, F_GETFL) & O_NONBLOCK)
       dsh->mode |= DPIP_NONBLOCK;
    dsh->status = 0;
+   dsh->frame_left = 0;
 
    return dsh;
 }
 
 /*
- * Return value: 1..DataSize sent, -1 eagain, or -3 on big Error
+ * Gather-write a vector of buffers to the socket.
+ * Return value: 1..total bytes sent, -1 eagain, or -3 on big Error
  */
-static int Dpip_dsh_write(Dsh *dsh, int nb, const char *Data, int DataSize)
+static int Dpip_dsh_writev(Dsh *dsh, int nb, const struct iovec *iov,
+                           int iovcnt)
 {
-   int req_mode, old_flags = 0, st, ret = -3, sent = 0;
+   struct iovec v[DPIP_IOV_MAX];
+   int i, n, req_mode, old_flags = 0, st, ret = -3, sent = 0, total = 0;
+
+   /* work on a local copy, skipping empty buffers */
+   for (i = n = 0; i < iovcnt && n < DPIP_IOV_MAX; ++i) {
+      if (iov[i].iov_len > 0) {
+         v[n++] = iov[i];
+         total += (int)iov[i].iov_len;
+      }
+   }
+   if (total == 0)
+      return 0;
 
    req_mode = (nb) ? DPIP_NONBLOCK : 0;
    if ((dsh->mode & DPIP_NONBLOCK) != req_mode) {
@@ -274,8 +323,9 @@ static int Dpip_dsh_write(Dsh *dsh, int nb, const char *Data, int DataSize)
             (nb) ? O_NONBLOCK | old_flags : old_flags & ~O_NONBLOCK);
    }
 
+   i = 0;
    while (1) {
-      st = write(dsh->fd_out, Data + sent, DataSize - sent);
+      st = writev(dsh->fd_out, v + i, n - i);
       if (st < 0) {
          if (errno == EINTR) {
             continue;
@@ -284,16 +334,23 @@ static int Dpip_dsh_write(Dsh *dsh, int nb, const char *Data, int DataSize)
             ret = -1;
             break;
          } else {
-            MSG_ERR("[Dpip_dsh_write] %s\n", dStrerror(errno));
+            MSG_ERR("[Dpip_dsh_writev] %s\n", dStrerror(errno));
             dsh->status = DPIP_ERROR;
             break;
          }
       } else {
          sent += st;
-         if (nb || sent == DataSize) {
+         if (nb || sent == total) {
             ret = sent;
             break;
          }
+         /* advance over what was written */
+         while (st >= (int)v[i].iov_len) {
+            st -= (int)v[i].iov_len;
+            ++i;
+         }
+         v[i].iov_base = (char *)v[i].iov_base + st;
+         v[i].iov_len -= st;
       }
    }
 
@@ -306,28 +363,88 @@ static int Dpip_dsh_write(Dsh *dsh, int nb, const char *Data, int DataSize)
 }
 
 /*
- * Streamed write to socket
- * Return: 0 on success, 1 on error.
+ * Return value: 1..DataSize sent, -1 eagain, or -3 on big Error
  */
-int a_Dpip_dsh_write(Dsh *dsh, int flush, const char *Data, int DataSize)
+static int Dpip_dsh_write(Dsh *dsh, int nb, const char *Data, int DataSize)
 {
-   int ret = 1;
+   struct iovec iov;
 
-   /* append to buf */
-   dStr_append_l(dsh->wrbuf, Data, DataSize);
+   iov.iov_base = (char *)Data;
+   iov.iov_len = DataSize;
+   return Dpip_dsh_writev(dsh, nb, &iov, 1);
+}
 
-   if (!flush || dsh->wrbuf->len == 0)
+/*
+ * Append to the write buffer the data in 'iov'.
+ * (the first buffer in 'iov' must be the write buffer itself)
+ */
+static void Dpip_dsh_buffer(Dsh *dsh, const struct iovec *iov, int iovcnt)
+{
+   int i;
+
+   for (i = 1; i < iovcnt; ++i)
+      dStr_append_l(dsh->wrbuf, iov[i].iov_base, (int)iov[i].iov_len);
+}
+
+/*
+ * Streamed gather-write to socket.
+ * The buffers are sent after any pending data, without copying them
+ * when flushing. In DPIP_BIN_OUT mode they go as a single frame.
+ * Return: 0 on success, 1 on error.
+ */
+int a_Dpip_dsh_writev(Dsh *dsh, int flush, const struct iovec *iov,
+                      int iovcnt)
+{
+   struct iovec v[DPIP_IOV_MAX];
+   char hdr[DPIP_FRAME_HDR_SZ];
+   int i, n = 0, DataSize = 0, hdr_sz = 0, total, ret = 1;
+
+   dReturn_val_if_fail(iovcnt <= DPIP_IOV_MAX - 2, 1);
+
+   for (i = 0; i < iovcnt; ++i)
+      DataSize += (int)iov[i].iov_len;
+
+   v[n].iov_base = dsh->wrbuf->str;
+   v[n++].iov_len = dsh->wrbuf->len;
+   if ((dsh->mode & DPIP_BIN_OUT) && DataSize > 0) {
+      Dpip_frame_hdr(hdr, DataSize);
+      hdr_sz = DPIP_FRAME_HDR_SZ;
+      v[n].iov_base = hdr;
+      v[n++].iov_len = hdr_sz;
+   }
+   for (i = 0; i < iovcnt; ++i)
+      v[n++] = iov[i];
+   total = dsh->wrbuf->len + hdr_sz + DataSize;
+
+   if (!flush || total == 0) {
+      /* append to buf */
+      Dpip_dsh_buffer(dsh, v, n);
       return 0;
+   }
 
-   ret = Dpip_dsh_write(dsh, 0, dsh->wrbuf->str, dsh->wrbuf->len);
-   if (ret == dsh->wrbuf->len) {
+   if (Dpip_dsh_writev(dsh, 0, v, n) == total) {
       dStr_truncate(dsh->wrbuf, 0);
       ret = 0;
+   } else {
+      Dpip_dsh_buffer(dsh, v, n);
    }
 
    return ret;
 }
 
+/*
+ * Streamed write to socket
+ * Return: 0 on success, 1 on error.
+ */
+int a_Dpip_dsh_write(Dsh *dsh, int flush, const char *Data, int DataSize)
+{
+   struct iovec iov;
+
+   iov.iov_base = (char *)Data;
+   iov.iov_len = DataSize;
+   return a_Dpip_dsh_writev(dsh, flush, &iov, 1);
+}
+
 /*
  * Return value: 0 on success or empty buffer,
  *               1..DataSize sent, -1 eagain, or -3 on big Error
@@ -350,19 +467,61 @@ int a_Dpip_dsh_tryflush(Dsh *dsh)
 
 /*
  * Return value: 1..DataSize sent, -1 eagain, or -3 on big Error
+ * (in DPIP_BIN_OUT mode the count includes the frame header)
  */
 int a_Dpip_dsh_trywrite(Dsh *dsh, const char *Data, int DataSize)
 {
-   int st;
+   struct iovec v[2];
+   char hdr[DPIP_FRAME_HDR_SZ];
+   int st, sent, n = 0;
+
+   if ((dsh->mode & DPIP_BIN_OUT) && DataSize > 0) {
+      Dpip_frame_hdr(hdr, DataSize);
+      v[n].iov_base = hdr;
+      v[n++].iov_len = DPIP_FRAME_HDR_SZ;
+   }
+   v[n].iov_base = (char *)Data;
+   v[n++].iov_len = DataSize;
 
-   if ((st = Dpip_dsh_write(dsh, 1, Data, DataSize)) > 0) {
+   if ((st = Dpip_dsh_writev(dsh, 1, v, n)) > 0) {
       /* update internal buffer */
-      if (st < DataSize)
-         dStr_append_l(dsh->wrbuf, Data + st, DataSize - st);
+      sent = st;
+      if (n == 2) {
+         if (st < DPIP_FRAME_HDR_SZ)
+            dStr_append_l(dsh->wrbuf, hdr + st, DPIP_FRAME_HDR_SZ - st);
+         sent = MAX(st - DPIP_FRAME_HDR_SZ, 0);
+      }
+      if (sent < DataSize)
+         dStr_append_l(dsh->wrbuf, Data + sent, DataSize - sent);
    }
    return st;
 }
 
+/*
+ * Start the answer to an "open_url" request.
+ * If the peer asked for it, binary framing is negotiated here and
+ * every write that follows goes as a frame.
+ * Return: 0 on success, 1 on error.
+ */
+int a_Dpip_dsh_start_send_page(Dsh *dsh, int flush, const char *url)
+{
+   char *d_cmd;
+   int ret;
+
+   if (dsh->mode & DPIP_BIN_OK) {
+      d_cmd = a_Dpip_build_cmd("cmd=%s url=%s framing=%s",
+                               "start_send_page", url, "bin");
+   } else {
+      d_cmd = a_Dpip_build_cmd("cmd=%s url=%s", "start_send_page", url);
+   }
+   ret = a_Dpip_dsh_write_str(dsh, flush, d_cmd);
+   dFree(d_cmd);
+   if (dsh->mode & DPIP_BIN_OK)
+      dsh->mode |= DPIP_BIN_OUT;
+
+   return ret;
+}
+
 /*
  * Convenience function.
  */
@@ -425,6 +584,75 @@ static void Dpip_dsh_read(Dsh *dsh, int blocking)
       Dpip_dsh_read(dsh, 0);
 }
 
+/*
+ * Read straight from the socket into 'Buf' in
+ * either BLOCKING or NONBLOCKING mode.
+ * Return value: 1..BufSize read, 0 on EOF, -1 eagain, or -3 on big Error
+ */
+static int Dpip_dsh_read_fd(Dsh *dsh, int blocking, char *Buf, int BufSize)
+{
+   int req_mode, old_flags = 0, st, ret, nb = !blocking;
+
+   req_mode = (nb) ? DPIP_NONBLOCK : 0;
+   if ((dsh->mode & DPIP_NONBLOCK) != req_mode) {
+      /* change mode temporarily... */
+      old_flags = fcntl(dsh->fd_in, F_GETFL);
+      fcntl(dsh->fd_in, F_SETFL,
+            (nb) ? O_NONBLOCK | old_flags : old_flags & ~O_NONBLOCK);
+   }
+
+   do {
+      st = read(dsh->fd_in, Buf, BufSize);
+   } while (st < 0 && errno == EINTR);
+
+   if (st < 0) {
+      if (errno == EAGAIN) {
+         dsh->status = DPIP_EAGAIN;
+         ret = -1;
+      } else {
+         MSG_ERR("[Dpip_dsh_read_fd] %s\n", dStrerror(errno));
+         dsh->status = DPIP_ERROR;
+         ret = -3;
+      }
+   } else {
+      if (st == 0)
+         dsh->status = DPIP_EOF;
+      ret = st;
+   }
+
+   if ((dsh->mode & DPIP_NONBLOCK) != req_mode) {
+      /* restore old mode */
+      fcntl(dsh->fd_in, F_SETFL, old_flags);
+   }
+
+   return ret;
+}
+
+/*
+ * Parse the binary frame headers at the start of the read buffer.
+ * Return value: the number of payload bytes ready in the read buffer.
+ */
+static int Dpip_dsh_frame_avail(Dsh *dsh)
+{
+   while (dsh->frame_left == 0 && dsh->rdbuf->len >= DPIP_FRAME_HDR_SZ) {
+      dsh->frame_left = a_Dpip_frame_size(dsh->rdbuf->str);
+      dStr_erase(dsh->rdbuf, 0, DPIP_FRAME_HDR_SZ);
+   }
+   return MIN(dsh->frame_left, dsh->rdbuf->len);
+}
+
+/*
+ * Switch to the data mode requested by the last tag.
+ */
+static void Dpip_dsh_switch_mode(Dsh *dsh)
+{
+   if (dsh->mode & DPIP_LAST_TAG) {
+      dsh->mode = (dsh->mode & (DPIP_BIN_OK | DPIP_BIN_OUT)) |
+                  ((dsh->mode & DPIP_BIN_NEXT) ? DPIP_BIN : DPIP_RAW);
+      dsh->frame_left = 0;
+   }
+}
+
 /*
  * Return a newlly allocated string with the next dpip token in the socket.
  * Return value: token string and length on success, NULL otherwise.
@@ -439,8 +667,7 @@ char *a_Dpip_dsh_read_token2(Dsh *dsh, int blocking, int *DataSize)
    Dpip_dsh_read(dsh, 0);
 
    /* switch mode upon request */
-   if (dsh->mode & DPIP_LAST_TAG)
-      dsh->mode = DPIP_RAW;
+   Dpip_dsh_switch_mode(dsh);
 
    if (blocking) {
       if (dsh->mode & DPIP_TAG) {
@@ -457,6 +684,12 @@ char *a_Dpip_dsh_read_token2(Dsh *dsh, int blocking, int *DataSize)
          while (dsh->rdbuf->len == 0 &&
                 dsh->status != DPIP_ERROR && dsh->status != DPIP_EOF)
             Dpip_dsh_read(dsh, 1);
+
+      } else if (dsh->mode & DPIP_BIN) {
+         /* Wait for payload when there's none and no ERR/EOF */
+         while (Dpip_dsh_frame_avail(dsh) == 0 &&
+                dsh->status != DPIP_ERROR && dsh->status != DPIP_EOF)
+            Dpip_dsh_read(dsh, 1);
       }
    }
 
@@ -466,8 +699,22 @@ char *a_Dpip_dsh_read_token2(Dsh *dsh, int blocking, int *DataSize)
          ret = dStrndup(dsh->rdbuf->str, p - dsh->rdbuf->str + 3);
          *DataSize = p - dsh->rdbuf->str + 3;
          dStr_erase(dsh->rdbuf, 0, p - dsh->rdbuf->str + 3);
-         if (strstr(ret, DPIP_MODE_SWITCH_TAG))
+         if (strstr(ret, DPIP_MODE_SWITCH_TAG)) {
             dsh->mode |= DPIP_LAST_TAG;
+            if (Dpip_tag_wants_bin(ret, *DataSize))
+               dsh->mode |= DPIP_BIN_NEXT;
+         } else if (Dpip_tag_wants_bin(ret, *DataSize)) {
+            dsh->mode |= DPIP_BIN_OK;
+         }
+      }
+   } else if (dsh->mode & DPIP_BIN) {
+      /* binary mode, return the payload we have from the current frame */
+      int n = Dpip_dsh_frame_avail(dsh);
+      if (n > 0) {
+         ret = dStrndup(dsh->rdbuf->str, n);
+         *DataSize = n;
+         dStr_erase(dsh->rdbuf, 0, n);
+         dsh->frame_left -= n;
       }
    } else {
       /* raw mode, return what we have "as is" */
@@ -492,6 +739,55 @@ char *a_Dpip_dsh_read_token(Dsh *dsh, int blocking)
    return a_Dpip_dsh_read_token2(dsh, blocking, &token_size);
 }
 
+/*
+ * Read data into the caller's buffer (for DPIP_RAW and DPIP_BIN modes).
+ * Buffered bytes are handed out first, then payload is read from the
+ * socket straight into 'Buf'. Frame headers are stripped.
+ * Return value: 1..BufSize read, 0 on EOF/error, -1 eagain.
+ */
+int a_Dpip_dsh_read_frame(Dsh *dsh, int blocking, char *Buf, int BufSize)
+{
+   char hdr[DPIP_FRAME_HDR_SZ];
+   int n, st, bin;
+
+   dReturn_val_if_fail(BufSize > 0, 0);
+
+   Dpip_dsh_switch_mode(dsh);
+   dReturn_val_if_fail(dsh->mode & (DPIP_RAW | DPIP_BIN), 0);
+   bin = dsh->mode & DPIP_BIN;
+
+   while (1) {
+      n = (bin) ? Dpip_dsh_frame_avail(dsh) : dsh->rdbuf->len;
+      if (n > 0) {
+         n = MIN(n, BufSize);
+         memcpy(Buf, dsh->rdbuf->str, n);
+         dStr_erase(dsh->rdbuf, 0, n);
+         if (bin)
+            dsh->frame_left -= n;
+         return n;
+      }
+      if (dsh->status == DPIP_ERROR || dsh->status == DPIP_EOF)
+         return 0;
+
+      if (bin && dsh->frame_left == 0) {
+         /* get the (rest of the) next frame header */
+         st = Dpip_dsh_read_fd(dsh, blocking, hdr,
+                               DPIP_FRAME_HDR_SZ - dsh->rdbuf->len);
+         if (st > 0)
+            dStr_append_l(dsh->rdbuf, hdr, st);
+      } else {
+         n = (bin) ? MIN(BufSize, dsh->frame_left) : BufSize;
+         if ((st = Dpip_dsh_read_fd(dsh, blocking, Buf, n)) > 0) {
+            if (bin)
+               dsh->frame_left -= st;
+            return st;
+         }
+      }
+      if (st == -1)
+         return -1;
+   }
+}
+
 /*
  * Close this socket for reading and writing.
  * (flush pending data)
@@ -9,6 +9,8 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <sys/uio.h>   /* for struct iovec */
+
 #include "../dlib/dlib.h"
 
 /*
@@ -18,6 +20,17 @@ extern "C" {
 #define   DPIP_LAST_TAG   2   /* Dpip mode-switching tag */
 #define   DPIP_RAW        4   /* Raw data in the socket  */
 #define   DPIP_NONBLOCK   8   /* Nonblocking IO          */
+#define   DPIP_BIN       16   /* Length-prefixed binary frames in the socket */
+#define   DPIP_BIN_NEXT  32   /* Mode-switching tag requested binary frames */
+#define   DPIP_BIN_OK    64   /* The peer accepts binary frames from us  */
+#define   DPIP_BIN_OUT  128   /* We're writing binary frames             */
+
+/*
+ * Binary framing: after a "start_send_page" tag carrying framing='bin',
+ * data comes as frames of a 4-byte big-endian payload size followed by
+ * the payload. Control messages always use text tags.
+ */
+#define   DPIP_FRAME_HDR_SZ  4
 
 typedef enum {
    DPIP_EAGAIN,
@@ -38,8 +51,9 @@ typedef struct {
    Dstr *rdbuf;    /* read buffer */
    int flush_sz;   /* max size before flush */
 
-   int mode;       /* mode flags: DPIP_TAG | DPIP_LAST_TAG | DPIP_RAW */
+   int mode;       /* mode flags: DPIP_TAG | DPIP_LAST_TAG | DPIP_RAW ... */
    int status;     /* status code: DPIP_EAGAIN | DPIP_ERROR | DPIP_EOF */
+   int frame_left; /* payload bytes left in the current input frame */
 } Dsh;
 
 
@@ -61,16 +75,22 @@ char *a_Dpip_get_attr_l(const char *tag, size_t tagsize, const char *attrname);
 
 int a_Dpip_check_auth(const char *auth);
 
+int a_Dpip_frame_size(const char *hdr);
+
 /*
  * Dpip socket API
  */
 Dsh *a_Dpip_dsh_new(int fd_in, int fd_out, int flush_sz);
 int a_Dpip_dsh_write(Dsh *dsh, int flush, const char *Data, int DataSize);
 int a_Dpip_dsh_write_str(Dsh *dsh, int flush, const char *str);
+int a_Dpip_dsh_writev(Dsh *dsh, int flush, const struct iovec *iov,
+                      int iovcnt);
+int a_Dpip_dsh_start_send_page(Dsh *dsh, int flush, const char *url);
 int a_Dpip_dsh_tryflush(Dsh *dsh);
 int a_Dpip_dsh_trywrite(Dsh *dsh, const char *Data, int DataSize);
 char *a_Dpip_dsh_read_token(Dsh *dsh, int blocking);
 char *a_Dpip_dsh_read_token2(Dsh *dsh, int blocking, int *DataSize);
+int a_Dpip_dsh_read_frame(Dsh *dsh, int blocking, char *Buf, int BufSize);
 void a_Dpip_dsh_close(Dsh *dsh);
 void a_Dpip_dsh_free(Dsh *dsh);
 
@@ -40,7 +40,10 @@ const enum ScaleMode { SIMPLE, BEAUTIFUL, BEAUTIFUL_GAMMA }
 Vector <FltkImgbuf::GammaCorrectionTable> *FltkImgbuf::gammaCorrectionTables
    = new Vector <FltkImgbuf::GammaCorrectionTable> (true, 2);
 
-uchar *FltkImgbuf::findGammaCorrectionTable (double gamma)
+unsigned long FltkImgbuf::drawStamp = 0;
+
+FltkImgbuf::GammaCorrectionTable *FltkImgbuf::findGammaCorrectionTable
+   (double gamma)
 {
    // Since the number of possible keys is low, a linear search is
    // sufficiently fast.
@@ -48,7 +51,7 @@ uchar *FltkImgbuf::findGammaCorrectionTable (double gamma)
    for (int i = 0; i < gammaCorrectionTables->size(); i++) {
       GammaCorrectionTable *gct = gammaCorrectionTables->get(i);
       if (gct->gamma == gamma)
-         return gct->map;
+         return gct;
    }
 
    _MSG("Creating new table for gamma = %g\n", gamma);
@@ -56,11 +59,15 @@ uchar *FltkImgbuf::findGammaCorrectionTable (double gamma)
    GammaCorrectionTable *gct = new GammaCorrectionTable();
    gct->gamma = gamma;
 
+   // Averaging is done in 16 bit linear light, so that dark values are
+   // not lost on the way, as they would be with an 8 bit linear value.
    for (int i = 0; i < 256; i++)
-      gct->map[i] = 255 * pow((double)i / 255, gamma);
+      gct->toLinear[i] = 65535 * pow((double)i / 255, 1 / gamma) + 0.5;
+   for (int i = 0; i < 65536; i++)
+      gct->fromLinear[i] = 255 * pow((double)i / 65535, gamma) + 0.5;
 
    gammaCorrectionTables->put (gct);
-   return gct->map;
+   return gct;
 }
 
 bool FltkImgbuf::excessiveImageDimensions (int width, int height)
@@ -141,9 +148,21 @@ void FltkImgbuf::init (Type type, int width, int height, double gamma,
       // Set light-gray as interim background color.
       memset(rawdata, 222, width*height*bpp);
 
+      // Indexed images are stored as such; until the colormap arrives,
+      // indexes are shown as gray values.
+      if (type == INDEXED) {
+         cmap = new uchar[4 * 256];
+         for (int i = 0; i < 256; i++) {
+            cmap[4 * i] = cmap[4 * i + 1] = cmap[4 * i + 2] = i;
+            cmap[4 * i + 3] = 0;
+         }
+      } else
+         cmap = NULL;
+
       refCount = 1;
       deleteOnUnref = true;
       copiedRows = new lout::misc::BitSet (height);
+      lastDrawn = 0;
 
       DBG_IF_RTFL {
          lout::misc::StringBuffer sb;
@@ -175,6 +194,7 @@ FltkImgbuf::~FltkImgbuf ()
       root->detachScaledBuf (this);
 
    delete[] rawdata;
+   delete[] cmap;
    delete copiedRows;
 
    if (scaledBuffers)
@@ -201,17 +221,90 @@ void FltkImgbuf::detachScaledBuf (FltkImgbuf *scaledBuf)
       delete this;
 }
 
+/**
+ * \brief Scaled buffers only: allocate the pixel data again after
+ *    releaseScaled(), and scale the rows the root buffer already has.
+ */
+void FltkImgbuf::restoreScaled ()
+{
+   rawdata = new uchar[bpp * width * height];
+   memset(rawdata, 222, width*height*bpp);
+   copiedRows->clear ();
+
+   for (int row = 0; row < root->height; row++) {
+      if (root->copiedRows->get (row))
+         scaleRow (row, root->rawdata + row*root->width*root->bpp);
+   }
+}
+
 void FltkImgbuf::setCMap (int *colors, int num_colors)
 {
+   if (cmap == NULL)
+      return;
+
+   for (int i = 0; i < num_colors && i < 256; i++) {
+      cmap[4 * i]     = (colors[i] >> 16) & 0xff;
+      cmap[4 * i + 1] = (colors[i] >> 8) & 0xff;
+      cmap[4 * i + 2] = colors[i] & 0xff;
+   }
+
+   // The scaled buffers hold RGB, so rows already there are done again.
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); ) {
+      FltkImgbuf *sb = it.getNext ();
+      sb->copiedRows->clear ();
+      for (int row = 0; row < height; row++)
+         if (copiedRows->get (row))
+            sb->scaleRow (row, rawdata + row * width);
+   }
+}
+
+/**
+ * Expand n pixels of an indexed buffer into red, green, blue.
+ *
+ * Colormap entries are four bytes wide, so each pixel is a single
+ * (unaligned) 32 bit copy, whose fourth byte is then overwritten by the
+ * next pixel. Only the last pixel is copied byte by byte, since 'dest'
+ * holds exactly 3 * n bytes.
+ */
+inline void FltkImgbuf::expandIndexed (const core::byte *src,
+                                       core::byte *dest, int n)
+{
+   int i = 0;
+
+   for (; i + 4 < n; i += 4) {
+      memcpy (dest + 3 * i, cmap + 4 * src[i], 4);
+      memcpy (dest + 3 * i + 3, cmap + 4 * src[i + 1], 4);
+      memcpy (dest + 3 * i + 6, cmap + 4 * src[i + 2], 4);
+      memcpy (dest + 3 * i + 9, cmap + 4 * src[i + 3], 4);
+   }
+   for (; i < n - 1; i++)
+      memcpy (dest + 3 * i, cmap + 4 * src[i], 4);
+   if (i < n) {
+      const uchar *c = cmap + 4 * src[i];
+      dest[3 * i] = c[0];
+      dest[3 * i + 1] = c[1];
+      dest[3 * i + 2] = c[2];
+   }
 }
 
 inline void FltkImgbuf::scaleRow (int row, const core::byte *data)
 {
-   if (row < root->height) {
+   // Released buffers are scaled as a whole when drawn again.
+   if (row < root->height && rawdata) {
+      core::byte *expanded = NULL;
+
+      if (root->type == INDEXED) {
+         expanded = new core::byte[3 * root->width];
+         root->expandIndexed (data, expanded, root->width);
+         data = expanded;
+      }
+
       if (scaleMode == SIMPLE)
          scaleRowSimple (row, data);
       else
          scaleRowBeautiful (row, data);
+
+      delete[] expanded;
    }
 }
 
@@ -276,10 +369,20 @@ inline void FltkImgbuf::scaleRowBeautiful (int row, const core::byte *data)
       // a larger area than a single row may be accessed here.
       for (int r=row1; (allRootRows=root->copiedRows->get(r)) && ++r < row2; );
       if (allRootRows) {
-         scaleBuffer (root->rawdata + row1 * root->width * bpp,
-                      root->width, row2 - row1,
+         const core::byte *src =
+            root->rawdata + row1 * root->width * root->bpp;
+         core::byte *expanded = NULL;
+
+         if (root->type == INDEXED) {
+            int n = root->width * (row2 - row1);
+            expanded = new core::byte[3 * n];
+            root->expandIndexed (src, expanded, n);
+            src = expanded;
+         }
+         scaleBuffer (src, root->width, row2 - row1,
                       rawdata + sr1 * width * bpp, width, 1,
                       bpp, gamma);
+         delete[] expanded;
          // Mark scaled row done
          copiedRows->set (sr1, true);
 
@@ -303,52 +406,100 @@ inline void FltkImgbuf::scaleRowBeautiful (int row, const core::byte *data)
  * average of all pixel values. This is pretty fast and leads to
  * rather good results.
  *
- * Nothing special (like interpolation) is done when scaling up.
+ * The box filter is separable: the source rows of a destination row
+ * are summed up once into a row of column sums, and then the (precomputed)
+ * column spans are summed up for each destination pixel. This way, each
+ * source pixel is read once, instead of once per destination pixel
+ * covering it, and no division is done in the inner loops. The loops are
+ * kept simple enough for the compiler to vectorize.
+ *
+ * Nothing special (like interpolation) is done when scaling up: when a
+ * destination pixel covers a single source pixel, it is just copied, and
+ * destination rows covering the same source rows are copied from the
+ * previous one.
  *
  * If scaleMode is set to BEAUTIFUL_GAMMA, gamma correction is
  * considered, see <http://www.4p8.com/eric.brasseur/gamma.html>.
- *
- * TODO Could be optimized as in scaleRowSimple: when the destination
- * image is larger, calculate only one row/column, and copy it to the
- * other rows/columns.
+ * Sums are done in 16 bit linear light in both modes.
  */
 inline void FltkImgbuf::scaleBuffer (const core::byte *src, int srcWidth,
                                      int srcHeight, core::byte *dest,
                                      int destWidth, int destHeight, int bpp,
                                      double gamma)
 {
-   uchar *gammaMap1, *gammaMap2;
-
-   if (scaleMode == BEAUTIFUL_GAMMA) {
-      gammaMap1 = findGammaCorrectionTable (gamma);
-      gammaMap2 = findGammaCorrectionTable (1 / gamma);
+   GammaCorrectionTable *gct =
+      findGammaCorrectionTable (scaleMode == BEAUTIFUL_GAMMA ? gamma : 1);
+   const unsigned short *toLinear = gct->toLinear;
+   const uchar *fromLinear = gct->fromLinear;
+   int rowLen = srcWidth * bpp;
+
+   // Column spans: destination pixel x covers [xo[x], xo[x + 1]) in the
+   // source, but at least one pixel.
+   int *xo1 = new int[2 * destWidth], *xo2 = xo1 + destWidth;
+   bool oneToOne = true;
+   for (int x = 0; x < destWidth; x++) {
+      xo1[x] = x * srcWidth / destWidth;
+      xo2[x] = lout::misc::max ((x + 1) * srcWidth / destWidth, xo1[x] + 1);
+      oneToOne = oneToOne && xo2[x] == xo1[x] + 1;
    }
 
-   for(int x = 0; x < destWidth; x++)
-      for(int y = 0; y < destHeight; y++) {
-         int xo1 = x * srcWidth / destWidth;
-         int xo2 = lout::misc::max ((x + 1) * srcWidth / destWidth, xo1 + 1);
-         int yo1 = y * srcHeight / destHeight;
-         int yo2 = lout::misc::max ((y + 1) * srcHeight / destHeight, yo1 + 1);
-         int n = (xo2 - xo1) * (yo2 - yo1);
-
-         int v[bpp];
-         for(int i = 0; i < bpp; i++)
-            v[i] = 0;
-
-         for(int xo = xo1; xo < xo2; xo++)
-            for(int yo = yo1; yo < yo2; yo++) {
-               const core::byte *ps = src + bpp * (yo * srcWidth + xo);
-               for(int i = 0; i < bpp; i++)
-                  v[i] +=
-                     (scaleMode == BEAUTIFUL_GAMMA ? gammaMap2[ps[i]] : ps[i]);
-            }
+   unsigned int *colSum = NULL;
+   int prevYo1 = -1, prevYo2 = -1;
+
+   for (int y = 0; y < destHeight; y++) {
+      int yo1 = y * srcHeight / destHeight;
+      int yo2 = lout::misc::max ((y + 1) * srcHeight / destHeight, yo1 + 1);
+      core::byte *pd = dest + y * destWidth * bpp;
+
+      if (yo1 == prevYo1 && yo2 == prevYo2) {
+         // Scaling up: same source rows as the previous destination row.
+         memcpy (pd, pd - destWidth * bpp, destWidth * bpp);
+         continue;
+      }
+      prevYo1 = yo1;
+      prevYo2 = yo2;
+
+      if (oneToOne && yo2 == yo1 + 1) {
+         // Every pixel is a copy of a single source pixel.
+         const core::byte *ps = src + yo1 * rowLen;
+         for (int x = 0; x < destWidth; x++)
+            memcpy (pd + x * bpp, ps + xo1[x] * bpp, bpp);
+         continue;
+      }
+
+      // Vertical pass: sum up the source rows, in linear light.
+      if (colSum == NULL)
+         colSum = new unsigned int[rowLen];
+      const core::byte *ps = src + yo1 * rowLen;
+      for (int i = 0; i < rowLen; i++)
+         colSum[i] = toLinear[ps[i]];
+      for (int yo = yo1 + 1; yo < yo2; yo++) {
+         ps = src + yo * rowLen;
+         for (int i = 0; i < rowLen; i++)
+            colSum[i] += toLinear[ps[i]];
+      }
 
-         core::byte *pd = dest + bpp * (y * destWidth + x);
-         for(int i = 0; i < bpp; i++)
-            pd[i] =
-               scaleMode == BEAUTIFUL_GAMMA ? gammaMap1[v[i] / n] : v[i] / n;
+      // Horizontal pass: sum up the column spans.
+      int dy = yo2 - yo1;
+      for (int x = 0; x < destWidth; x++) {
+         const unsigned int *cs = colSum + xo1[x] * bpp;
+         unsigned int n = (xo2[x] - xo1[x]) * dy;
+         if (n == 1) {
+            // Don't take a single pixel through linear light and back.
+            memcpy (pd + x * bpp, src + yo1 * rowLen + xo1[x] * bpp, bpp);
+            continue;
+         }
+         for (int i = 0; i < bpp; i++) {
+            unsigned long long v = 0;
+            for (int xo = xo1[x]; xo < xo2[x]; xo++)
+               v += cs[(xo - xo1[x]) * bpp + i];
+            pd[x * bpp + i] = fromLinear[(v + n / 2) / n];
+         }
       }
+   }
+
+   delete[] colSum;
+   delete[] xo1;
 }
 
 void FltkImgbuf::copyRow (int row, const core::byte *data)
@@ -431,13 +582,54 @@ core::Imgbuf* FltkImgbuf::getScaledBuf (int width, int height)
    }
 
    // This size is not yet used, so a new buffer has to be created.
-   FltkImgbuf *sb = new FltkImgbuf (type, width, height, gamma, this);
+   // Indexes can't be averaged, so scaled buffers of indexed images
+   // hold RGB.
+   FltkImgbuf *sb = new FltkImgbuf (type == INDEXED ? RGB : type,
+                                    width, height, gamma, this);
    scaledBuffers->append (sb);
    DBG_OBJ_ASSOC_CHILD (sb);
 
    return sb;
 }
 
+int FltkImgbuf::getScaledSize ()
+{
+   int size = 0;
+
+   assert (isRoot());
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); ) {
+      FltkImgbuf *sb = it.getNext ();
+      if (sb->rawdata)
+         size += sb->bpp * sb->width * sb->height;
+   }
+   return size;
+}
+
+unsigned long FltkImgbuf::getLastDrawn ()
+{
+   assert (isRoot());
+   return lastDrawn;
+}
+
+int FltkImgbuf::releaseScaled ()
+{
+   int size = 0;
+
+   assert (isRoot());
+   for (Iterator <FltkImgbuf> it = scaledBuffers->iterator(); it.hasNext(); ) {
+      FltkImgbuf *sb = it.getNext ();
+      if (sb->rawdata) {
+         size += sb->bpp * sb->width * sb->height;
+         delete[] sb->rawdata;
+         sb->rawdata = NULL;
+         sb->copiedRows->clear ();
+      }
+   }
+   _MSG("FltkImgbuf[root %p]: released %d bytes of scaled buffers\n",
+        this, size);
+   return size;
+}
+
 void FltkImgbuf::getRowArea (int row, dw::core::Rectangle *area)
 {
    // TODO: May have to be adjusted.
@@ -480,14 +672,15 @@ int FltkImgbuf::getRootHeight ()
 
 core::Imgbuf *FltkImgbuf::createSimilarBuf (int width, int height)
 {
-   return new FltkImgbuf (type, width, height, gamma);
+   // The colormap may still change, so copies of indexed images are RGB.
+   return new FltkImgbuf (type == INDEXED ? RGB : type, width, height, gamma);
 }
 
 void FltkImgbuf::copyTo (Imgbuf *dest, int xDestRoot, int yDestRoot,
                          int xSrc, int ySrc, int widthSrc, int heightSrc)
 {
    FltkImgbuf *fDest = (FltkImgbuf*)dest;
-   assert (bpp == fDest->bpp);
+   assert (bpp == fDest->bpp || (type == INDEXED && fDest->type == RGB));
 
    int xSrc2 = lout::misc::min (xSrc + widthSrc, fDest->width - xDestRoot);
    int ySrc2 = lout::misc::min (ySrc + heightSrc, fDest->height - yDestRoot);
@@ -504,8 +697,11 @@ void FltkImgbuf::copyTo (Imgbuf *dest, int xDestRoot, int yDestRoot,
 
          //printf ("   (%d, %d): %d -> %d\n", x, y, iSrc, iDest);
 
-         for (int b = 0; b < bpp; b++)
-            fDest->rawdata[bpp * iDest + b] = rawdata[bpp * iSrc + b];
+         if (type == INDEXED)
+            expandIndexed (rawdata + iSrc, fDest->rawdata + 3 * iDest, 1);
+         else
+            for (int b = 0; b < bpp; b++)
+               fDest->rawdata[bpp * iDest + b] = rawdata[bpp * iSrc + b];
       }
 }
 
@@ -581,6 +777,22 @@ int FltkImgbuf::backscaledY(int yScaled)
    return yScaled * root->height / height;
 }
 
+struct DrawIndexedData {
+   FltkImgbuf *imgbuf;
+   int x, y;
+};
+
+/**
+ * Callback for fl_draw_image: expand a line of an indexed buffer.
+ */
+void FltkImgbuf::drawIndexedLine (void *data, int x, int y, int w, uchar *buf)
+{
+   DrawIndexedData *d = (DrawIndexedData*)data;
+   FltkImgbuf *ib = d->imgbuf;
+
+   ib->expandIndexed (ib->rawdata + (d->y + y) * ib->width + d->x + x, buf, w);
+}
+
 void FltkImgbuf::draw (Fl_Widget *target, int xRoot, int yRoot,
                        int x, int y, int width, int height)
 {
@@ -603,8 +815,20 @@ void FltkImgbuf::draw (Fl_Widget *target, int xRoot, int yRoot,
       height = this->height - y;
    }
 
-   fl_draw_image(rawdata+bpp*(y*this->width + x), xRoot + x, yRoot + y, width,
-                 height, bpp, this->width * bpp);
+   (isRoot() ? this : root)->lastDrawn = ++drawStamp;
+   if (rawdata == NULL)
+      restoreScaled ();
+
+   if (type == INDEXED) {
+      // Only the lines actually drawn are expanded.
+      DrawIndexedData d = { this, x, y };
+      fl_draw_image(drawIndexedLine, &d, xRoot + x, yRoot + y, width, height,
+                    3);
+   } else {
+      // (GRAY is drawn as such, with bpp == 1)
+      fl_draw_image(rawdata+bpp*(y*this->width + x), xRoot + x, yRoot + y,
+                    width, height, bpp, this->width * bpp);
+   }
 
 }
 
@@ -15,7 +15,8 @@ private:
    {
    public:
       double gamma;
-      uchar map[256];
+      unsigned short toLinear[256];  // 8 bit gamma encoded -> 16 bit linear
+      uchar fromLinear[65536];       // and back
    };
 
    FltkImgbuf *root;
@@ -30,16 +31,20 @@ private:
 //{
    int bpp;
    uchar *rawdata;
+   uchar *cmap;   // INDEXED root buffers: 256 x red, green, blue, (unused)
 //}
 
    // This is just for testing drawing, it has to be replaced by
    // the image buffer.
    lout::misc::BitSet *copiedRows;
 
+   unsigned long lastDrawn;      // root buffers: see getLastDrawn()
+   static unsigned long drawStamp;
+
    static lout::container::typed::Vector <GammaCorrectionTable>
       *gammaCorrectionTables;
 
-   static uchar *findGammaCorrectionTable (double gamma);
+   static GammaCorrectionTable *findGammaCorrectionTable (double gamma);
    static bool excessiveImageDimensions (int width, int height);
 
    FltkImgbuf (Type type, int width, int height, double gamma,
@@ -49,6 +54,9 @@ private:
    int backscaledY(int yScaled);
    int isRoot() { return (root == NULL); }
    void detachScaledBuf (FltkImgbuf *scaledBuf);
+   void restoreScaled ();
+   inline void expandIndexed (const core::byte *src, core::byte *dest, int n);
+   static void drawIndexedLine (void *data, int x, int y, int w, uchar *buf);
 
 protected:
    ~FltkImgbuf ();
@@ -73,6 +81,9 @@ public:
    void getRowArea (int row, dw::core::Rectangle *area);
    int  getRootWidth ();
    int  getRootHeight ();
+   int getScaledSize ();
+   unsigned long getLastDrawn ();
+   int releaseScaled ();
    core::Imgbuf *createSimilarBuf (int width, int height);
    void copyTo (Imgbuf *dest, int xDestRoot, int yDestRoot,
                 int xSrc, int ySrc, int widthSrc, int heightSrc);
@@ -522,6 +522,20 @@ void Image::drawRow (int row)
                      area.height);
 }
 
+void Image::drawRows (int firstRow, int lastRow)
+{
+   core::Rectangle first, last;
+
+   assert (buffer != NULL);
+
+   // The rows are consecutive, so the union of their areas is one area.
+   buffer->getRowArea (firstRow, &first);
+   buffer->getRowArea (lastRow, &last);
+   if (first.width && last.y + last.height > first.y)
+      queueDrawArea (first.x + boxOffsetX (), first.y + boxOffsetY (),
+                     first.width, last.y + last.height - first.y);
+}
+
 void Image::finish ()
 {
    // Nothing to do; images are always drawn line by line.
@@ -164,6 +164,7 @@ public:
    void setBuffer (core::Imgbuf *buffer, bool resize = false);
 
    void drawRow (int row);
+   void drawRows (int firstRow, int lastRow);
 
    void finish ();
    void fatal ();
@@ -46,11 +46,15 @@ namespace core {
  * </table>
  *
  * The last two types need a colormap, which is set by
- * dw::core::Imgbuf::setCMap, which must be called before
+ * dw::core::Imgbuf::setCMap, which should be called before
  * dw::core::Imgbuf::copyRow. This function expects the colors as 32 bit
- * unsigned integers, which have the format 0xrrbbgg (for indexed
+ * unsigned integers, which have the format 0xrrggbb (for indexed
  * images), or 0xaarrggbb (for indexed alpha), respectively.
  *
+ * GRAY and INDEXED data is kept at one byte per pixel, and only expanded
+ * when drawn. Since indexes can't be averaged, the scaled buffers of an
+ * INDEXED root buffer hold RGB.
+ *
  *
  * <h3>Scaling</h3>
  *
@@ -191,6 +195,30 @@ public:
    virtual int getRootHeight () = 0;
 
 
+   /*
+    * Memory management (called for root buffers)
+    */
+
+   /**
+    * \brief Bytes of pixel data held by the scaled buffers of this image.
+    */
+   virtual int getScaledSize () = 0;
+
+   /**
+    * \brief When the image (at any size) was last drawn; larger values
+    *    are more recent.
+    */
+   virtual unsigned long getLastDrawn () = 0;
+
+   /**
+    * \brief Free the pixel data of the scaled buffers, and return the
+    *    number of bytes freed.
+    *
+    * The buffers themselves stay valid; their rows are scaled again from
+    * the root buffer when they are drawn next time.
+    */
+   virtual int releaseScaled () = 0;
+
    /**
     * Creates an image buffer with same parameters (type, gamma etc.)
     * except size.
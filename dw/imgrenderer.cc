@@ -43,6 +43,14 @@ void ImgRendererDist::drawRow (int row)
    }
 }
 
+void ImgRendererDist::drawRows (int firstRow, int lastRow)
+{
+   for (typed::Iterator <TypedPointer <ImgRenderer> > it =
+           children->iterator (); it.hasNext (); ) {
+      TypedPointer <ImgRenderer> *tp = it.getNext ();
+      tp->getTypedValue()->drawRows (firstRow, lastRow);
+   }
+}
 
 void ImgRendererDist::finish ()
 {
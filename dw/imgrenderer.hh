@@ -33,6 +33,16 @@ public:
     */
    virtual void drawRow (int row) = 0;
 
+   /**
+    * \brief Called, when data from the rows \em firstRow to \em lastRow
+    *    (inclusive) is available, instead of calling "drawRow" for each.
+    *
+    * The implementation may queue a single area for drawing; by default,
+    * "drawRow" is called for every row.
+    */
+   virtual void drawRows (int firstRow, int lastRow)
+   { for (int row = firstRow; row <= lastRow; row++) drawRow (row); }
+
    /**
     * \brief Called, when all image data has been retrieved.
     *
@@ -69,6 +79,7 @@ public:
 
    void setBuffer (core::Imgbuf *buffer, bool resize);
    void drawRow (int row);
+   void drawRows (int firstRow, int lastRow);
    void finish ();
    void fatal ();
 
@@ -49,6 +49,12 @@ public:
    public:
       virtual void resizeQueued (bool extremesChanged);
       virtual void canvasSizeChanged (int width, int ascent, int descent);
+
+      /**
+       * \brief Called, when the visible part of the canvas has changed,
+       *    by scrolling or by resizing the viewport.
+       */
+      virtual void viewportChanged (int x, int y, int width, int height);
    };
 
    class LinkReceiver: public lout::signal::Receiver
@@ -127,7 +133,7 @@ private:
    class Emitter: public lout::signal::Emitter
    {
    private:
-      enum { RESIZE_QUEUED, CANVAS_SIZE_CHANGED };
+      enum { RESIZE_QUEUED, CANVAS_SIZE_CHANGED, VIEWPORT_CHANGED };
 
    protected:
       bool emitToReceiver (lout::signal::Receiver *receiver, int signalNo,
@@ -138,6 +144,7 @@ private:
 
       void emitResizeQueued (bool extremesChanged);
       void emitCanvasSizeChanged (int width, int ascent, int descent);
+      void emitViewportChanged (int x, int y, int width, int height);
    };
 
    Emitter emitter;
@@ -0,0 +1,571 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include "plaintext.hh"
+
+#include <limits.h>
+#include <string.h>
+
+using namespace lout;
+
+namespace dw {
+
+int PlainText::CLASS_ID = -1;
+
+// ----------------------------------------------------------------------
+
+PlainText::PlainTextIterator::PlainTextIterator (PlainText *plainText,
+                                                 core::Content::Type mask,
+                                                 bool atEnd):
+   core::Iterator (plainText, mask, atEnd), lineText (1)
+{
+   index = atEnd ? 2 * plainText->numLines () : -1;
+   content.type = atEnd ? core::Content::END : core::Content::START;
+}
+
+PlainText::PlainTextIterator::PlainTextIterator (PlainText *plainText,
+                                                 core::Content::Type mask,
+                                                 int index):
+   core::Iterator (plainText, mask, false), lineText (1)
+{
+   setValues (index);
+}
+
+void PlainText::PlainTextIterator::setValues (int index)
+{
+   PlainText *plainText = (PlainText*)getWidget();
+
+   this->index = index;
+   content.space = false;
+
+   if (index < 0)
+      content.type = core::Content::START;
+   else if (index >= 2 * plainText->numLines ())
+      content.type = core::Content::END;
+   else if (index % 2 == 0) {
+      content.type = core::Content::TEXT;
+      content.text = plainText->getLine (index / 2, &lineText);
+   } else {
+      content.type = core::Content::BREAK;
+      content.breakSpace = 0;
+   }
+}
+
+object::Object *PlainText::PlainTextIterator::clone ()
+{
+   return new PlainTextIterator ((PlainText*)getWidget(), getMask(), index);
+}
+
+int PlainText::PlainTextIterator::compareTo (object::Comparable *other)
+{
+   return index - ((PlainTextIterator*)other)->index;
+}
+
+bool PlainText::PlainTextIterator::next ()
+{
+   if (content.type == core::Content::END)
+      return false;
+
+   do
+      setValues (index + 1);
+   while (content.type != core::Content::END &&
+          !(content.type & getMask ()));
+
+   return content.type != core::Content::END;
+}
+
+bool PlainText::PlainTextIterator::prev ()
+{
+   if (content.type == core::Content::START)
+      return false;
+
+   do
+      setValues (index - 1);
+   while (content.type != core::Content::START &&
+          !(content.type & getMask ()));
+
+   return content.type != core::Content::START;
+}
+
+void PlainText::PlainTextIterator::highlight (int start, int end,
+                                              core::HighlightLayer layer)
+{
+   PlainText *plainText = (PlainText*)getWidget();
+   HlPosition *hlStart = &plainText->hlStart[layer];
+   HlPosition *hlEnd = &plainText->hlEnd[layer];
+   HlPosition oldStart = *hlStart, oldEnd = *hlEnd;
+   int index1 = index, index2 = index;
+
+   if (hlStart->index > hlEnd->index) {
+      /* nothing is highlighted */
+      hlStart->index = index;
+      hlEnd->index = index;
+   }
+
+   if (hlStart->index >= index) {
+      index2 = hlStart->index;
+      hlStart->index = index;
+      hlStart->nChar = start;
+   }
+
+   if (hlEnd->index <= index) {
+      index2 = hlEnd->index;
+      hlEnd->index = index;
+      hlEnd->nChar = end;
+   }
+
+   if (oldStart.index != hlStart->index || oldStart.nChar != hlStart->nChar ||
+       oldEnd.index != hlEnd->index || oldEnd.nChar != hlEnd->nChar)
+      plainText->queueDrawLines (index1, index2);
+}
+
+void PlainText::PlainTextIterator::unhighlight (int direction,
+                                                core::HighlightLayer layer)
+{
+   PlainText *plainText = (PlainText*)getWidget();
+   HlPosition *hlStart = &plainText->hlStart[layer];
+   HlPosition *hlEnd = &plainText->hlEnd[layer];
+   HlPosition oldStart = *hlStart, oldEnd = *hlEnd;
+   int index1 = index, index2 = index;
+
+   if (hlStart->index > hlEnd->index)
+      return;
+
+   if (direction == 0) {
+      index1 = hlStart->index;
+      index2 = hlEnd->index;
+      hlStart->index = 1;
+      hlEnd->index = 0;
+   } else if (direction > 0 && hlStart->index <= index) {
+      index1 = hlStart->index;
+      hlStart->index = index + 1;
+      hlStart->nChar = 0;
+   } else if (direction < 0 && hlEnd->index >= index) {
+      index1 = hlEnd->index;
+      hlEnd->index = index - 1;
+      hlEnd->nChar = INT_MAX;
+   }
+
+   if (oldStart.index != hlStart->index || oldStart.nChar != hlStart->nChar ||
+       oldEnd.index != hlEnd->index || oldEnd.nChar != hlEnd->nChar)
+      plainText->queueDrawLines (index1, index2);
+}
+
+void PlainText::PlainTextIterator::getAllocation (int start, int end,
+                                                  core::Allocation
+                                                  *allocation)
+{
+   PlainText *plainText = (PlainText*)getWidget();
+
+   if (index < 0 || index >= 2 * plainText->numLines ()) {
+      *allocation = *(plainText->getAllocation ());
+      return;
+   }
+
+   const char *text = plainText->getLine (index / 2, plainText->lineBuf);
+   int x1, x2;
+
+   if (index % 2 == 0) {
+      x1 = plainText->xOfChar (text, start);
+      x2 = plainText->xOfChar (text, end);
+   } else {
+      /* the break, at the end of the line */
+      x1 = x2 = plainText->xOfChar (text, INT_MAX);
+   }
+
+   allocation->x = plainText->allocation.x + plainText->boxOffsetX () + x1;
+   allocation->y = plainText->allocation.y + plainText->boxOffsetY () +
+                   index / 2 * plainText->lineHeight ();
+   allocation->width = x2 - x1;
+   allocation->ascent = plainText->textStyle->font->ascent;
+   allocation->descent = plainText->textStyle->font->descent;
+}
+
+// ----------------------------------------------------------------------
+
+PlainText::PlainText (core::style::Style *textStyle, Source *source)
+{
+   DBG_OBJ_CREATE ("dw::PlainText");
+   registerName ("dw::PlainText", &CLASS_ID);
+
+   this->textStyle = textStyle;
+   textStyle->ref ();
+
+   this->source = source;
+   lineEnds = new misc::SimpleVector <size_t> (1);
+   lineBuf = new misc::SimpleVector <char> (PIECE_SIZE);
+   maxLineChars = 0;
+   mustQueueResize = false;
+
+   for (int layer = 0; layer < core::HIGHLIGHT_NUM_LAYERS; layer++) {
+      hlStart[layer].index = 1;
+      hlStart[layer].nChar = 0;
+      hlEnd[layer].index = 0;
+      hlEnd[layer].nChar = 0;
+   }
+}
+
+PlainText::~PlainText ()
+{
+   delete lineEnds;
+   delete lineBuf;
+   textStyle->unref ();
+
+   DBG_OBJ_DELETE ();
+}
+
+void PlainText::sizeRequestSimpl (core::Requisition *requisition)
+{
+   requisition->width = misc::max (getAvailWidth (true),
+                                   boxDiffWidth () + contentWidth ());
+   requisition->ascent =
+      boxOffsetY () + numLines () * lineHeight () + boxRestHeight ();
+   requisition->descent = 0;
+}
+
+void PlainText::getExtremesSimpl (core::Extremes *extremes)
+{
+   extremes->minWidth = extremes->maxWidth = boxDiffWidth () + contentWidth ();
+   extremes->minWidthIntrinsic = extremes->minWidth;
+   extremes->maxWidthIntrinsic = extremes->maxWidth;
+   correctExtremes (extremes, false);
+   extremes->adjustmentWidth =
+      misc::min (extremes->minWidthIntrinsic, extremes->minWidth);
+}
+
+void PlainText::containerSizeChangedForChildren ()
+{
+   DBG_OBJ_ENTER0 ("resize", 0, "containerSizeChangedForChildren");
+   // Nothing to do.
+   DBG_OBJ_LEAVE ();
+}
+
+bool PlainText::usesAvailWidth ()
+{
+   return true;
+}
+
+bool PlainText::isBlockLevel ()
+{
+   return true;
+}
+
+/**
+ * \brief Copy a line to buf as it is shown, without its line break and
+ *    with its tabs expanded, and return it.
+ *
+ * A line whose text is gone is empty.
+ */
+const char *PlainText::getLine (int line, misc::SimpleVector <char> *buf)
+{
+   size_t size, start = line > 0 ? lineEnds->get (line - 1) : 0,
+      end = lineEnds->get (line);
+   const char *text = source->getText (&size);
+   int column = 0;
+
+   if (text == NULL || end > size)
+      end = start;
+   if (end > start && text[end - 1] == '\n')
+      end--;
+   if (end > start && text[end - 1] == '\r')
+      end--;
+
+   buf->setSize (0);
+   for (size_t i = start; i < end; i++) {
+      if (text[i] == '\t') {
+         do {
+            buf->increase ();
+            buf->set (buf->size () - 1, ' ');
+         } while (++column % TAB_SIZE);
+      } else {
+         if ((text[i] & 0xc0) != 0x80)
+            column++;
+         buf->increase ();
+         buf->set (buf->size () - 1, text[i]);
+      }
+   }
+   buf->increase ();
+   buf->set (buf->size () - 1, '\0');
+   return buf->getArray ();
+}
+
+/**
+ * \brief Return where the piece of a line starting at start ends.
+ *
+ * Pieces never end within a UTF-8 character.
+ */
+int PlainText::pieceEnd (const char *text, int start)
+{
+   int i = start;
+
+   while (text[i] && i - start < PIECE_SIZE)
+      i++;
+   while ((text[i] & 0xc0) == 0x80)
+      i++;
+   return i;
+}
+
+/**
+ * \brief Return the character of a line nearest to the horizontal
+ *    position x, relative to the start of the line.
+ */
+int PlainText::charAtX (const char *text, int x)
+{
+   int start = 0, i;
+
+   while (text[start]) {
+      int end = pieceEnd (text, start), width = textWidth (text + start,
+                                                           end - start);
+      if (x < width)
+         break;
+      x -= width;
+      start = end;
+   }
+
+   for (i = start; text[i]; ) {
+      int next = layout->nextGlyph (text, i);
+      int width = textWidth (text + i, next - i);
+
+      if (x >= width) {
+         x -= width;
+         i = next;
+      } else {
+         if (x >= width / 2)
+            i = next;
+         break;
+      }
+   }
+   return i;
+}
+
+/**
+ * \brief Return the horizontal position of a character of a line,
+ *    relative to the start of the line.
+ */
+int PlainText::xOfChar (const char *text, int nChar)
+{
+   int x = 0;
+
+   for (int start = 0, end; text[start] && start < nChar; start = end) {
+      end = misc::min (pieceEnd (text, start), nChar);
+      x += textWidth (text + start, end - start);
+   }
+   return x;
+}
+
+/**
+ * \brief Return which characters of a line are highlighted in a layer.
+ *
+ * last may be INT_MAX, for the whole rest of the line.
+ */
+bool PlainText::hlRange (int line, int layer, int *first, int *last)
+{
+   int index = 2 * line;
+
+   if (hlStart[layer].index > hlEnd[layer].index ||
+       hlStart[layer].index > index || hlEnd[layer].index < index)
+      return false;
+
+   *first = hlStart[layer].index < index ? 0 : hlStart[layer].nChar;
+   *last = hlEnd[layer].index > index ? INT_MAX : hlEnd[layer].nChar;
+   return *first < *last;
+}
+
+void PlainText::draw (core::View *view, core::Rectangle *area,
+                      core::DrawingContext *context)
+{
+   int lh = lineHeight ();
+
+   drawWidgetBox (view, area, false);
+
+   if (lh > 0 && numLines () > 0) {
+      int y = area->y - boxOffsetY ();
+      int first = misc::max (0, y / lh);
+      int last = misc::min (numLines () - 1, (y + area->height) / lh);
+
+      for (int line = first; line <= last; line++)
+         drawLine (view, area, line);
+   }
+}
+
+void PlainText::drawLine (core::View *view, core::Rectangle *area, int line)
+{
+   const char *text = getLine (line, lineBuf);
+   core::style::Font *font = textStyle->font;
+   int yBase = allocation.y + boxOffsetY () + line * lineHeight () +
+               font->ascent;
+   int x = boxOffsetX (), end, width;
+
+   for (int start = 0; text[start] && x < area->x + area->width;
+        start = end, x += width) {
+      end = pieceEnd (text, start);
+      width = textWidth (text + start, end - start);
+      if (x + width < area->x)
+         continue;
+
+      view->drawText (font, textStyle->color,
+                      core::style::Color::SHADING_NORMAL,
+                      allocation.x + x, yBase, text + start, end - start);
+
+      for (int layer = 0; layer < core::HIGHLIGHT_NUM_LAYERS; layer++) {
+         int first, last;
+
+         if (!hlRange (line, layer, &first, &last))
+            continue;
+         first = misc::max (first, start);
+         last = misc::min (last, end);
+         if (first >= last)
+            continue;
+
+         int xStart = x + textWidth (text + start, first - start);
+         int hlWidth = textWidth (text + first, last - first);
+         core::style::Color *bgColor = textStyle->backgroundColor;
+
+         if (!bgColor)
+            bgColor = getBgColor ();
+         view->drawRectangle (bgColor, core::style::Color::SHADING_INVERSE,
+                              true, allocation.x + xStart,
+                              yBase - font->ascent, hlWidth,
+                              font->ascent + font->descent);
+         view->drawText (font, textStyle->color,
+                         core::style::Color::SHADING_INVERSE,
+                         allocation.x + xStart, yBase, text + first,
+                         last - first);
+      }
+   }
+}
+
+/**
+ * \brief Queue the lines of two iterator indexes, and those between them,
+ *    for drawing.
+ */
+void PlainText::queueDrawLines (int index1, int index2)
+{
+   int line1 = misc::max (0, misc::min (index1, index2) / 2);
+   int line2 = misc::max (index1, index2) / 2;
+   int lh = lineHeight ();
+
+   queueDrawArea (0, boxOffsetY () + line1 * lh, allocation.width,
+                  (line2 - line1 + 1) * lh);
+}
+
+bool PlainText::buttonPressImpl (core::EventButton *event)
+{
+   return sendSelectionEvent (core::SelectionState::BUTTON_PRESS, event);
+}
+
+bool PlainText::buttonReleaseImpl (core::EventButton *event)
+{
+   return sendSelectionEvent (core::SelectionState::BUTTON_RELEASE, event);
+}
+
+bool PlainText::motionNotifyImpl (core::EventMotion *event)
+{
+   if (event->state & core::BUTTON1_MASK)
+      return sendSelectionEvent (core::SelectionState::BUTTON_MOTION, event);
+   else
+      return false;
+}
+
+/**
+ * \brief Send event to selection.
+ */
+bool PlainText::sendSelectionEvent (core::SelectionState::EventType eventType,
+                                    core::MousePositionEvent *event)
+{
+   core::Iterator *it;
+   int index, charPos = 0, lh = lineHeight ();
+   bool r;
+
+   if (numLines () == 0) {
+      index = -1;
+   } else {
+      int y = event->yWidget - boxOffsetY ();
+
+      if (y < 0) {
+         // Above the first line: take its start.
+         index = 0;
+      } else if (lh <= 0 || y >= numLines () * lh) {
+         // Below the last line: take its end.
+         index = 2 * (numLines () - 1);
+         charPos = core::SelectionState::END_OF_WORD;
+      } else {
+         index = 2 * (y / lh);
+         charPos = charAtX (getLine (index / 2, lineBuf),
+                            event->xWidget - boxOffsetX ());
+      }
+   }
+
+   it = new PlainTextIterator (this, core::Content::maskForSelection (true),
+                               index);
+   r = selectionHandleEvent (eventType, it, charPos, -1, event);
+   it->unref ();
+   return r;
+}
+
+core::Iterator *PlainText::iterator (core::Content::Type mask, bool atEnd)
+{
+   return new PlainTextIterator (this, mask, atEnd);
+}
+
+/**
+ * \brief Append the next line of the text, which ends, after its line
+ *    break if it has one, at the offset end.
+ *
+ * As with dw::Textblock, call flush() after adding a batch of lines.
+ */
+void PlainText::addLine (size_t end)
+{
+   const char *text;
+   int chars = 0;
+
+   lineEnds->increase ();
+   lineEnds->set (numLines () - 1, end);
+
+   text = getLine (numLines () - 1, lineBuf);
+   for (int i = 0; text[i]; i++)
+      if ((text[i] & 0xc0) != 0x80)
+         chars++;
+   maxLineChars = misc::max (maxLineChars, chars);
+   mustQueueResize = true;
+}
+
+/**
+ * \brief Remove all lines, e.g. when the text has changed.
+ */
+void PlainText::clear ()
+{
+   lineEnds->setSize (0);
+   maxLineChars = 0;
+   for (int layer = 0; layer < core::HIGHLIGHT_NUM_LAYERS; layer++) {
+      hlStart[layer].index = 1;
+      hlEnd[layer].index = 0;
+   }
+   mustQueueResize = true;
+}
+
+void PlainText::flush ()
+{
+   if (mustQueueResize) {
+      queueResize (-1, true);
+      mustQueueResize = false;
+   }
+}
+
+} // namespace dw
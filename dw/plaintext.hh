@@ -0,0 +1,148 @@
+#ifndef __DW_PLAINTEXT_HH__
+#define __DW_PLAINTEXT_HH__
+
+#include "core.hh"
+#include "../lout/misc.hh"
+
+namespace dw {
+
+/**
+ * \brief A widget for plain text, also when it is very large.
+ *
+ * dw::Textblock needs a word for each line and breaks all of them into
+ * lines, which is much too expensive for long logs. This widget does not
+ * own the text: it asks a dw::PlainText::Source for it, and keeps only
+ * the offset where each line ends. Tabs are expanded, and line breaks
+ * stripped, when a line is drawn. Lines are not wrapped and all have the
+ * same height, so the size is known without any layout, and only the
+ * lines within the drawn area are measured and drawn.
+ *
+ * The width assumes that all characters are as wide as an "M", which
+ * holds for the monospace font plain text is shown with.
+ *
+ * The contents, as seen by iterators (and so by selection and
+ * findtext), are a dw::core::Content::TEXT for each line, followed by
+ * a dw::core::Content::BREAK.
+ */
+class PlainText: public core::Widget
+{
+public:
+   /**
+    * \brief Where the text comes from.
+    *
+    * The text may move between two calls, but the offsets of the lines
+    * added must remain valid in it, until dw::PlainText::clear() is
+    * called.
+    */
+   class Source
+   {
+   public:
+      virtual ~Source () { }
+
+      /**
+       * \brief Return the text, and its size in size, or NULL when it is
+       *    gone.
+       */
+      virtual const char *getText (size_t *size) = 0;
+   };
+
+private:
+   class PlainTextIterator: public core::Iterator
+   {
+   private:
+      /* 2 * line for its text, 2 * line + 1 for its break; -1 and
+       * 2 * number of lines for start and end */
+      int index;
+      /* the line content.text points to */
+      lout::misc::SimpleVector <char> lineText;
+
+      void setValues (int index);
+
+   public:
+      PlainTextIterator (PlainText *plainText, core::Content::Type mask,
+                         bool atEnd);
+      PlainTextIterator (PlainText *plainText, core::Content::Type mask,
+                         int index);
+
+      lout::object::Object *clone ();
+      int compareTo (lout::object::Comparable *other);
+
+      bool next ();
+      bool prev ();
+      void highlight (int start, int end, core::HighlightLayer layer);
+      void unhighlight (int direction, core::HighlightLayer layer);
+      void getAllocation (int start, int end, core::Allocation *allocation);
+   };
+
+   struct HlPosition {
+      int index;   /* as in PlainTextIterator */
+      int nChar;
+   };
+
+   enum {
+      /* Long lines are measured and drawn in pieces of about this many
+       * bytes, so that only the visible ones are drawn. */
+      PIECE_SIZE = 128,
+      TAB_SIZE = 8
+   };
+
+   core::style::Style *textStyle;
+   Source *source;
+   /* where each line ends in the text, after its line break */
+   lout::misc::SimpleVector <size_t> *lineEnds;
+   /* lines are copied here to be measured and drawn */
+   lout::misc::SimpleVector <char> *lineBuf;
+   int maxLineChars;
+   bool mustQueueResize;
+
+   HlPosition hlStart[core::HIGHLIGHT_NUM_LAYERS];
+   HlPosition hlEnd[core::HIGHLIGHT_NUM_LAYERS];
+
+   inline int lineHeight ()
+   { return textStyle->font->ascent + textStyle->font->descent; }
+   inline int textWidth (const char *text, int len)
+   { return layout->textWidth (textStyle->font, text, len); }
+   inline int contentWidth ()
+   { return maxLineChars * textWidth ("M", 1); }
+   inline int numLines () { return lineEnds->size (); }
+
+   const char *getLine (int line, lout::misc::SimpleVector <char> *buf);
+   int pieceEnd (const char *text, int start);
+   int charAtX (const char *text, int x);
+   int xOfChar (const char *text, int nChar);
+   bool hlRange (int line, int layer, int *first, int *last);
+   void drawLine (core::View *view, core::Rectangle *area, int line);
+   void queueDrawLines (int index1, int index2);
+   bool sendSelectionEvent (core::SelectionState::EventType eventType,
+                            core::MousePositionEvent *event);
+
+protected:
+   void sizeRequestSimpl (core::Requisition *requisition);
+   void getExtremesSimpl (core::Extremes *extremes);
+   void containerSizeChangedForChildren ();
+   bool usesAvailWidth ();
+   void draw (core::View *view, core::Rectangle *area,
+              core::DrawingContext *context);
+
+   bool buttonPressImpl (core::EventButton *event);
+   bool buttonReleaseImpl (core::EventButton *event);
+   bool motionNotifyImpl (core::EventMotion *event);
+
+public:
+   static int CLASS_ID;
+
+   PlainText (core::style::Style *textStyle, Source *source);
+   ~PlainText ();
+
+   bool isBlockLevel ();
+
+   core::Iterator *iterator (core::Content::Type mask, bool atEnd);
+
+   void addLine (size_t end);
+   void clear ();
+   void flush ();
+};
+
+} // namespace dw
+
+#endif // __DW_PLAINTEXT_HH__
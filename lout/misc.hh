@@ -665,6 +665,18 @@ public:
       return ret;
    }
 
+   /**
+    * \brief Like zoneAlloc(), but aligned for any pointer or number, as
+    *    needed for structures.
+    */
+   inline void * zoneAllocAligned (size_t t) {
+      const size_t a = sizeof (double) > sizeof (void*) ?
+                       sizeof (double) : sizeof (void*);
+
+      freeIdx = min (poolSize, (freeIdx + a - 1) & ~(a - 1));
+      return zoneAlloc ((t + a - 1) & ~(a - 1));
+   }
+
    inline void zoneFree () {
       for (int i = 0; i < pools->size (); i++)
          free (pools->get (i));
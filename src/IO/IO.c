@@ -19,6 +19,7 @@
 #include "../msg.h"
 #include "../chain.h"
 #include "../klist.h"
+#include "../url.h"
 #include "IO.h"
 #include "iowatch.hh"
 #include "tls.h"
@@ -38,10 +39,22 @@ typedef struct {
    int FD;                /* Current File Descriptor */
    int Status;            /* nonzero upon IO failure */
    Dstr *Buf;             /* Internal buffer */
+   Dlist *Pending;        /* Writes queued behind Buf (IOSeg_t) */
+   int FileFD;            /* File being streamed into Buf, or -1 */
+   long FileLeft;         /* Bytes still expected from FileFD */
 
    void *Info;            /* CCC Info structure for this IO */
 } IOData_t;
 
+/*
+ * A queued write: either in-memory data or a file to be streamed.
+ */
+typedef struct {
+   Dstr *Data;            /* NULL for a file segment */
+   char *Path;
+   long Size;
+} IOSeg_t;
+
 
 /*
  * Local data
@@ -68,6 +81,7 @@ static IOData_t *IO_new(int op)
    io->FD = -1;
    io->Key = 0;
    io->Buf = dStr_sized_new(IOBufLen);
+   io->FileFD = -1;
 
    return io;
 }
@@ -111,10 +125,99 @@ static IOData_t *IO_get(int Key)
  */
 static void IO_free(IOData_t *io)
 {
+   IOSeg_t *seg;
+
+   while ((seg = dList_nth_data(io->Pending, 0))) {
+      dList_remove(io->Pending, seg);
+      dStr_free(seg->Data, 1);
+      dFree(seg->Path);
+      dFree(seg);
+   }
+   dList_free(io->Pending);
+   if (io->FileFD != -1)
+      dClose(io->FileFD);
    dStr_free(io->Buf, 1);
    dFree(io);
 }
 
+/*
+ * Queue a write behind whatever is already waiting to be sent.
+ * (Data is only appended to Buf directly when nothing is pending)
+ */
+static void IO_queue(IOData_t *io, const char *buf, int size,
+                     const DilloUrlDataFile *file)
+{
+   IOSeg_t *seg;
+
+   if (!file && io->FileFD == -1 && dList_length(io->Pending) == 0) {
+      dStr_append_l(io->Buf, buf, size);
+      return;
+   }
+   seg = dNew0(IOSeg_t, 1);
+   if (file) {
+      seg->Path = dStrdup(file->path);
+      seg->Size = file->size;
+   } else {
+      seg->Data = dStr_sized_new(size);
+      dStr_append_l(seg->Data, buf, size);
+   }
+   if (!io->Pending)
+      io->Pending = dList_new(4);
+   dList_append(io->Pending, seg);
+}
+
+/*
+ * Refill an empty write buffer from the pending queue.
+ * Files are read in IOBufLen*8 chunks, so they are never held in memory.
+ * Return value: TRUE if there is data to write.
+ */
+static bool_t IO_refill(IOData_t *io)
+{
+   char Buf[IOBufLen * 8];
+   ssize_t St;
+   IOSeg_t *seg;
+
+   while (io->Buf->len == 0 && io->Status == 0) {
+      if (io->FileFD != -1) {
+         do
+            St = read(io->FileFD, Buf, MIN((long)sizeof(Buf), io->FileLeft));
+         while (St < 0 && errno == EINTR);
+         if (St <= 0) {
+            /* the file shrank or failed since the form was submitted */
+            io->Status = St < 0 ? errno : EIO;
+            MSG("IO_refill: short read on upload file, %ld bytes missing\n",
+                io->FileLeft);
+         } else {
+            dStr_append_l(io->Buf, Buf, St);
+            io->FileLeft -= St;
+         }
+         if (io->Status || io->FileLeft == 0) {
+            dClose(io->FileFD);
+            io->FileFD = -1;
+         }
+      } else if ((seg = dList_nth_data(io->Pending, 0))) {
+         dList_remove(io->Pending, seg);
+         if (seg->Data) {
+            dStr_append_l(io->Buf, seg->Data->str, seg->Data->len);
+            dStr_free(seg->Data, 1);
+         } else if (seg->Size > 0) {
+            if ((io->FileFD = open(seg->Path, O_RDONLY)) < 0) {
+               io->Status = errno;
+               MSG("IO_refill: can't open %s: %s\n", seg->Path,
+                   dStrerror(errno));
+            } else {
+               io->FileLeft = seg->Size;
+            }
+         }
+         dFree(seg->Path);
+         dFree(seg);
+      } else {
+         break;
+      }
+   }
+   return (io->Buf->len > 0);
+}
+
 /*
  * Close an open FD, and remove io controls.
  * (This function can be used for Close and Abort operations)
@@ -226,6 +329,8 @@ static bool_t IO_write(IOData_t *io)
    io->Status = 0;
 
    while (1) {
+      if (!IO_refill(io))
+         break;
       St = conn ? a_Tls_write(conn, io->Buf->str, io->Buf->len)
                 : write(io->FD, io->Buf->str, io->Buf->len);
       if (St < 0) {
@@ -249,9 +354,8 @@ static bool_t IO_write(IOData_t *io)
          /* Not all data written */
          dStr_erase (io->Buf, 0, St);
       } else {
-         /* All data in buffer written */
+         /* All data in buffer written, go for the pending queue */
          dStr_truncate(io->Buf, 0);
-         break;
       }
    }
 
@@ -377,9 +481,12 @@ void a_IO_ccc(int Op, int Branch, int Dir, ChainLink *Info,
             io = Info->LocalKey;
             if (Data2 && !strcmp(Data2, "FD")) {
                io->FD = *(int*)Data1; /* SockFD */
+            } else if (Data2 && !strcmp(Data2, "file")) {
+               IO_queue(io, NULL, 0, Data1); /* DilloUrlDataFile */
+               IO_submit(io);
             } else {
                dbuf = Data1;
-               dStr_append_l(io->Buf, dbuf->Buf, dbuf->Size);
+               IO_queue(io, dbuf->Buf, dbuf->Size, NULL);
                IO_submit(io);
             }
             break;
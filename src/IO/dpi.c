@@ -54,6 +54,8 @@
 typedef struct {
    int InTag;
    int Send2EOF;
+   int BinFrames;   /* data comes in length-prefixed binary frames */
+   int FrameLeft;   /* payload bytes left in the current frame */
 
    int DataTotalSize;
    int DataRecvSize;
@@ -149,6 +151,27 @@ static int Dpi_get_token(dpi_conn_t *conn)
       return resp;
    }
 
+   if (conn->Send2EOF && conn->BinFrames) {
+      /* strip frame headers, the payload goes as is */
+      while (conn->FrameLeft == 0) {
+         if (conn->Buf->len - conn->BufIdx < DPIP_FRAME_HDR_SZ) {
+            /* incomplete header, wait for more data */
+            dStr_erase(conn->Buf, 0, conn->BufIdx);
+            conn->BufIdx = 0;
+            return resp;
+         }
+         conn->FrameLeft = a_Dpip_frame_size(buf + conn->BufIdx);
+         conn->BufIdx += DPIP_FRAME_HDR_SZ;
+      }
+      if (conn->BufIdx == conn->Buf->len)
+         return resp;
+      conn->TokIdx = conn->BufIdx;
+      conn->TokSize = MIN(conn->FrameLeft, conn->Buf->len - conn->BufIdx);
+      conn->BufIdx += conn->TokSize;
+      conn->FrameLeft -= conn->TokSize;
+      return 0;
+   }
+
    if (conn->Send2EOF) {
       conn->TokIdx = conn->BufIdx;
       conn->TokSize = conn->Buf->len - conn->BufIdx;
@@ -197,7 +220,7 @@ static int Dpi_get_token(dpi_conn_t *conn)
  */
 static void Dpi_parse_token(dpi_conn_t *conn)
 {
-   char *tag, *cmd, *msg, *urlstr;
+   char *tag, *cmd, *msg, *urlstr, *framing;
    DataBuf *dbuf;
    char *Tok = conn->Buf->str + conn->TokIdx;
 
@@ -229,6 +252,9 @@ static void Dpi_parse_token(dpi_conn_t *conn)
 
    } else if (strcmp(cmd, "start_send_page") == 0) {
       conn->Send2EOF = 1;
+      framing = a_Dpip_get_attr_l(Tok, conn->TokSize, "framing");
+      conn->BinFrames = (framing && strcmp(framing, "bin") == 0);
+      dFree(framing);
       urlstr = a_Dpip_get_attr_l(Tok, conn->TokSize, "url");
       a_Chain_fcb(OpSend, conn->InfoRecv, urlstr, cmd);
       dFree(urlstr);
@@ -339,9 +365,10 @@ static int Dpi_start_dpid(void)
 {
    pid_t pid;
    int st_pipe[2], ret = 1;
-   char *answer;
+   char *answer, fd_str[16];
 
-   /* create a pipe to track our child's status */
+   /* create a pipe to track our child's status.
+    * dpid keeps it open until its sockets are ready (or it exits) */
    if (pipe(st_pipe))
       return 1;
 
@@ -350,6 +377,8 @@ static int Dpi_start_dpid(void)
       /* This is the child process.  Execute the command. */
       char *path1 = dStrconcat(dGethomedir(), "/.dillo/dpid", NULL);
       dClose(st_pipe[0]);
+      snprintf(fd_str, 16, "%d", st_pipe[1]);
+      setenv("DPID_READY_FD", fd_str, 1);
       if (execl(path1, "dpid", (char*)NULL) == -1) {
          dFree(path1);
          path1 = dStrconcat(DILLO_BINDIR, "dpid", NULL);
@@ -480,8 +509,13 @@ static int Dpi_check_dpid(int num_tries)
       if (!starting) {
          /* start dpid */
          if (Dpi_start_dpid() == 0) {
-            starting = 1;
-            ret = 1;
+            /* a ready dpid answers now, no need to wait */
+            if (Dpi_check_dpid_ids() == 1) {
+               ret = 0;
+            } else {
+               starting = 1;
+               ret = 1;
+            }
          }
       } else if (++starting < num_tries) {
          /* starting */
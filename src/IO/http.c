@@ -376,6 +376,14 @@ static Dstr *Http_make_content_type(const DilloUrl *url)
    return dstr;
 }
 
+/* Servers that have WebP versions of their images send them to those who
+ * ask for them, and they're usually smaller. */
+#ifdef ENABLE_WEBP
+#  define HTTP_ACCEPT_IMAGE "image/webp,image/png,image/*;q=0.8,*/*;q=0.5"
+#else
+#  define HTTP_ACCEPT_IMAGE "image/png,image/*;q=0.8,*/*;q=0.5"
+#endif
+
 /*
  * Make the http query string
  */
@@ -389,7 +397,7 @@ static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy)
 
    /* BUG: dillo doesn't actually understand application/xml yet */
    const char *accept_hdr_value =
-      web->flags & WEB_Image ? "image/png,image/*;q=0.8,*/*;q=0.5" :
+      web->flags & WEB_Image ? HTTP_ACCEPT_IMAGE :
       web->flags & WEB_Stylesheet ? "text/css,*/*;q=0.1" :
       "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8";
 
@@ -438,8 +446,10 @@ static Dstr *Http_make_query_str(DilloWeb *web, bool_t use_proxy)
          request_uri->str, URL_AUTHORITY(url), prefs.http_user_agent,
          accept_hdr_value, HTTP_Language_hdr, auth ? auth : "",
          proxy_auth->str, referer, connection_hdr_val, content_type->str,
-         (long)URL_DATA(url)->len, cookies);
-      dStr_append_l(query, URL_DATA(url)->str, URL_DATA(url)->len);
+         a_Url_data_len(url), cookies);
+      /* file parts are streamed by Http_send_query() */
+      if (!url->data_files)
+         dStr_append_l(query, URL_DATA(url)->str, URL_DATA(url)->len);
       dStr_free(content_type, TRUE);
    } else {
       dStr_sprintfa(
@@ -494,6 +504,28 @@ static void Http_send_query(SocketData_t *S)
    a_Chain_bcb(OpSend, S->Info, dbuf, NULL);
    dFree(dbuf);
    dStr_free(query, 1);
+
+   if (S->web->url->data_files) {
+      /* Interleave the POST data with its files, which the IO engine
+       * reads from disk as the socket drains. */
+      const DilloUrl *url = S->web->url;
+      int i, n = dList_length(url->data_files), offset = 0;
+
+      for (i = 0; i <= n; i++) {
+         DilloUrlDataFile *file = dList_nth_data(url->data_files, i);
+         int end = file ? file->offset : URL_DATA(url)->len;
+
+         if (end > offset) {
+            dbuf = a_Chain_dbuf_new(URL_DATA(url)->str + offset,
+                                    end - offset, 0);
+            a_Chain_bcb(OpSend, S->Info, dbuf, NULL);
+            dFree(dbuf);
+            offset = end;
+         }
+         if (file)
+            a_Chain_bcb(OpSend, S->Info, file, "file");
+      }
+   }
 }
 
 /*
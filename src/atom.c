@@ -0,0 +1,178 @@
+/*
+ * File: atom.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * A table of interned strings (atoms).
+ *
+ * It holds the class names and ids of elements, and those in CSS
+ * selectors, so that matching compares pointers instead of strings.
+ * Each atom counts its references: the document trees and the selectors
+ * release theirs when they go, so the table only holds the names in use.
+ *
+ * Strings are kept as they are: atoms are case-sensitive. Each atom
+ * knows the atom of its ASCII lowercase, for the case-insensitive
+ * matching of quirks mode.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "atom.h"
+
+
+typedef struct {
+   uint_t refcount;
+   uint_t hash;
+   const char *folded;    /* its lowercase atom; str itself if lowercase */
+   char str[1];
+} Atom;
+
+static Atom **Slots = NULL;
+static uint_t NumSlots = 0;    /* power of two */
+static uint_t NumAtoms = 0;
+
+#define ATOM_MIN_SLOTS 1024
+
+/*
+ * The atom whose string this is.
+ */
+#define ATOM_OF(str) ((Atom *)((char *)(str) - offsetof(Atom, str)))
+
+
+/*
+ * FNV-1a
+ */
+static uint_t Atom_hash(const char *str, int len)
+{
+   uint_t h = 2166136261u;
+   int i;
+
+   for (i = 0; i < len; i++) {
+      h ^= (uchar_t)str[i];
+      h *= 16777619u;
+   }
+   return h;
+}
+
+/*
+ * Give the table num_slots slots (or free it, for 0), placing the atoms
+ * again.
+ */
+static void Atom_resize(uint_t num_slots)
+{
+   Atom **old = Slots;
+   uint_t i, j, old_num = NumSlots;
+
+   NumSlots = num_slots;
+   Slots = num_slots ? dNew0(Atom *, num_slots) : NULL;
+   for (i = 0; i < old_num; i++) {
+      if (old[i]) {
+         for (j = old[i]->hash & (NumSlots - 1); Slots[j];
+              j = (j + 1) & (NumSlots - 1)) ;
+         Slots[j] = old[i];
+      }
+   }
+   dFree(old);
+}
+
+/*
+ * Return a reference to the atom for the first len bytes of str.
+ */
+const char *a_Atom_intern_l(const char *str, int len)
+{
+   uint_t h = Atom_hash(str, len), i;
+   Atom *atom;
+   int j;
+
+   if (4 * (NumAtoms + 1) > 3 * NumSlots)
+      Atom_resize(NumSlots ? 2 * NumSlots : ATOM_MIN_SLOTS);
+
+   for (i = h & (NumSlots - 1); (atom = Slots[i]);
+        i = (i + 1) & (NumSlots - 1)) {
+      if (atom->hash == h && strncmp(atom->str, str, len) == 0 &&
+          atom->str[len] == '\0') {
+         atom->refcount++;
+         return atom->str;
+      }
+   }
+
+   atom = dMalloc(offsetof(Atom, str) + len + 1);
+   atom->refcount = 1;
+   atom->hash = h;
+   memcpy(atom->str, str, len);
+   atom->str[len] = '\0';
+   atom->folded = atom->str;
+   Slots[i] = atom;
+   NumAtoms++;
+
+   for (j = 0; j < len; j++) {
+      if (D_ASCII_TOLOWER(str[j]) != str[j]) {
+         char *lower = dStrndup(str, len);
+
+         for ( ; j < len; j++)
+            lower[j] = D_ASCII_TOLOWER(lower[j]);
+         /* (this may move the table, but not the atoms) */
+         atom->folded = a_Atom_intern_l(lower, len);
+         dFree(lower);
+         break;
+      }
+   }
+   return atom->str;
+}
+
+/*
+ * Return a reference to the atom for str.
+ */
+const char *a_Atom_intern(const char *str)
+{
+   return a_Atom_intern_l(str, strlen(str));
+}
+
+/*
+ * Release a reference to an atom (NULL is ignored).
+ */
+void a_Atom_unref(const char *str)
+{
+   Atom *atom;
+   uint_t i, j, home, mask = NumSlots - 1;
+
+   if (!str || --(atom = ATOM_OF(str))->refcount > 0)
+      return;
+
+   for (i = atom->hash & mask; Slots[i] != atom; i = (i + 1) & mask) ;
+
+   /* Close the gap, moving back the atoms that probed past it */
+   for (j = (i + 1) & mask; Slots[j]; j = (j + 1) & mask) {
+      home = Slots[j]->hash & mask;
+      if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+         continue;
+      Slots[i] = Slots[j];
+      i = j;
+   }
+   Slots[i] = NULL;
+   NumAtoms--;
+
+   if (atom->folded != atom->str)
+      a_Atom_unref(atom->folded);
+   dFree(atom);
+
+   if (NumAtoms == 0)
+      Atom_resize(0);
+   else if (NumSlots > ATOM_MIN_SLOTS && 8 * NumAtoms < NumSlots)
+      Atom_resize(NumSlots / 2);
+}
+
+/*
+ * Return the atom of the ASCII lowercase of an atom, or NULL for NULL.
+ * (it isn't a new reference: it lives as long as the atom)
+ */
+const char *a_Atom_fold(const char *str)
+{
+   return str ? ATOM_OF(str)->folded : NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef __ATOM_H__
+#define __ATOM_H__
+
+#include "../dlib/dlib.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * An atom is the one interned copy of a string: two atoms are equal iff
+ * their pointers are. Each a_Atom_intern*() returns a reference, which
+ * must be given back with a_Atom_unref().
+ */
+const char *a_Atom_intern_l(const char *str, int len);
+const char *a_Atom_intern(const char *str);
+void a_Atom_unref(const char *atom);
+const char *a_Atom_fold(const char *atom);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __ATOM_H__ */
@@ -63,6 +63,7 @@ BrowserWindow *a_Bw_new()
 
    bw->RootClients = dList_new(8);
    bw->ImageClients = dList_new(8);
+   bw->PreloadClients = dList_new(8);
    bw->NumImages = 0;
    bw->NumImagesGot = 0;
    bw->NumPendingStyleSheets = 0;
@@ -91,6 +92,7 @@ void a_Bw_free(BrowserWindow *bw)
 
          dList_free(bw->RootClients);
          dList_free(bw->ImageClients);
+         dList_free(bw->PreloadClients);
          dList_free(bw->Docs);
 
          a_Url_free(bw->nav_expect_url);
@@ -132,7 +134,22 @@ void a_Bw_add_client(BrowserWindow *bw, int Key, int Root)
       /* --Images progress-bar stuff-- */
       a_UIcmd_set_img_prog(bw, bw->NumImagesGot, bw->NumImages, 1);
    }
-   if (dList_length(bw->RootClients) + dList_length(bw->ImageClients) == 1)
+   if (dList_length(bw->RootClients) + dList_length(bw->ImageClients) +
+       dList_length(bw->PreloadClients) == 1)
+      a_UIcmd_set_buttons_sens(bw);
+}
+
+/*
+ * Add a client of the preload scanner. It's stopped with the images, but
+ * not counted as one: the parser counts the resource when it requests it.
+ */
+void a_Bw_add_preload_client(BrowserWindow *bw, int Key)
+{
+   dReturn_if_fail ( bw != NULL );
+
+   dList_append(bw->PreloadClients, INT2VOIDP(Key));
+   if (dList_length(bw->RootClients) + dList_length(bw->ImageClients) +
+       dList_length(bw->PreloadClients) == 1)
       a_UIcmd_set_buttons_sens(bw);
 }
 
@@ -150,6 +167,8 @@ int a_Bw_remove_client(BrowserWindow *bw, int ClientKey)
    } else if ((data = dList_find(bw->ImageClients, INT2VOIDP(ClientKey)))) {
       dList_remove_fast(bw->ImageClients, data);
       ++bw->NumImagesGot;
+   } else if ((data = dList_find(bw->PreloadClients, INT2VOIDP(ClientKey)))) {
+      dList_remove_fast(bw->PreloadClients, data);
    }
    return data ? 0 : 1;
 }
@@ -192,6 +211,10 @@ void a_Bw_stop_clients(BrowserWindow *bw, int flags)
          a_Capi_stop_client(VOIDP2INT(data), (flags & BW_Force));
          dList_remove_fast(bw->ImageClients, data);
       }
+      while ((data = dList_nth_data(bw->PreloadClients, 0))) {
+         a_Capi_stop_client(VOIDP2INT(data), (flags & BW_Force));
+         dList_remove_fast(bw->PreloadClients, data);
+      }
    }
 }
 
@@ -266,7 +289,7 @@ void a_Bw_remove_doc(BrowserWindow *bw, void *vdoc)
 
 /*- Cleanup ----------------------------------------------------------------*/
 /*
- * Empty RootClients, ImageClients and PageUrls lists and
+ * Empty the client and PageUrls lists and
  * reset progress bar data.
  */
 void a_Bw_cleanup(BrowserWindow *bw)
@@ -281,6 +304,9 @@ void a_Bw_cleanup(BrowserWindow *bw)
    while ((data = dList_nth_data(bw->ImageClients, 0))) {
       dList_remove_fast(bw->ImageClients, data);
    }
+   while ((data = dList_nth_data(bw->PreloadClients, 0))) {
+      dList_remove_fast(bw->PreloadClients, data);
+   }
    /* Remove PageUrls */
    while ((data = dList_nth_data(bw->PageUrls, 0))) {
       a_Url_free(data);
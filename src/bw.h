@@ -28,6 +28,8 @@ typedef struct {
    Dlist *RootClients;
    /* Image Keys for all active connections in the window */
    Dlist *ImageClients;
+   /* Keys of the preload scanner's clients (not counted as images) */
+   Dlist *PreloadClients;
    /* Number of images in the page */
    int NumImages;
    /* Number of images already loaded */
@@ -72,6 +74,7 @@ BrowserWindow *a_Bw_get(int i);
 int a_Bw_num();
 
 void a_Bw_add_client(BrowserWindow *bw, int Key, int Root);
+void a_Bw_add_preload_client(BrowserWindow *bw, int Key);
 int a_Bw_remove_client(BrowserWindow *bw, int ClientKey);
 void a_Bw_close_client(BrowserWindow *bw, int ClientKey);
 void a_Bw_stop_clients(BrowserWindow *bw, int flags);
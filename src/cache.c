@@ -24,6 +24,7 @@
 #include "IO/IO.h"
 #include "web.hh"
 #include "dicache.h"
+#include "plain.hh"
 #include "nav.h"
 #include "cookies.h"
 #include "hsts.h"
@@ -39,6 +40,8 @@
 #define MAX_INIT_BUF  1024*1024
 /* Maximum filesize for a URL, before offering a download */
 #define HUGE_FILESIZE 15*1024*1024
+/* Seconds the charset prescan may hold back an HTML page */
+#define CACHE_PRESCAN_DEADLINE 0.5
 
 /*
  *  Local data types
@@ -296,6 +299,10 @@ static void Cache_auth_free(Dlist *auth)
  */
 static void Cache_entry_free(CacheEntry_t *entry)
 {
+   /* an image may be decoding from the data in the background, and
+    * plain text is drawn from it */
+   a_Dicache_release_data(entry->Url);
+   a_Plain_release_data(entry->Url);
    a_Url_free((DilloUrl *)entry->Url);
    dFree(entry->TypeDet);
    dFree(entry->TypeHdr);
@@ -407,6 +414,19 @@ uint_t a_Cache_get_flags(const DilloUrl *url)
    return (entry ? entry->Flags : 0);
 }
 
+/*
+ * Get the bytes received so far, and the expected total (0 if unknown).
+ */
+void a_Cache_get_transfer_size(const DilloUrl *url, int *Received,
+                               int *Expected)
+{
+   CacheEntry_t *entry = Cache_entry_search(url);
+
+   *Received = entry ? entry->TransferSize : 0;
+   *Expected = (entry && (entry->Flags & CA_GotLength)) ?
+               entry->ExpectedSize : 0;
+}
+
 /*
  * Get cache entry status (following redirections).
  */
@@ -531,6 +551,7 @@ const char *a_Cache_set_content_type(const DilloUrl *url, const char *ctype,
             /* Invalidate UTF8Data */
             dStr_free(entry->UTF8Data, 1);
             entry->UTF8Data = NULL;
+            a_Plain_reread_data(entry->Url);
          }
          dFree(major); dFree(minor); dFree(charset);
       }
@@ -1153,6 +1174,51 @@ static void Cache_provide_redirection_blocked_page(CacheEntry_t *entry,
    dFree(client->Buf);
 }
 
+/*
+ * Set the charset an HTML document declares in its first bytes before
+ * it's dispatched, so that its parser doesn't have to start over when
+ * it finds the <meta> (see Html_update_content_type()).
+ * Return FALSE while more data is needed.
+ */
+static bool_t Cache_prescan_charset(CacheEntry_t *entry)
+{
+   const char *curr = Cache_current_content_type(entry);
+   char *ctype;
+   int st;
+
+   if (entry->TypeMeta || (entry->Flags & CA_Redirect) ||
+       !curr || dStrnAsciiCasecmp(curr, "text/html", 9))
+      return TRUE;
+
+   st = a_Misc_prescan_charset(entry->Data->str, entry->Data->len, &ctype);
+   if (st == 2 && (entry->Flags & CA_InProgress))
+      return FALSE;
+   if (ctype) {
+      _MSG("Cache_prescan_charset: {%s} for %s\n", ctype, URL_STR(entry->Url));
+      a_Cache_set_content_type(entry->Url, ctype, "meta");
+      dFree(ctype);
+   }
+   return TRUE;
+}
+
+/*
+ * Give up the charset prescan of an entry that's been waiting for too long.
+ */
+static void Cache_prescan_deadline_cb(void *data)
+{
+   DilloUrl *url = (DilloUrl *)data;
+   CacheEntry_t *entry = Cache_entry_search(url);
+
+   if (entry && (entry->Flags & CA_PrescanWait) &&
+       !(entry->Flags & CA_Prescanned)) {
+      _MSG("Cache_prescan_deadline_cb: %s\n", URL_STR(url));
+      entry->Flags |= CA_Prescanned;
+      Cache_delayed_process_queue(entry);
+   }
+   a_Url_free(url);
+   a_Timeout_remove();
+}
+
 /*
  * Update cache clients for a single cache-entry
  * Tasks:
@@ -1198,6 +1264,18 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
       } else
          return entry;  /* i.e., wait for more data */
    }
+   if (!(entry->Flags & CA_Prescanned)) {
+      if (!Cache_prescan_charset(entry)) {
+         /* wait for more data, but don't hold back the first paint */
+         if (!(entry->Flags & CA_PrescanWait)) {
+            entry->Flags |= CA_PrescanWait;
+            a_Timeout_add(CACHE_PRESCAN_DEADLINE, Cache_prescan_deadline_cb,
+                          a_Url_dup(entry->Url));
+         }
+         return entry;
+      }
+      entry->Flags |= CA_Prescanned;
+   }
 
    Busy = TRUE;
    for (i = 0; (Client = dList_nth_data(ClientQueue, i)); ++i) {
@@ -1291,8 +1369,9 @@ static CacheEntry_t *Cache_process_queue(CacheEntry_t *entry)
             }
          }
 
-         /* Remove client when done */
-         if (!(entry->Flags & CA_InProgress)) {
+         /* Remove client when done (and its image is decoded) */
+         if (!(entry->Flags & CA_InProgress) &&
+             !a_Dicache_decoding(Client->Url, Client->Version)) {
             /* Copy flags to a local var */
             int flags = ClientWeb->flags;
 
@@ -1383,6 +1462,18 @@ static void Cache_delayed_process_queue(CacheEntry_t *entry)
    }
 }
 
+/*
+ * Feed the clients of a cached URL again from the main cycle
+ * (the dicache uses it when rows decoded in the background are ready).
+ */
+void a_Cache_process_delayed(const DilloUrl *Url)
+{
+   CacheEntry_t *entry;
+
+   if ((entry = Cache_entry_search(Url)))
+      Cache_delayed_process_queue(entry);
+}
+
 /*
  * Last Client for this entry?
  * Return: Client if true, NULL otherwise
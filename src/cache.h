@@ -34,6 +34,8 @@ extern "C" {
 #define CA_HugeFile     0x1000  /* URL content is too big */
 #define CA_IsEmpty      0x2000  /* True until a byte of content arrives */
 #define CA_KeepAlive    0x4000
+#define CA_Prescanned   0x8000  /* True after looking for a META charset */
+#define CA_PrescanWait 0x10000  /* The prescan's deadline is set */
 
 typedef struct CacheClient CacheClient_t;
 
@@ -68,6 +70,8 @@ const char *a_Cache_set_content_type(const DilloUrl *url, const char *ctype,
                                      const char *from);
 uint_t a_Cache_get_flags(const DilloUrl *url);
 uint_t a_Cache_get_flags_with_redirection(const DilloUrl *url);
+void a_Cache_get_transfer_size(const DilloUrl *url, int *Received,
+                               int *Expected);
 bool_t a_Cache_process_dbuf(int Op, const char *buf, size_t buf_size,
                           const DilloUrl *Url);
 int a_Cache_download_enabled(const DilloUrl *url);
@@ -75,6 +79,7 @@ void a_Cache_entry_remove_by_url(DilloUrl *url);
 void a_Cache_freeall(void);
 CacheClient_t *a_Cache_client_get_if_unique(int Key);
 void a_Cache_stop_client(int Key);
+void a_Cache_process_delayed(const DilloUrl *Url);
 
 
 #ifdef __cplusplus
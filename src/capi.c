@@ -307,8 +307,10 @@ static char *Capi_dpi_build_cmd(DilloWeb *web, char *server)
                              "download", URL_STR(web->url), web->filename);
 
    } else {
-      /* For everyone else, the url string is enough... */
-      cmd = a_Dpip_build_cmd("cmd=%s url=%s", "open_url", URL_STR(web->url));
+      /* For everyone else, the url string is enough...
+       * (and binary framing is welcome for the answer) */
+      cmd = a_Dpip_build_cmd("cmd=%s url=%s framing=%s",
+                             "open_url", URL_STR(web->url), "bin");
    }
    return cmd;
 }
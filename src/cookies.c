@@ -37,7 +37,7 @@ void a_Cookies_init(void)
 #include <errno.h>
 
 #include "IO/Url.h"
-#include "list.h"
+#include "domtrie.h"
 #include "cookies.h"
 #include "capi.h"
 #include "../dpip/dpip.h"
@@ -52,15 +52,14 @@ typedef enum {
    COOKIE_DENY
 } CookieControlAction;
 
+/* The rules for one domain; -1 when there is no such rule */
 typedef struct {
-   CookieControlAction action;
-   char *domain;
+   int exact;               /* "example.com" */
+   int subdomains;          /* ".example.com" */
 } CookieControl;
 
 /* Variables for access control */
-static CookieControl *ccontrol = NULL;
-static int num_ccontrol = 0;
-static int num_ccontrol_max = 1;
+static Domtrie *ccontrol = NULL;
 static CookieControlAction default_action = COOKIE_DENY;
 
 static bool_t disabled;
@@ -237,7 +236,7 @@ char *a_Cookies_get_query(const DilloUrl *query_url, const DilloUrl *requester)
  */
 static int Cookie_control_init(void)
 {
-   CookieControl cc;
+   CookieControlAction action;
    FILE *stream;
    char *filename, *rc;
    char line[LINE_MAXLEN];
@@ -286,37 +285,39 @@ static int Cookie_control_init(void)
          rule[j] = '\0';
 
          if (dStrAsciiCasecmp(rule, "ACCEPT") == 0)
-            cc.action = COOKIE_ACCEPT;
+            action = COOKIE_ACCEPT;
          else if (dStrAsciiCasecmp(rule, "ACCEPT_SESSION") == 0)
-            cc.action = COOKIE_ACCEPT_SESSION;
+            action = COOKIE_ACCEPT_SESSION;
          else if (dStrAsciiCasecmp(rule, "DENY") == 0)
-            cc.action = COOKIE_DENY;
+            action = COOKIE_DENY;
          else {
             MSG("Cookies: rule '%s' for domain '%s' is not recognised.\n",
                 rule, domain);
             continue;
          }
 
-         cc.domain = dStrdup(domain);
-         if (dStrAsciiCasecmp(cc.domain, "DEFAULT") == 0) {
+         if (dStrAsciiCasecmp(domain, "DEFAULT") == 0) {
             /* Set the default action */
-            default_action = cc.action;
-            dFree(cc.domain);
-         } else {
-            int i;
-            uint_t len = strlen(cc.domain);
-
-            /* Insert into list such that longest rules come first. */
-            a_List_add(ccontrol, num_ccontrol, num_ccontrol_max);
-            for (i = num_ccontrol++;
-                 i > 0 && (len > strlen(ccontrol[i-1].domain));
-                 i--) {
-               ccontrol[i] = ccontrol[i-1];
+            default_action = action;
+         } else if (domain[domain[0] == '.'] != '\0') {
+            CookieControl *cc;
+            void **slot;
+
+            if (!ccontrol)
+               ccontrol = a_Domtrie_new();
+            slot = a_Domtrie_slot(ccontrol, domain + (domain[0] == '.'));
+            if (!(cc = *slot)) {
+               cc = *slot = dNew(CookieControl, 1);
+               cc->exact = cc->subdomains = -1;
             }
-            ccontrol[i] = cc;
+            /* The first rule for a given domain wins */
+            if (domain[0] == '.' && cc->subdomains == -1)
+               cc->subdomains = action;
+            else if (domain[0] != '.' && cc->exact == -1)
+               cc->exact = action;
          }
 
-         if (cc.action != COOKIE_DENY)
+         if (action != COOKIE_DENY)
             enabled = TRUE;
       }
    }
@@ -328,29 +329,24 @@ static int Cookie_control_init(void)
 
 /*
  * Check the rules for an appropriate action for this domain.
- * The rules are ordered by domain length, with longest first, so the
- * first match is the most specific.
+ * The rules are found by walking the domain's labels in a trie,
+ * with the deepest (most specific) match first.
  */
 static CookieControlAction Cookies_control_check_domain(const char *domain)
 {
-   int i, diff;
-
-   for (i = 0; i < num_ccontrol; i++) {
-      if (ccontrol[i].domain[0] == '.') {
-         diff = strlen(domain) - strlen(ccontrol[i].domain);
-         if (diff >= 0) {
-            if (dStrAsciiCasecmp(domain + diff, ccontrol[i].domain) != 0)
-               continue;
-         } else {
-            continue;
-         }
-      } else {
-         if (dStrAsciiCasecmp(domain, ccontrol[i].domain) != 0)
-            continue;
-      }
-
-      /* If we got here we have a match */
-      return( ccontrol[i].action );
+   DomtrieMatch m[DOMTRIE_MAX_LABELS];
+   int i, n = 0;
+
+   if (ccontrol)
+      n = a_Domtrie_match(ccontrol, domain, m, DOMTRIE_MAX_LABELS);
+   for (i = 0; i < n; i++) {
+      CookieControl *cc = m[i].Data;
+
+      /* ".example.com" doesn't apply to "example.com" itself */
+      if (m[i].Exact && cc->exact != -1)
+         return cc->exact;
+      if (!m[i].Exact && cc->subdomains != -1)
+         return cc->subdomains;
    }
 
    return default_action;
@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include "../dlib/dlib.h"
 #include "msg.h"
+#include "atom.h"
 #include "html_common.hh"
 #include "css.hh"
 
@@ -150,7 +151,7 @@ bool CssSelector::match (Doctree *docTree, const DoctreeNode *node,
 
          for (const DoctreeNode *n = node;
               n && n->num > *matchCacheEntry; n = docTree->parent (n))
-            if (sel->match (n) &&
+            if (sel->match (n, docTree->quirksMode ()) &&
                 match (docTree, n, i - 1, cs->combinator, matchCache))
                return true;
 
@@ -163,7 +164,7 @@ bool CssSelector::match (Doctree *docTree, const DoctreeNode *node,
          return false; // \todo implement other combinators
    }
 
-   if (!node || !sel->match (node))
+   if (!node || !sel->match (node, docTree->quirksMode ()))
       return false;
 
    // tail recursion should be optimized by the compiler
@@ -236,8 +237,8 @@ CssSimpleSelector::CssSimpleSelector () {
 
 CssSimpleSelector::~CssSimpleSelector () {
    for (int i = 0; i < klass.size (); i++)
-      dFree (klass.get (i));
-   dFree (id);
+      a_Atom_unref (klass.get (i));
+   a_Atom_unref (id);
    dFree (pseudo);
 }
 
@@ -245,7 +246,7 @@ void CssSimpleSelector::setSelect (SelectType t, const char *v) {
    switch (t) {
       case SELECT_CLASS:
          klass.increase ();
-         klass.set (klass.size () - 1, dStrdup (v));
+         klass.set (klass.size () - 1, a_Atom_intern (v));
          break;
       case SELECT_PSEUDO_CLASS:
          if (pseudo == NULL)
@@ -253,7 +254,7 @@ void CssSimpleSelector::setSelect (SelectType t, const char *v) {
          break;
       case SELECT_ID:
          if (id == NULL)
-            id = dStrdup (v);
+            id = a_Atom_intern (v);
          break;
       default:
          break;
@@ -263,21 +264,26 @@ void CssSimpleSelector::setSelect (SelectType t, const char *v) {
 /**
  * \brief Return whether simple selector matches at a given node of
  *        the document tree.
+ *
+ * In quirks mode, ids and class names match ignoring ASCII case.
  */
-bool CssSimpleSelector::match (const DoctreeNode *n) {
+bool CssSimpleSelector::match (const DoctreeNode *n, bool quirks) {
    assert (n);
    if (element != ELEMENT_ANY && element != n->element)
       return false;
    if (pseudo != NULL &&
       (n->pseudo == NULL || dStrAsciiCasecmp (pseudo, n->pseudo) != 0))
       return false;
-   if (id != NULL && (n->id == NULL || dStrAsciiCasecmp (id, n->id) != 0))
+   if (id != NULL && id != n->id &&
+       !(quirks && a_Atom_fold (id) == a_Atom_fold (n->id)))
       return false;
    for (int i = 0; i < klass.size (); i++) {
       bool found = false;
       if (n->klass != NULL) {
          for (int j = 0; j < n->klass->size (); j++) {
-            if (dStrAsciiCasecmp (klass.get(i), n->klass->get(j)) == 0) {
+            if (klass.get(i) == n->klass->get(j) ||
+                (quirks && a_Atom_fold (klass.get(i)) ==
+                           a_Atom_fold (n->klass->get(j)))) {
                found = true;
                break;
             }
@@ -372,25 +378,26 @@ void CssStyleSheet::RuleList::insert (CssRule *rule) {
 void CssStyleSheet::addRule (CssRule *rule) {
    CssSimpleSelector *top = rule->selector->top ();
    RuleList *ruleList = NULL;
-   lout::object::ConstString *string;
+   lout::object::Pointer *atom;
 
    if (top->getId ()) {
-      string = new lout::object::ConstString (top->getId ());
-      ruleList = idTable.get (string);
+      atom = new lout::object::Pointer ((void *) a_Atom_fold (top->getId ()));
+      ruleList = idTable.get (atom);
       if (ruleList == NULL) {
          ruleList = new RuleList ();
-         idTable.put (string, ruleList);
+         idTable.put (atom, ruleList);
       } else {
-         delete string;
+         delete atom;
       }
    } else if (top->getClass () && top->getClass ()->size () > 0) {
-      string = new lout::object::ConstString (top->getClass ()->get (0));
-      ruleList = classTable.get (string);
+      atom = new lout::object::Pointer
+         ((void *) a_Atom_fold (top->getClass ()->get (0)));
+      ruleList = classTable.get (atom);
       if (ruleList == NULL) {
          ruleList = new RuleList;
-         classTable.put (string, ruleList);
+         classTable.put (atom, ruleList);
       } else {
-         delete string;
+         delete atom;
       }
    } else if (top->getElement () >= 0 && top->getElement () < ntags) {
       ruleList = &elementTable[top->getElement ()];
@@ -421,9 +428,9 @@ void CssStyleSheet::apply (CssPropertyList *props, Doctree *docTree,
    int numLists = 0, index[maxLists] = {0};
 
    if (node->id) {
-      lout::object::ConstString idString (node->id);
+      lout::object::Pointer idAtom ((void *) a_Atom_fold (node->id));
 
-      ruleList[numLists] = idTable.get (&idString);
+      ruleList[numLists] = idTable.get (&idAtom);
       if (ruleList[numLists])
          numLists++;
    }
@@ -435,9 +442,10 @@ void CssStyleSheet::apply (CssPropertyList *props, Doctree *docTree,
             break;
          }
 
-         lout::object::ConstString classString (node->klass->get (i));
+         lout::object::Pointer
+            classAtom ((void *) a_Atom_fold (node->klass->get (i)));
 
-         ruleList[numLists] = classTable.get (&classString);
+         ruleList[numLists] = classTable.get (&classAtom);
          if (ruleList[numLists])
             numLists++;
       }
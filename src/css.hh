@@ -336,8 +336,9 @@ class CssPropertyList : public lout::misc::SimpleVector <CssProperty> {
 class CssSimpleSelector {
    private:
       int element;
-      char *pseudo, *id;
-      lout::misc::SimpleVector <char *> klass;
+      char *pseudo;
+      const char *id; // an atom, as are the class names
+      lout::misc::SimpleVector <const char *> klass;
 
    public:
       enum {
@@ -356,11 +357,13 @@ class CssSimpleSelector {
       ~CssSimpleSelector ();
       inline void setElement (int e) { element = e; };
       void setSelect (SelectType t, const char *v);
-      inline lout::misc::SimpleVector <char *> *getClass () { return &klass; };
+      inline lout::misc::SimpleVector <const char *> *getClass () {
+         return &klass;
+      };
       inline const char *getPseudoClass () { return pseudo; };
       inline const char *getId () { return id; };
       inline int getElement () { return element; };
-      bool match (const DoctreeNode *node);
+      bool match (const DoctreeNode *node, bool quirks);
       int specificity ();
       void print ();
 };
@@ -472,11 +475,13 @@ class CssStyleSheet {
             inline int hashValue () { return (intptr_t) this; };
       };
 
+      /* Rule lists by the lowercase atom of an id or class, so that they
+       * also serve quirks mode; the rules' selectors still match case */
       class RuleMap : public lout::container::typed::HashTable
-                             <lout::object::ConstString, RuleList > {
+                             <lout::object::Pointer, RuleList > {
          public:
             RuleMap () : lout::container::typed::HashTable
-               <lout::object::ConstString, RuleList > (true, true, 256) {};
+               <lout::object::Pointer, RuleList > (true, true, 256) {};
       };
 
       static const int ntags = 90 + 14; // \todo don't hardcode
@@ -11,13 +11,24 @@
 
 #include <string.h>         /* for memset */
 #include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+
+#ifdef D_IMG_THREADED
+#  include <pthread.h>
+#endif
 
 #include "msg.h"
+#include "prefs.h"
 #include "image.hh"
 #include "imgbuf.hh"
 #include "web.hh"
+#include "capi.h"
 #include "dicache.h"
+#include "IO/iowatch.hh"
 #include "dpng.h"
+#include "dwebp.h"
 #include "dgif.h"
 #include "djpeg.h"
 
@@ -25,7 +36,8 @@
 enum {
    DIC_Gif,
    DIC_Png,
-   DIC_Jpeg
+   DIC_Jpeg,
+   DIC_Webp
 };
 
 
@@ -36,9 +48,95 @@ enum {
 static Dlist *CachedIMGs = NULL;
 
 static uint_t dicache_size_total; /* invariant: dicache_size_total is
-                                   * the sum of the image sizes (3*w*h)
+                                   * the sum of the image sizes (TotalSize)
                                    * of all the images in the dicache. */
 
+/*
+ * Memory budget (prefs.image_memory_budget).
+ */
+#define DIC_MAX_EVICTED  256
+
+static ulong_t dicache_use_stamp;     /* Orders the entries' LastUse */
+static ulong_t dicache_draw_mark;     /* Images drawn after it are shown */
+static size_t dicache_evicted_total;
+static size_t dicache_redecoded_total;
+static Dlist *EvictedURLs;            /* Recently evicted, not redecoded */
+
+#ifdef D_IMG_THREADED
+/*
+ * Background decoding.
+ *
+ * The decoders run in a single worker thread. The main thread hands the
+ * new image data over to the entry's job, and the calls the decoder makes
+ * from the worker (set_parms, set_cmap, new_scan and write) are queued as
+ * events. A notify pipe brings them back to the main thread, where they're
+ * applied to the entry and its cache clients are fed again.
+ *
+ * Once the image data is complete, the worker decodes it in place from the
+ * cache's buffer, and marks the job done after the last pass. The cache
+ * keeps the client open until then (a_Dicache_decoding()), so closing
+ * doesn't wait for the worker. Aborting cancels the pending data.
+ */
+
+typedef enum {
+   DIC_EvParms,
+   DIC_EvCmap,
+   DIC_EvScan,
+   DIC_EvWrite
+} DicEventType;
+
+typedef struct {
+   DicEventType Type;
+   uint_t width, height;     /* EvParms */
+   DilloImgType type;        /* EvParms */
+   double gamma;             /* EvParms */
+   int bg_color, bg_index;   /* EvCmap */
+   uint_t num_colors;        /* EvCmap */
+   int num_colors_max;       /* EvCmap */
+   uint_t Y;                 /* EvWrite */
+   uchar_t *buf;             /* EvCmap: color map, EvWrite: row */
+} DicacheEvent;
+
+typedef struct {
+   DilloUrl *url;
+   int version;
+   void *layout;             /* For creating the imgbuf */
+   CA_Callback_t Decoder;
+   void *DecoderData;
+
+   /* Shared, guarded by dicache_mutex */
+   Dstr *Input;              /* Data handed over, not yet decoded */
+   const char *CacheBuf;     /* The complete data, in the cache (a ref) */
+   int CacheBufSize;
+   bool_t Completed;         /* The cache entry is complete */
+   bool_t SkipPasses;        /* Its SkipPasses */
+   Dlist *Events;            /* Decoder output, for the main thread */
+   bool_t Busy;              /* The worker is running the decoder */
+   bool_t Done;              /* All the data has been decoded */
+
+   /* Only touched by the worker */
+   Dstr *Data;               /* The data so far, while it's incomplete */
+   uint_t FedSize;           /* What the decoder has been fed */
+   uint_t width;
+   DilloImgType type;
+
+   /* Only touched by the main thread */
+   bool_t DoneSeen;          /* Done has been applied */
+} DicacheJob;
+
+static bool_t dicache_threaded = FALSE;
+static pthread_t dicache_worker;
+static pthread_mutex_t dicache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dicache_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t dicache_idle_cond = PTHREAD_COND_INITIALIZER;
+static Dlist *dicache_jobs;           /* Live jobs (main thread only) */
+static Dlist *dicache_run_queue;      /* Jobs with pending input */
+static DicacheJob *dicache_worker_job;   /* Job being decoded */
+static bool_t dicache_worker_complete;   /* Its Completed flag */
+static bool_t dicache_worker_skip_passes;   /* and SkipPasses */
+static int dicache_notify_pipe[2];
+#endif /* D_IMG_THREADED */
+
 /*
  * Compare function for image entries
  */
@@ -56,13 +154,373 @@ static int Dicache_entry_cmp(const void *v1, const void *v2)
    return st;
 }
 
+#ifdef D_IMG_THREADED
+
+static void Dicache_set_parms(DilloUrl *url, int version, void *layout,
+                              uint_t width, uint_t height, DilloImgType type,
+                              double gamma);
+
+/*
+ * Are we running in the decoder thread?
+ */
+static bool_t Dicache_in_worker(void)
+{
+   return dicache_threaded && pthread_equal(pthread_self(), dicache_worker);
+}
+
+/* Worker side ------------------------------------------------------------ */
+
+static DicacheEvent *Dicache_event_new(DicEventType Type)
+{
+   DicacheEvent *ev = dNew0(DicacheEvent, 1);
+
+   ev->Type = Type;
+   return ev;
+}
+
+/*
+ * Queue an event for the main thread
+ */
+static void Dicache_job_event(DicacheEvent *ev)
+{
+   pthread_mutex_lock(&dicache_mutex);
+   dList_append(dicache_worker_job->Events, ev);
+   pthread_mutex_unlock(&dicache_mutex);
+}
+
+static void Dicache_job_set_parms(uint_t width, uint_t height,
+                                  DilloImgType type, double gamma)
+{
+   DicacheEvent *ev = Dicache_event_new(DIC_EvParms);
+
+   ev->width = width;
+   ev->height = height;
+   ev->type = type;
+   ev->gamma = gamma;
+   /* remember the row format for the write events */
+   dicache_worker_job->width = width;
+   dicache_worker_job->type = type;
+   Dicache_job_event(ev);
+}
+
+static void Dicache_job_set_cmap(int bg_color, const uchar_t *cmap,
+                                 uint_t num_colors, int num_colors_max,
+                                 int bg_index)
+{
+   DicacheEvent *ev = Dicache_event_new(DIC_EvCmap);
+
+   ev->bg_color = bg_color;
+   ev->num_colors = num_colors;
+   ev->num_colors_max = num_colors_max;
+   ev->bg_index = bg_index;
+   ev->buf = dNew(uchar_t, 3 * num_colors);
+   memcpy(ev->buf, cmap, 3 * num_colors);
+   Dicache_job_event(ev);
+}
+
+static void Dicache_job_write(const uchar_t *buf, uint_t Y)
+{
+   DicacheJob *job = dicache_worker_job;
+   DicacheEvent *ev;
+   uint_t bpp;
+
+   dReturn_if_fail ( job->width > 0 );
+
+   bpp = (job->type == DILLO_IMG_TYPE_RGB) ? 3 :
+         (job->type == DILLO_IMG_TYPE_CMYK_INV) ? 4 : 1;
+   ev = Dicache_event_new(DIC_EvWrite);
+   ev->Y = Y;
+   ev->buf = dNew(uchar_t, bpp * job->width);
+   memcpy(ev->buf, buf, bpp * job->width);
+   Dicache_job_event(ev);
+}
+
+/*
+ * Decoder thread: feed the queued data to the decoders, one job at a time.
+ * Every pass ends with a single notification for the rows it produced,
+ * or for the job being done.
+ */
+static void *Dicache_worker(void *data)
+{
+   DicacheJob *job;
+   CacheClient_t Client;
+   const char *buf;
+   uint_t size;
+   bool_t complete, notify;
+
+   pthread_mutex_lock(&dicache_mutex);
+   while (1) {
+      while (!(job = dList_nth_data(dicache_run_queue, 0)))
+         pthread_cond_wait(&dicache_work_cond, &dicache_mutex);
+      dList_remove(dicache_run_queue, job);
+      if (job->CacheBuf) {
+         buf = job->CacheBuf;
+         size = job->CacheBufSize;
+      } else {
+         if (!job->Data)
+            job->Data = dStr_new(NULL);
+         dStr_append_l(job->Data, job->Input->str, job->Input->len);
+         dStr_truncate(job->Input, 0);
+         buf = job->Data->str;
+         size = job->Data->len;
+      }
+      complete = job->Completed;
+      dicache_worker_complete = complete;
+      dicache_worker_skip_passes = job->SkipPasses;
+      job->Busy = TRUE;
+      pthread_mutex_unlock(&dicache_mutex);
+
+      if (size > job->FedSize) {
+         /* The decoders only look at Buf, BufSize and CbData on CA_Send */
+         memset(&Client, 0, sizeof(Client));
+         Client.Url = job->url;
+         Client.Version = job->version;
+         Client.Buf = (void *)buf;
+         Client.BufSize = size;
+         Client.CbData = job->DecoderData;
+         dicache_worker_job = job;
+         job->Decoder(CA_Send, &Client);
+         dicache_worker_job = NULL;
+         job->FedSize = size;
+      }
+      if (complete) {
+         /* the rest comes from the cache's buffer */
+         dStr_free(job->Data, 1);
+         job->Data = NULL;
+      }
+
+      pthread_mutex_lock(&dicache_mutex);
+      job->Busy = FALSE;
+      if (complete && !dList_find(dicache_run_queue, job))
+         job->Done = TRUE;
+      notify = job->Done || dList_length(job->Events) > 0;
+      pthread_cond_broadcast(&dicache_idle_cond);
+      if (notify)
+         write(dicache_notify_pipe[1], ".", 1);
+   }
+   return NULL;                 /* (avoids a compiler warning) */
+}
+
+/* Main thread side ------------------------------------------------------- */
+
+/*
+ * Apply the events a job has produced so far to its dicache entry.
+ * Return value: whether there was anything new (events, or the job
+ * being done).
+ */
+static bool_t Dicache_job_apply(DicacheJob *job)
+{
+   Dlist *events;
+   DicacheEvent *ev;
+   bool_t done;
+   int i;
+
+   pthread_mutex_lock(&dicache_mutex);
+   events = job->Events;
+   job->Events = dList_new(32);
+   done = job->Done && !job->DoneSeen;
+   job->DoneSeen = job->Done;
+   pthread_mutex_unlock(&dicache_mutex);
+
+   for (i = 0; (ev = dList_nth_data(events, i)); ++i) {
+      switch (ev->Type) {
+      case DIC_EvParms:
+         Dicache_set_parms(job->url, job->version, job->layout,
+                           ev->width, ev->height, ev->type, ev->gamma);
+         break;
+      case DIC_EvCmap:
+         a_Dicache_set_cmap(job->url, job->version, ev->bg_color, ev->buf,
+                            ev->num_colors, ev->num_colors_max, ev->bg_index);
+         break;
+      case DIC_EvScan:
+         a_Dicache_new_scan(job->url, job->version);
+         break;
+      case DIC_EvWrite:
+         a_Dicache_write(job->url, job->version, ev->buf, ev->Y);
+         break;
+      }
+      dFree(ev->buf);
+      dFree(ev);
+   }
+   dList_free(events);
+   return (i > 0 || done);
+}
+
+/*
+ * Read the worker's notifications and update the images.
+ */
+static void Dicache_notify_cb(int fd, void *data)
+{
+   char buf[16];
+   int i;
+   DicacheJob *job;
+
+   while (read(dicache_notify_pipe[0], buf, sizeof(buf)) > 0);
+
+   for (i = 0; (job = dList_nth_data(dicache_jobs, i)); ++i)
+      if (Dicache_job_apply(job))
+         a_Cache_process_delayed(job->url);
+}
+
+/*
+ * Hand the entry's new data over to the decoder thread.
+ * Once the data is complete, the worker gets a reference to the cache's
+ * buffer instead, and is told to finish.
+ */
+static void Dicache_job_feed(DICacheEntry *DicEntry, CacheClient_t *Client)
+{
+   DicacheJob *job = DicEntry->DecoderJob;
+   bool_t complete = a_Dicache_data_complete(DicEntry->url);
+   char *buf;
+   int size;
+
+   if (!job) {
+      job = dNew0(DicacheJob, 1);
+      job->url = a_Url_dup(DicEntry->url);
+      job->version = DicEntry->version;
+      job->layout = ((DilloWeb *)Client->Web)->Image->layout;
+      job->Decoder = DicEntry->Decoder;
+      job->DecoderData = DicEntry->DecoderData;
+      job->Input = dStr_new(NULL);
+      job->Events = dList_new(32);
+      job->type = DILLO_IMG_TYPE_NOTSET;
+      dList_append(dicache_jobs, job);
+      DicEntry->DecoderJob = job;
+   }
+
+   if (complete && !a_Capi_get_buf(DicEntry->url, &buf, &size))
+      complete = FALSE;
+
+   pthread_mutex_lock(&dicache_mutex);
+   if (complete) {
+      job->CacheBuf = buf;
+      job->CacheBufSize = size;
+      dStr_free(job->Input, 1);
+      job->Input = dStr_new(NULL);
+   } else {
+      dStr_append_l(job->Input, (char *)Client->Buf + DicEntry->DecodedSize,
+                    Client->BufSize - DicEntry->DecodedSize);
+   }
+   job->Completed = complete;
+   job->SkipPasses = DicEntry->SkipPasses;
+   if (!dList_find(dicache_run_queue, job))
+      dList_append(dicache_run_queue, job);
+   pthread_cond_signal(&dicache_work_cond);
+   pthread_mutex_unlock(&dicache_mutex);
+}
+
+static void Dicache_job_remove(DICacheEntry *DicEntry)
+{
+   DicacheJob *job = DicEntry->DecoderJob;
+   DicacheEvent *ev;
+
+   while ((ev = dList_nth_data(job->Events, 0))) {
+      dList_remove_fast(job->Events, ev);
+      dFree(ev->buf);
+      dFree(ev);
+   }
+   dList_free(job->Events);
+   dList_remove(dicache_jobs, job);
+   dStr_free(job->Input, 1);
+   dStr_free(job->Data, 1);
+   if (job->CacheBuf)
+      a_Capi_unref_buf(job->url);
+   a_Url_free(job->url);
+   dFree(job);
+   DicEntry->DecoderJob = NULL;
+}
+
+/*
+ * Apply the last results of a job and drop it.
+ * Afterwards the decoder belongs to the main thread again.
+ * (The cache only closes the client once the job is done, so this
+ *  doesn't wait for the worker)
+ */
+static void Dicache_job_finish(DICacheEntry *DicEntry)
+{
+   DicacheJob *job = DicEntry->DecoderJob;
+
+   pthread_mutex_lock(&dicache_mutex);
+   while (job->Busy || dList_find(dicache_run_queue, job))
+      pthread_cond_wait(&dicache_idle_cond, &dicache_mutex);
+   pthread_mutex_unlock(&dicache_mutex);
+
+   Dicache_job_apply(job);
+   Dicache_job_remove(DicEntry);
+}
+
+/*
+ * Drop the pending data, and wait for the worker to leave the decoder.
+ */
+static void Dicache_job_cancel(DICacheEntry *DicEntry)
+{
+   DicacheJob *job = DicEntry->DecoderJob;
+
+   pthread_mutex_lock(&dicache_mutex);
+   dList_remove(dicache_run_queue, job);
+   while (job->Busy)
+      pthread_cond_wait(&dicache_idle_cond, &dicache_mutex);
+   pthread_mutex_unlock(&dicache_mutex);
+
+   Dicache_job_remove(DicEntry);
+}
+
+/*
+ * Start the decoder thread (decoding stays synchronous if it fails)
+ */
+static void Dicache_worker_init(void)
+{
+   pthread_attr_t thrATTR;
+
+   if (pipe(dicache_notify_pipe) < 0) {
+      MSG("Dicache_worker_init: pipe failed, decoding in the main thread\n");
+      return;
+   }
+   fcntl(dicache_notify_pipe[0], F_SETFL, O_NONBLOCK);
+   /* a full pipe already has a notification pending */
+   fcntl(dicache_notify_pipe[1], F_SETFL, O_NONBLOCK);
+
+   dicache_jobs = dList_new(16);
+   dicache_run_queue = dList_new(16);
+
+   pthread_attr_init(&thrATTR);
+   pthread_attr_setdetachstate(&thrATTR, PTHREAD_CREATE_DETACHED);
+   if (pthread_create(&dicache_worker, &thrATTR, Dicache_worker, NULL) == 0) {
+      dicache_threaded = TRUE;
+      a_IOwatch_add_fd(dicache_notify_pipe[0], DIO_READ, Dicache_notify_cb,
+                       NULL);
+   } else {
+      MSG("Dicache_worker_init: no thread, decoding in the main thread\n");
+      dClose(dicache_notify_pipe[0]);
+      dClose(dicache_notify_pipe[1]);
+   }
+   pthread_attr_destroy(&thrATTR);
+}
+
+#endif /* D_IMG_THREADED */
+
 /*
  * Initialize dicache data
  */
 void a_Dicache_init(void)
 {
    CachedIMGs = dList_new(256);
+   EvictedURLs = dList_new(32);
    dicache_size_total = 0;
+#ifdef D_IMG_THREADED
+   Dicache_worker_init();
+#endif
+}
+
+/*
+ * Current time, in seconds
+ */
+static double Dicache_now(void)
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
 }
 
 /*
@@ -74,12 +532,15 @@ static DICacheEntry *Dicache_entry_new(void)
 
    entry->width = 0;
    entry->height = 0;
+   entry->req_width = 0;
+   entry->req_height = 0;
    entry->Flags = DIF_Valid;
    entry->SurvCleanup = 0;
    entry->type = DILLO_IMG_TYPE_NOTSET;
    entry->cmap = NULL;
    entry->v_imgbuf = NULL;
    entry->RefCount = 1;
+   entry->LastUse = 0;
    entry->TotalSize = 0;
    entry->ScanNumber = 0;
    entry->BitVec = NULL;
@@ -89,6 +550,9 @@ static DICacheEntry *Dicache_entry_new(void)
    entry->Decoder = NULL;
    entry->DecoderData = NULL;
    entry->DecodedSize = 0;
+   entry->StartTime = Dicache_now();
+   entry->SkipPasses = FALSE;
+   entry->DecoderJob = NULL;
 
    return entry;
 }
@@ -162,6 +626,10 @@ static void Dicache_remove(const DilloUrl *Url, int version)
    dFree(entry->cmap);
    a_Bitvec_free(entry->BitVec);
    a_Imgbuf_unref(entry->v_imgbuf);
+#ifdef D_IMG_THREADED
+   if (entry->DecoderJob)
+      Dicache_job_cancel(entry);
+#endif
    if (entry->Decoder) {
       entry->Decoder(CA_Abort, entry->DecoderData);
    }
@@ -214,6 +682,151 @@ void a_Dicache_invalidate_entry(const DilloUrl *Url)
 }
 
 
+/*
+ * Compare function for the URLs in EvictedURLs
+ */
+static int Dicache_url_cmp(const void *v1, const void *v2)
+{
+   return a_Url_cmp((const DilloUrl *)v1, (const DilloUrl *)v2);
+}
+
+/*
+ * Least recently drawn image first
+ */
+static int Dicache_drawn_cmp(const void *v1, const void *v2)
+{
+   ulong_t d1 = a_Imgbuf_last_drawn(((const DICacheEntry *)v1)->v_imgbuf),
+           d2 = a_Imgbuf_last_drawn(((const DICacheEntry *)v2)->v_imgbuf);
+
+   return (d1 < d2) ? -1 : (d1 > d2);
+}
+
+/*
+ * Least recently requested entry first
+ */
+static int Dicache_used_cmp(const void *v1, const void *v2)
+{
+   ulong_t u1 = ((const DICacheEntry *)v1)->LastUse,
+           u2 = ((const DICacheEntry *)v2)->LastUse;
+
+   return (u1 < u2) ? -1 : (u1 > u2);
+}
+
+/*
+ * Is the entry unused? (no cache clients, and no page shows its imgbuf)
+ */
+static bool_t Dicache_entry_unused(DICacheEntry *entry)
+{
+   return entry->RefCount == 0 && entry->DecoderJob == NULL &&
+          (!entry->v_imgbuf || a_Imgbuf_last_reference(entry->v_imgbuf));
+}
+
+/*
+ * Bytes of decoded image data, scaled copies included.
+ */
+static size_t Dicache_resident_size(void)
+{
+   size_t size = dicache_size_total;
+   DICacheEntry *entry;
+   int i;
+
+   for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i)
+      if (entry->v_imgbuf)
+         size += a_Imgbuf_scaled_size(entry->v_imgbuf);
+   return size;
+}
+
+/*
+ * Free an unused entry to make room, and remember its URL so that
+ * decoding it again gets counted.
+ */
+static void Dicache_evict(DICacheEntry *entry)
+{
+   _MSG("Dicache_evict: %s (%u bytes)\n", URL_STR(entry->url),
+        entry->TotalSize);
+   dicache_evicted_total += entry->TotalSize;
+   if (!dList_find_custom(EvictedURLs, entry->url, Dicache_url_cmp)) {
+      if (dList_length(EvictedURLs) == DIC_MAX_EVICTED) {
+         DilloUrl *oldest = dList_nth_data(EvictedURLs, 0);
+         dList_remove(EvictedURLs, oldest);
+         a_Url_free(oldest);
+      }
+      dList_append(EvictedURLs, a_Url_dup(entry->url));
+   }
+   Dicache_remove(entry->url, entry->version);
+}
+
+/*
+ * Keep the decoded images within prefs.image_memory_budget.
+ * First free the scaled copies of the images that haven't been drawn
+ * since the previous pass (i.e. are off screen), least recently drawn
+ * first. Then the unused entries, least recently requested first; the
+ * cache still has their data, so they're decoded again when requested.
+ */
+static void Dicache_enforce_budget(void)
+{
+   size_t budget, resident, freed;
+   ulong_t mark = dicache_draw_mark, drawn;
+   DICacheEntry *entry;
+   Dlist *lru;
+   int i;
+
+   if (prefs.image_memory_budget <= 0)
+      return;
+   budget = (size_t)prefs.image_memory_budget << 20;
+
+   /* The next pass takes the images drawn from now on as shown */
+   for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i) {
+      if (entry->v_imgbuf &&
+          (drawn = a_Imgbuf_last_drawn(entry->v_imgbuf)) > dicache_draw_mark)
+         dicache_draw_mark = drawn;
+   }
+
+   if ((resident = Dicache_resident_size()) <= budget)
+      return;
+   _MSG("Dicache_enforce_budget: %lu bytes over\n",
+        (ulong_t)(resident - budget));
+
+   /* Scaled copies of off-screen images */
+   lru = dList_new(32);
+   for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i) {
+      if (entry->v_imgbuf && a_Imgbuf_last_drawn(entry->v_imgbuf) <= mark &&
+          a_Imgbuf_scaled_size(entry->v_imgbuf) > 0)
+         dList_append(lru, entry);
+   }
+   dList_sort(lru, Dicache_drawn_cmp);
+   for (i = 0; resident > budget && (entry = dList_nth_data(lru, i)); ++i) {
+      freed = a_Imgbuf_release_scaled(entry->v_imgbuf);
+      resident -= freed;
+      dicache_evicted_total += freed;
+   }
+   dList_free(lru);
+
+   /* Unused entries */
+   lru = dList_new(32);
+   for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i) {
+      if (entry->TotalSize > 0 && Dicache_entry_unused(entry))
+         dList_append(lru, entry);
+   }
+   dList_sort(lru, Dicache_used_cmp);
+   for (i = 0; resident > budget && (entry = dList_nth_data(lru, i)); ++i) {
+      resident -= entry->TotalSize;
+      Dicache_evict(entry);
+   }
+   dList_free(lru);
+}
+
+/*
+ * Get the decoded image memory counters.
+ */
+void a_Dicache_get_stats(DicacheStats *stats)
+{
+   stats->Resident = Dicache_resident_size();
+   stats->Evicted = dicache_evicted_total;
+   stats->Redecoded = dicache_redecoded_total;
+}
+
+
 /* ------------------------------------------------------------------------- */
 
 /*
@@ -222,14 +835,13 @@ void a_Dicache_invalidate_entry(const DilloUrl *Url)
  * - HTML width and height attrs are handled with setNonCssHint.
  * - CSS sizing is handled by the CSS engine.
  */
-void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
-                         uint_t width, uint_t height, DilloImgType type,
-                         double gamma)
+static void Dicache_set_parms(DilloUrl *url, int version, void *layout,
+                              uint_t width, uint_t height, DilloImgType type,
+                              double gamma)
 {
    DICacheEntry *DicEntry;
+   DilloUrl *evicted;
 
-   _MSG("a_Dicache_set_parms (%s)\n", URL_STR(url));
-   dReturn_if_fail ( Image != NULL && width && height );
    /* Find the DicEntry for this Image */
    DicEntry = a_Dicache_get_entry(url, version);
    dReturn_if_fail ( DicEntry != NULL );
@@ -238,12 +850,12 @@ void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
 
    _MSG("  RefCount=%d version=%d\n", DicEntry->RefCount, DicEntry->version);
 
-   /* BUG: there's just one image-type now */
-   #define I_RGB 0
    DicEntry->v_imgbuf =
-      a_Imgbuf_new(Image->layout, I_RGB, width, height, gamma);
+      a_Imgbuf_new(layout, type, width, height, gamma);
 
-   DicEntry->TotalSize = width * height * 3;
+   /* indexed and gray images are stored at one byte per pixel */
+   DicEntry->TotalSize = width * height *
+      ((type == DILLO_IMG_TYPE_INDEXED || type == DILLO_IMG_TYPE_GRAY) ? 1:3);
    DicEntry->width = width;
    DicEntry->height = height;
    DicEntry->type = type;
@@ -251,6 +863,28 @@ void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
    DicEntry->State = DIC_SetParms;
 
    dicache_size_total += DicEntry->TotalSize;
+
+   if ((evicted = dList_find_custom(EvictedURLs, url, Dicache_url_cmp))) {
+      /* Freed by the budget before, and decoded once more */
+      dicache_redecoded_total += DicEntry->TotalSize;
+      dList_remove(EvictedURLs, evicted);
+      a_Url_free(evicted);
+   }
+}
+
+void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
+                         uint_t width, uint_t height, DilloImgType type,
+                         double gamma)
+{
+   _MSG("a_Dicache_set_parms (%s)\n", URL_STR(url));
+   dReturn_if_fail ( Image != NULL && width && height );
+#ifdef D_IMG_THREADED
+   if (Dicache_in_worker()) {
+      Dicache_job_set_parms(width, height, type, gamma);
+      return;
+   }
+#endif
+   Dicache_set_parms(url, version, Image->layout, width, height, type, gamma);
 }
 
 /*
@@ -260,9 +894,17 @@ void a_Dicache_set_cmap(DilloUrl *url, int version, int bg_color,
                         const uchar_t *cmap, uint_t num_colors,
                         int num_colors_max, int bg_index)
 {
-   DICacheEntry *DicEntry = a_Dicache_get_entry(url, version);
+   DICacheEntry *DicEntry;
 
    _MSG("a_Dicache_set_cmap\n");
+#ifdef D_IMG_THREADED
+   if (Dicache_in_worker()) {
+      Dicache_job_set_cmap(bg_color, cmap, num_colors, num_colors_max,
+                           bg_index);
+      return;
+   }
+#endif
+   DicEntry = a_Dicache_get_entry(url, version);
    dReturn_if_fail ( DicEntry != NULL );
 
    dFree(DicEntry->cmap);
@@ -273,6 +915,8 @@ void a_Dicache_set_cmap(DilloUrl *url, int version, int bg_color,
       DicEntry->cmap[bg_index * 3 + 1] = (bg_color >> 8) & 0xff;
       DicEntry->cmap[bg_index * 3 + 2] = (bg_color) & 0xff;
    }
+   if (DicEntry->v_imgbuf)
+      a_Imgbuf_set_cmap(DicEntry->v_imgbuf, DicEntry->cmap, num_colors_max);
 
    DicEntry->State = DIC_SetCmap;
 }
@@ -286,6 +930,12 @@ void a_Dicache_new_scan(const DilloUrl *url, int version)
 
    _MSG("a_Dicache_new_scan\n");
    dReturn_if_fail ( url != NULL );
+#ifdef D_IMG_THREADED
+   if (Dicache_in_worker()) {
+      Dicache_job_event(Dicache_event_new(DIC_EvScan));
+      return;
+   }
+#endif
    DicEntry = a_Dicache_get_entry(url, version);
    dReturn_if_fail ( DicEntry != NULL );
    if (DicEntry->State < DIC_SetParms) {
@@ -308,13 +958,19 @@ void a_Dicache_write(DilloUrl *url, int version, const uchar_t *buf, uint_t Y)
    DICacheEntry *DicEntry;
 
    _MSG("a_Dicache_write\n");
+#ifdef D_IMG_THREADED
+   if (Dicache_in_worker()) {
+      Dicache_job_write(buf, Y);
+      return;
+   }
+#endif
    DicEntry = a_Dicache_get_entry(url, version);
    dReturn_if_fail ( DicEntry != NULL );
    dReturn_if_fail ( DicEntry->width > 0 && DicEntry->height > 0 );
 
    /* update the common buffer in the imgbuf */
    a_Imgbuf_update(DicEntry->v_imgbuf, buf, DicEntry->type,
-                   DicEntry->cmap, DicEntry->width, DicEntry->height, Y);
+                   DicEntry->width, DicEntry->height, Y);
 
    a_Bitvec_set_bit(DicEntry->BitVec, (int)Y);
    DicEntry->State = DIC_Write;
@@ -348,10 +1004,91 @@ void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client)
    a_Bw_close_client(Web->bw, Client->Key);
 }
 
+/*
+ * Should the decoder skip the intermediate passes of a progressive image?
+ * (decoders may call it from the worker thread)
+ */
+bool_t a_Dicache_skip_passes(const DilloUrl *url, int version)
+{
+   DICacheEntry *DicEntry;
+
+#ifdef D_IMG_THREADED
+   if (Dicache_in_worker())
+      return dicache_worker_skip_passes;
+#endif
+   DicEntry = a_Dicache_get_entry(url, version);
+   return DicEntry ? DicEntry->SkipPasses : FALSE;
+}
+
+/*
+ * Is the image still being decoded in the background?
+ * (the cache keeps the client open meanwhile)
+ */
+bool_t a_Dicache_decoding(const DilloUrl *url, int version)
+{
+#ifdef D_IMG_THREADED
+   DICacheEntry *DicEntry;
+   DicacheJob *job;
+   bool_t done;
+
+   if (version && (DicEntry = a_Dicache_get_entry(url, version)) &&
+       (job = DicEntry->DecoderJob)) {
+      pthread_mutex_lock(&dicache_mutex);
+      done = job->Done;
+      pthread_mutex_unlock(&dicache_mutex);
+      return !done;
+   }
+#endif
+   return FALSE;
+}
+
+/*
+ * The cache is freeing the data of this URL: stop decoding from it.
+ */
+void a_Dicache_release_data(const DilloUrl *url)
+{
+#ifdef D_IMG_THREADED
+   DICacheEntry *entry;
+   DicacheJob *job;
+   int i;
+
+   for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i)
+      if ((job = entry->DecoderJob) && job->CacheBuf &&
+          !a_Url_cmp(entry->url, url))
+         Dicache_job_cancel(entry);
+#endif
+}
+
+/*
+ * Tell whether the image data is completely in the cache.
+ * (decoders may call it from the worker thread)
+ */
+bool_t a_Dicache_data_complete(const DilloUrl *url)
+{
+#ifdef D_IMG_THREADED
+   if (Dicache_in_worker())
+      return dicache_worker_complete;
+#endif
+   return (a_Capi_get_flags(url) & CAPI_Completed) ? TRUE : FALSE;
+}
+
 /* ------------------------------------------------------------------------- */
 
 /*
- * Generic MIME handler for GIF, JPEG and PNG.
+ * Is the entry's image big enough for the size this Image is displayed at?
+ */
+static bool_t Dicache_size_fits(DICacheEntry *DicEntry, DilloImage *Image)
+{
+   return (!DicEntry->req_width ||
+           (Image->display_width &&
+            Image->display_width <= DicEntry->req_width)) &&
+          (!DicEntry->req_height ||
+           (Image->display_height &&
+            Image->display_height <= DicEntry->req_height));
+}
+
+/*
+ * Generic MIME handler for GIF, JPEG, PNG and WebP.
  * Sets a_Dicache_callback as the cache-client,
  * and also sets the image decoder.
  *
@@ -376,14 +1113,26 @@ static void *Dicache_image(int ImgType, const char *MimeType, void *Ptr,
    }
 
    DicEntry = a_Dicache_get_entry(web->url, DIC_Last);
+   if (DicEntry && !Dicache_size_fits(DicEntry, web->Image)) {
+      /* Decoded at a reduced size, but a larger one is wanted now */
+      _MSG("Dicache_image: new version for %ux%u\n",
+           web->Image->display_width, web->Image->display_height);
+      DicEntry = NULL;
+   }
    if (!DicEntry) {
+      /* Make room for the new image */
+      Dicache_enforce_budget();
       /* Create an entry for this image... */
       DicEntry = Dicache_add_entry(web->url);
       /* Attach a decoder */
       if (ImgType == DIC_Jpeg) {
+         /* libjpeg can decode at a fraction of the size */
+         DicEntry->req_width = web->Image->display_width;
+         DicEntry->req_height = web->Image->display_height;
          DicEntry->Decoder = (CA_Callback_t)a_Jpeg_callback;
          DicEntry->DecoderData =
-            a_Jpeg_new(web->Image, DicEntry->url, DicEntry->version);
+            a_Jpeg_new(web->Image, DicEntry->url, DicEntry->version,
+                       DicEntry->req_width, DicEntry->req_height);
       } else if (ImgType == DIC_Gif) {
          DicEntry->Decoder = (CA_Callback_t)a_Gif_callback;
          DicEntry->DecoderData =
@@ -392,6 +1141,10 @@ static void *Dicache_image(int ImgType, const char *MimeType, void *Ptr,
          DicEntry->Decoder = (CA_Callback_t)a_Png_callback;
          DicEntry->DecoderData =
             a_Png_new(web->Image, DicEntry->url, DicEntry->version);
+      } else if (ImgType == DIC_Webp) {
+         DicEntry->Decoder = (CA_Callback_t)a_Webp_callback;
+         DicEntry->DecoderData =
+            a_Webp_new(web->Image, DicEntry->url, DicEntry->version);
       }
    } else {
       /* Repeated image */
@@ -399,6 +1152,7 @@ static void *Dicache_image(int ImgType, const char *MimeType, void *Ptr,
    }
    /* Survive three cleanup passes (set to zero = old behaviour). */
    DicEntry->SurvCleanup = 3;
+   DicEntry->LastUse = ++dicache_use_stamp;
 
    *Data = DicEntry->DecoderData;
    *Call = (CA_Callback_t) a_Dicache_callback;
@@ -433,16 +1187,90 @@ void *a_Dicache_jpeg_image(const char *Type, void *Ptr, CA_Callback_t *Call,
    return Dicache_image(DIC_Jpeg, Type, Ptr, Call, Data);
 }
 
+/*
+ * WebP wrapper for Dicache_image()
+ */
+void *a_Dicache_webp_image(const char *Type, void *Ptr, CA_Callback_t *Call,
+                           void **Data)
+{
+   return Dicache_image(DIC_Webp, Type, Ptr, Call, Data);
+}
+
+/*
+ * Bring a client's Image up to date with the dicache entry.
+ */
+static void Dicache_image_update(DICacheEntry *DicEntry, DilloImage *Image)
+{
+   uint_t i;
+
+   /* when the data stream is not an image 'v_imgbuf' remains NULL */
+   if (!DicEntry->v_imgbuf)
+      return;
+
+   if (Image->height == 0 && DicEntry->State >= DIC_SetParms) {
+      /* Set parms */
+      a_Image_set_parms(
+         Image, DicEntry->v_imgbuf, DicEntry->url,
+         DicEntry->version, DicEntry->width, DicEntry->height,
+         DicEntry->type);
+   }
+   if (DicEntry->State == DIC_Write) {
+      if (DicEntry->ScanNumber == Image->ScanNumber) {
+         for (i = 0; i < DicEntry->height; ++i)
+            if (a_Bitvec_get_bit(DicEntry->BitVec, (int)i) &&
+                !a_Bitvec_get_bit(Image->BitVec, (int)i) )
+               a_Image_write(Image, i);
+      } else {
+         for (i = 0; i < DicEntry->height; ++i) {
+            if (a_Bitvec_get_bit(DicEntry->BitVec, (int)i) ||
+                !a_Bitvec_get_bit(Image->BitVec, (int)i)   ||
+                DicEntry->ScanNumber > Image->ScanNumber + 1) {
+               a_Image_write(Image, i);
+            }
+            if (!a_Bitvec_get_bit(DicEntry->BitVec, (int)i))
+               a_Bitvec_clear_bit(Image->BitVec, (int)i);
+         }
+         Image->ScanNumber = DicEntry->ScanNumber;
+      }
+   }
+}
+
+/*
+ * Is the whole image expected within prefs.progressive_image_budget?
+ * (at the speed the data has been coming in)
+ * If so, showing the intermediate passes of a progressive image would
+ * only cost redraws that are on screen for a moment.
+ */
+static bool_t Dicache_expect_complete(DICacheEntry *DicEntry)
+{
+   int received, expected;
+   double elapsed;
+
+   if (prefs.progressive_image_budget <= 0)
+      return FALSE;
+   if (a_Dicache_data_complete(DicEntry->url))
+      return TRUE;
+
+   a_Cache_get_transfer_size(DicEntry->url, &received, &expected);
+   elapsed = Dicache_now() - DicEntry->StartTime;
+   if (expected <= 0 || received <= 0 || elapsed <= 0)
+      return FALSE;
+   return (expected - received) * elapsed / received <
+          prefs.progressive_image_budget / 1000.0;
+}
+
 /*
  * This function is a cache client; (but feeds its clients from dicache)
  */
 void a_Dicache_callback(int Op, CacheClient_t *Client)
 {
-   uint_t i;
    DilloWeb *Web = Client->Web;
    DilloImage *Image = Web->Image;
-   DICacheEntry *DicEntry = a_Dicache_get_entry(Web->url, DIC_Last);
+   DICacheEntry *DicEntry;
 
+   /* A newer version may be decoding at another size; stick to ours */
+   DicEntry = a_Dicache_get_entry(Web->url, Client->Version ?
+                                  Client->Version : DIC_Last);
    dReturn_if_fail ( DicEntry != NULL );
 
    /* Copy the version number in the Client */
@@ -452,44 +1280,39 @@ void a_Dicache_callback(int Op, CacheClient_t *Client)
    /* Only call the decoder when necessary */
    if (Op == CA_Send && DicEntry->State < DIC_Close &&
        DicEntry->DecodedSize < Client->BufSize) {
-      DicEntry->Decoder(Op, Client);
+      DicEntry->SkipPasses = Dicache_expect_complete(DicEntry);
+#ifdef D_IMG_THREADED
+      if (dicache_threaded)
+         Dicache_job_feed(DicEntry, Client);
+      else
+#endif
+         DicEntry->Decoder(Op, Client);
       DicEntry->DecodedSize = Client->BufSize;
+#ifdef D_IMG_THREADED
+   } else if (Op == CA_Send && DicEntry->DecoderJob &&
+              !((DicacheJob *)DicEntry->DecoderJob)->Completed &&
+              a_Dicache_data_complete(DicEntry->url)) {
+      /* No new data, but now it's complete: let the worker finish */
+      Dicache_job_feed(DicEntry, Client);
+#endif
    } else if (Op == CA_Close || Op == CA_Abort) {
       if (DicEntry->State < DIC_Close) {
+#ifdef D_IMG_THREADED
+         if (DicEntry->DecoderJob && Op == CA_Close) {
+            Dicache_job_finish(DicEntry);
+            Dicache_image_update(DicEntry, Image);
+         } else if (DicEntry->DecoderJob) {
+            Dicache_job_cancel(DicEntry);
+         }
+#endif
          DicEntry->Decoder(Op, Client);
       } else {
          a_Dicache_close(DicEntry->url, DicEntry->version, Client);
       }
    }
 
-   /* when the data stream is not an image 'v_imgbuf' remains NULL */
-   if (Op == CA_Send && DicEntry->v_imgbuf) {
-      if (Image->height == 0 && DicEntry->State >= DIC_SetParms) {
-         /* Set parms */
-         a_Image_set_parms(
-            Image, DicEntry->v_imgbuf, DicEntry->url,
-            DicEntry->version, DicEntry->width, DicEntry->height,
-            DicEntry->type);
-      }
-      if (DicEntry->State == DIC_Write) {
-         if (DicEntry->ScanNumber == Image->ScanNumber) {
-            for (i = 0; i < DicEntry->height; ++i)
-               if (a_Bitvec_get_bit(DicEntry->BitVec, (int)i) &&
-                   !a_Bitvec_get_bit(Image->BitVec, (int)i) )
-                  a_Image_write(Image, i);
-         } else {
-            for (i = 0; i < DicEntry->height; ++i) {
-               if (a_Bitvec_get_bit(DicEntry->BitVec, (int)i) ||
-                   !a_Bitvec_get_bit(Image->BitVec, (int)i)   ||
-                   DicEntry->ScanNumber > Image->ScanNumber + 1) {
-                  a_Image_write(Image, i);
-               }
-               if (!a_Bitvec_get_bit(DicEntry->BitVec, (int)i))
-                  a_Bitvec_clear_bit(Image->BitVec, (int)i);
-            }
-            Image->ScanNumber = DicEntry->ScanNumber;
-         }
-      }
+   if (Op == CA_Send) {
+      Dicache_image_update(DicEntry, Image);
    } else if (Op == CA_Close) {
       a_Image_close(Image);
       a_Bw_close_client(Web->bw, Client->Key);
@@ -503,16 +1326,32 @@ void a_Dicache_callback(int Op, CacheClient_t *Client)
 
 /*
  * Free the imgbuf (RGB data) of unused entries.
+ * With a memory budget, unused images stay until it runs out.
  */
 void a_Dicache_cleanup(void)
 {
+   static DicacheStats last;
+   DicacheStats stats;
    int i;
    DICacheEntry *entry;
 
+   Dicache_enforce_budget();
+
+   /* Report the budget's work, when there's some news */
+   a_Dicache_get_stats(&stats);
+   if (stats.Evicted != last.Evicted || stats.Redecoded != last.Redecoded) {
+      MSG("Dicache: %lu KB resident, %lu KB evicted, %lu KB re-decoded\n",
+          (ulong_t)stats.Resident / 1024, (ulong_t)stats.Evicted / 1024,
+          (ulong_t)stats.Redecoded / 1024);
+      last = stats;
+   }
+
    for (i = 0; (entry = dList_nth_data(CachedIMGs, i)); ++i) {
       _MSG(" SurvCleanup = %d\n", entry->SurvCleanup);
       if (entry->RefCount == 0 &&
           (!entry->v_imgbuf || a_Imgbuf_last_reference(entry->v_imgbuf))) {
+         if (entry->TotalSize > 0 && prefs.image_memory_budget > 0)
+            continue;  /* left to the budget */
          if (--entry->SurvCleanup >= 0)
             continue;  /* keep the entry one more pass */
 
@@ -533,10 +1372,15 @@ void a_Dicache_cleanup(void)
 void a_Dicache_freeall(void)
 {
    DICacheEntry *entry;
+   DilloUrl *url;
 
    /* Remove all the dicache entries */
    while ((entry = dList_nth_data(CachedIMGs, dList_length(CachedIMGs)-1))) {
       dList_remove_fast(CachedIMGs, entry);
+#ifdef D_IMG_THREADED
+      if (entry->DecoderJob)
+         Dicache_job_cancel(entry);
+#endif
       a_Url_free(entry->url);
       dFree(entry->cmap);
       a_Bitvec_free(entry->BitVec);
@@ -545,4 +1389,18 @@ void a_Dicache_freeall(void)
       dFree(entry);
    }
    dList_free(CachedIMGs);
+
+   while ((url = dList_nth_data(EvictedURLs, 0))) {
+      dList_remove_fast(EvictedURLs, url);
+      a_Url_free(url);
+   }
+   dList_free(EvictedURLs);
+
+#ifdef D_IMG_THREADED
+   if (dicache_threaded) {
+      a_IOwatch_remove_fd(dicache_notify_pipe[0], DIO_READ);
+      dClose(dicache_notify_pipe[0]);
+      dClose(dicache_notify_pipe[1]);
+   }
+#endif
 }
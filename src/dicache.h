@@ -31,6 +31,8 @@ typedef struct DICacheEntry {
    DilloUrl *url;          /* Image URL for this entry */
    DilloImgType type;      /* Image type */
    uint_t width, height;   /* As taken from image data */
+   uint_t req_width;       /* Display size the decoder may reduce */
+   uint_t req_height;      /*  the image to (zero: don't reduce) */
    short Flags;            /* See Flags */
    short SurvCleanup;      /* Cleanup-pass survival for unused images */
    uchar_t *cmap;          /* Color map */
@@ -40,14 +42,25 @@ typedef struct DICacheEntry {
    bitvec_t *BitVec;       /* Bit vector for decoded rows */
    DicEntryState State;    /* Current status for this entry */
    int RefCount;           /* Reference Counter */
+   ulong_t LastUse;        /* Last request (for LRU eviction) */
    int version;            /* Version number, used for different
                               versions of the same URL image */
 
    uint_t DecodedSize;     /* Size of already decoded data */
+   double StartTime;       /* When the first data arrived (seconds) */
+   bool_t SkipPasses;      /* The whole image is expected soon */
    CA_Callback_t Decoder;  /* Client function */
    void *DecoderData;      /* Client function data */
+   void *DecoderJob;       /* Background decoding job (or NULL) */
 } DICacheEntry;
 
+/* Decoded image memory accounting */
+typedef struct {
+   size_t Resident;        /* Bytes held now, scaled copies included */
+   size_t Evicted;         /* Bytes freed to stay within the budget */
+   size_t Redecoded;       /* Bytes decoded again after being freed */
+} DicacheStats;
+
 
 void a_Dicache_init (void);
 
@@ -59,6 +72,8 @@ void *a_Dicache_gif_image(const char *Type, void *Ptr, CA_Callback_t *Call,
                           void **Data);
 void *a_Dicache_jpeg_image(const char *Type, void *Ptr, CA_Callback_t *Call,
                            void **Data);
+void *a_Dicache_webp_image(const char *Type, void *Ptr, CA_Callback_t *Call,
+                           void **Data);
 void a_Dicache_callback(int Op, CacheClient_t *Client);
 
 void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
@@ -70,11 +85,16 @@ void a_Dicache_set_cmap(DilloUrl *url, int version, int bg_color,
 void a_Dicache_new_scan(const DilloUrl *url, int version);
 void a_Dicache_write(DilloUrl *url, int version, const uchar_t *buf, uint_t Y);
 void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client);
+bool_t a_Dicache_data_complete(const DilloUrl *url);
+bool_t a_Dicache_skip_passes(const DilloUrl *url, int version);
+bool_t a_Dicache_decoding(const DilloUrl *url, int version);
+void a_Dicache_release_data(const DilloUrl *url);
 
 void a_Dicache_invalidate_entry(const DilloUrl *Url);
 DICacheEntry* a_Dicache_ref(const DilloUrl *Url, int version);
 void a_Dicache_unref(const DilloUrl *Url, int version);
 void a_Dicache_cleanup(void);
+void a_Dicache_get_stats(DicacheStats *stats);
 void a_Dicache_freeall(void);
 
 
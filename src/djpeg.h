@@ -9,7 +9,8 @@ extern "C" {
 #include "image.hh"
 
 
-void *a_Jpeg_new(DilloImage *Image, DilloUrl *url, int version);
+void *a_Jpeg_new(DilloImage *Image, DilloUrl *url, int version,
+                 uint_t req_width, uint_t req_height);
 void a_Jpeg_callback(int Op, void *data);
 
 
@@ -2,7 +2,28 @@
 #define __DOCTREE_HH__
 
 #include "lout/misc.hh"
+#include "atom.h"
 
+/**
+ * \brief The class names of an element, as atoms.
+ */
+class DoctreeClasses {
+   public:
+      int num;
+      const char **names;
+
+      inline int size () const { return num; };
+      inline const char *get (int i) const { return names[i]; };
+};
+
+/**
+ * \brief A node of the document tree.
+ *
+ * Nodes and their class lists are allocated in the zone of their
+ * Doctree, and freed all at once with it. Ids and class names are atoms
+ * (see atom.h), so that CSS matching compares them as pointers; the
+ * Doctree holds a reference to each.
+ */
 class DoctreeNode {
    public:
       DoctreeNode *parent;
@@ -10,33 +31,9 @@ class DoctreeNode {
       DoctreeNode *lastChild;
       int num; // unique ascending id
       int element;
-      lout::misc::SimpleVector<char*> *klass;
+      DoctreeClasses *klass;
       const char *pseudo;
-      const char *id;
-
-      DoctreeNode () {
-         parent = NULL;
-         sibling = NULL;
-         lastChild = NULL;
-         klass = NULL;
-         pseudo = NULL;
-         id = NULL;
-         element = 0;
-      };
-
-      ~DoctreeNode () {
-         dFree ((void*) id);
-         while (lastChild) {
-            DoctreeNode *n = lastChild;
-            lastChild = lastChild->sibling;
-            delete n;
-         }
-         if (klass) {
-            for (int i = 0; i < klass->size (); i++)
-               dFree (klass->get(i));
-            delete klass;
-         }
-      }
+      const char *id; // an atom
 };
 
 /**
@@ -47,23 +44,57 @@ class DoctreeNode {
  */
 class Doctree {
    private:
+      lout::misc::ZoneAllocator zone;
       DoctreeNode *topNode;
       DoctreeNode *rootNode;
       int num;
+      bool quirks;
+
+      DoctreeNode *newNode () {
+         DoctreeNode *dn =
+            (DoctreeNode *) zone.zoneAllocAligned (sizeof (DoctreeNode));
+
+         dn->parent = NULL;
+         dn->sibling = NULL;
+         dn->lastChild = NULL;
+         dn->num = 0;
+         dn->element = 0;
+         dn->klass = NULL;
+         dn->pseudo = NULL;
+         dn->id = NULL;
+         return dn;
+      };
 
    public:
-      Doctree () {
-         rootNode = new DoctreeNode;
+      Doctree () : zone (16 * 1024) {
+         rootNode = newNode ();
          topNode = rootNode;
          num = 0;
+         quirks = false;
       };
 
       ~Doctree () {
-         delete rootNode;
+         DoctreeNode *dn = rootNode;
+
+         /* Release the atoms of every node, taking the children off their
+          * parent as we go down */
+         while (dn) {
+            if (dn->lastChild) {
+               DoctreeNode *child = dn->lastChild;
+               dn->lastChild = child->sibling;
+               dn = child;
+            } else {
+               if (dn->klass)
+                  for (int i = 0; i < dn->klass->size (); i++)
+                     a_Atom_unref (dn->klass->get (i));
+               a_Atom_unref (dn->id);
+               dn = dn->parent;
+            }
+         }
       };
 
       DoctreeNode *push () {
-         DoctreeNode *dn = new DoctreeNode ();
+         DoctreeNode *dn = newNode ();
          dn->parent = topNode;
          dn->sibling = dn->parent->lastChild;
          dn->parent->lastChild = dn;
@@ -72,6 +103,11 @@ class Doctree {
          return dn;
       };
 
+      /* Memory that lives as long as the tree, for its nodes' data */
+      inline void *alloc (size_t size) {
+         return zone.zoneAllocAligned (size);
+      };
+
       void pop () {
          assert (topNode != rootNode); // never pop the root node
          topNode = topNode->parent;
@@ -94,6 +130,10 @@ class Doctree {
       inline DoctreeNode *sibling (const DoctreeNode *node) {
          return node->sibling;
       };
+
+      /* In quirks mode, ids and class names match case-insensitively */
+      inline void setQuirksMode (bool quirks) { this->quirks = quirks; };
+      inline bool quirksMode () const { return quirks; };
 };
 
 #endif
@@ -11,20 +11,110 @@
 
 #include "../dlib/dlib.h"
 #include "msg.h"
-#include "list.h"
+#include "domtrie.h"
 #include "domain.h"
 
+/*
+ * The destinations allowed for a set of origins.
+ * Destination patterns are kept in a trie, with DOMAIN_* flags as data.
+ */
 typedef struct {
-   char *origin;
-   char *destination;
-} Rule;
+   bool_t any;            /* "*" destination */
+   Domtrie *dests;
+} DestSet;
+
+#define DOMAIN_EXACT       1   /* "example.org" */
+#define DOMAIN_SUBDOMAINS  2   /* ".example.org" */
 
-static Rule *exceptions = NULL;
+/*
+ * The exceptions, compiled by origin pattern.
+ * Each origin trie node holds a DestSet pair: [0] for "example.org",
+ * [1] for ".example.org".
+ */
+static DestSet any_origin;
+static Domtrie *origins = NULL;
 static int num_exceptions = 0;
-static int num_exceptions_max = 1;
 
 static bool_t default_deny = FALSE;
 
+/*
+ * Add a destination pattern to a set.
+ */
+static void Domain_dest_add(DestSet *set, const char *pattern)
+{
+   int flag = DOMAIN_EXACT;
+   void **slot;
+
+   if (!strcmp(pattern, "*")) {
+      set->any = TRUE;
+      return;
+   }
+   if (pattern[0] == '.') {
+      flag = DOMAIN_SUBDOMAINS;
+      pattern++;
+   }
+   if (!set->dests)
+      set->dests = a_Domtrie_new();
+   slot = a_Domtrie_slot(set->dests, pattern);
+   *slot = INT2VOIDP(VOIDP2INT(*slot) | flag);
+}
+
+/*
+ * Add an exception from 'origin' to 'destination'.
+ */
+static void Domain_add_exception(const char *origin, const char *destination)
+{
+   DestSet *set;
+
+   if (!strcmp(origin, "*")) {
+      set = &any_origin;
+   } else {
+      int sub = (origin[0] == '.');
+      void **slot;
+
+      if (!origin[sub])
+         return;
+      if (!origins)
+         origins = a_Domtrie_new();
+      slot = a_Domtrie_slot(origins, origin + sub);
+      if (!*slot)
+         *slot = dNew0(DestSet, 2);
+      set = (DestSet *)*slot + sub;
+   }
+   Domain_dest_add(set, destination);
+   num_exceptions++;
+}
+
+static void Domain_destset_free(void *data)
+{
+   DestSet *set = data;
+
+   a_Domtrie_free(set[0].dests, NULL);
+   a_Domtrie_free(set[1].dests, NULL);
+   dFree(set);
+}
+
+/*
+ * Is 'host' within the destinations of 'set'?
+ */
+static bool_t Domain_dest_match(const DestSet *set, const char *host)
+{
+   DomtrieMatch m[DOMTRIE_MAX_LABELS];
+   int i, n;
+
+   if (set->any)
+      return TRUE;
+   if (!set->dests)
+      return FALSE;
+   n = a_Domtrie_match(set->dests, host, m, DOMTRIE_MAX_LABELS);
+   for (i = 0; i < n; i++) {
+      /* ".example.org" also matches "example.org" itself */
+      if (m[i].Exact || (VOIDP2INT(m[i].Data) & DOMAIN_SUBDOMAINS))
+         return TRUE;
+   }
+   return FALSE;
+}
+
 /*
  * Parse domainrc.
  */
@@ -64,10 +154,7 @@ void a_Domain_parse(FILE *fp)
                   MSG("Domain: Default action \"%s\" not recognised.\n", tok2);
                }
             } else {
-               a_List_add(exceptions, num_exceptions, num_exceptions_max);
-               exceptions[num_exceptions].origin = dStrdup(tok1);
-               exceptions[num_exceptions].destination = dStrdup(tok2);
-               num_exceptions++;
+               Domain_add_exception(tok1, tok2);
                _MSG("Domain: Exception from %s to %s.\n", tok1, tok2);
             }
          }
@@ -78,36 +165,8 @@ void a_Domain_parse(FILE *fp)
 
 void a_Domain_freeall(void)
 {
-   int i = 0;
-
-   for (i = 0; i < num_exceptions; i++) {
-      dFree(exceptions[i].origin);
-      dFree(exceptions[i].destination);
-   }
-   dFree(exceptions);
-}
-
-/*
- * Wildcard ('*') pattern always matches.
- * "example.org" pattern matches "example.org".
- * ".example.org" pattern matches "example.org" and "sub.example.org".
- */
-static bool_t Domain_match(const char *host, const char *pattern) {
-   int cmp = strcmp(pattern, "*");
-
-   if (cmp) {
-      if (pattern[0] != '.')
-         cmp = dStrAsciiCasecmp(host, pattern);
-      else {
-         int diff = strlen(host) - strlen(pattern);
-
-         if (diff == -1)
-            cmp = dStrAsciiCasecmp(host, pattern + 1);
-         else if (diff >= 0)
-            cmp = dStrAsciiCasecmp(host + diff, pattern);
-      }
-   }
-   return cmp ? FALSE : TRUE;
+   a_Domtrie_free(any_origin.dests, NULL);
+   a_Domtrie_free(origins, Domain_destset_free);
 }
 
 /*
@@ -115,8 +174,9 @@ static bool_t Domain_match(const char *host, const char *pattern) {
  */
 bool_t a_Domain_permit(const DilloUrl *source, const DilloUrl *dest)
 {
-   int i;
-   bool_t ret;
+   DomtrieMatch m[DOMTRIE_MAX_LABELS];
+   int i, n;
+   bool_t ret, matched;
    const char *source_host, *dest_host;
 
    if (default_deny == FALSE && num_exceptions == 0)
@@ -138,14 +198,19 @@ bool_t a_Domain_permit(const DilloUrl *source, const DilloUrl *dest)
 
    ret = default_deny ? FALSE : TRUE;
 
-   for (i = 0; i < num_exceptions; i++) {
-      if (Domain_match(source_host, exceptions[i].origin) &&
-          Domain_match(dest_host, exceptions[i].destination)) {
-         ret = default_deny;
-         _MSG("Domain: Matched rule from %s to %s.\n", exceptions[i].origin,
-              exceptions[i].destination);
-         break;
-      }
+   /* Walk the origins that match the source, then their destinations */
+   matched = Domain_dest_match(&any_origin, dest_host);
+   n = (matched || !origins) ? 0 :
+       a_Domtrie_match(origins, source_host, m, DOMTRIE_MAX_LABELS);
+   for (i = 0; i < n && !matched; i++) {
+      DestSet *set = m[i].Data;
+
+      matched = Domain_dest_match(&set[1], dest_host) ||
+                (m[i].Exact && Domain_dest_match(&set[0], dest_host));
+   }
+   if (matched) {
+      ret = default_deny;
+      _MSG("Domain: Matched rule for %s -> %s.\n", source_host, dest_host);
    }
 
    if (ret == FALSE) {
@@ -0,0 +1,210 @@
+/*
+ * File: domtrie.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * A trie of domain names, keyed by labels from right to left
+ * ("www.example.org" is stored as org -> example -> www).
+ *
+ * It's meant for rule sets that are compiled once (domainrc, cookiesrc,
+ * HSTS) and then checked on every request: a lookup is a single walk over
+ * the labels of the host, whatever the number of rules.
+ *
+ * Edges live in one hash table keyed by (parent node, label), so nodes
+ * with many children (e.g. "com") don't need any per-node index.
+ * Labels are compared ASCII case-insensitively.
+ */
+
+#include "domtrie.h"
+
+
+typedef struct DomtrieNode {
+   struct DomtrieNode *parent;
+   struct DomtrieNode *next;  /* hash chain */
+   uint_t hash;
+   char *label;               /* lowercase */
+   void *data;
+} DomtrieNode;
+
+struct Domtrie {
+   DomtrieNode root;
+   DomtrieNode **buckets;
+   uint_t num_buckets;        /* power of two */
+   uint_t num_nodes;
+};
+
+
+/*
+ * Hash a label (ASCII case-folded) under its parent node.
+ */
+static uint_t Domtrie_hash(const DomtrieNode *parent, const char *s, int len)
+{
+   uint_t h = 2166136261u ^ (uint_t)((size_t)parent >> 4);
+   int i;
+
+   for (i = 0; i < len; i++) {
+      h ^= (uchar_t)D_ASCII_TOLOWER(s[i]);
+      h *= 16777619u;
+   }
+   return h;
+}
+
+/*
+ * Find the child of 'parent' labeled s[0..len-1] (NULL if not present).
+ */
+static DomtrieNode *Domtrie_child(Domtrie *t, const DomtrieNode *parent,
+                                  const char *s, int len)
+{
+   uint_t h = Domtrie_hash(parent, s, len);
+   DomtrieNode *n;
+
+   for (n = t->buckets[h & (t->num_buckets - 1)]; n; n = n->next) {
+      if (n->hash == h && n->parent == parent &&
+          !dStrnAsciiCasecmp(n->label, s, len) && n->label[len] == '\0')
+         return n;
+   }
+   return NULL;
+}
+
+/*
+ * Double the hash table.
+ */
+static void Domtrie_grow(Domtrie *t)
+{
+   uint_t i, num = t->num_buckets * 2;
+   DomtrieNode **buckets = dNew0(DomtrieNode *, num);
+
+   for (i = 0; i < t->num_buckets; i++) {
+      DomtrieNode *n, *next;
+
+      for (n = t->buckets[i]; n; n = next) {
+         next = n->next;
+         n->next = buckets[n->hash & (num - 1)];
+         buckets[n->hash & (num - 1)] = n;
+      }
+   }
+   dFree(t->buckets);
+   t->buckets = buckets;
+   t->num_buckets = num;
+}
+
+/*
+ * Return a new, empty trie.
+ */
+Domtrie *a_Domtrie_new(void)
+{
+   Domtrie *t = dNew0(Domtrie, 1);
+
+   t->num_buckets = 64;
+   t->buckets = dNew0(DomtrieNode *, t->num_buckets);
+   return t;
+}
+
+/*
+ * Free a trie, calling 'free_data' on every non-NULL data reference.
+ */
+void a_Domtrie_free(Domtrie *t, void (*free_data)(void *))
+{
+   uint_t i;
+
+   if (!t)
+      return;
+   for (i = 0; i < t->num_buckets; i++) {
+      DomtrieNode *n, *next;
+
+      for (n = t->buckets[i]; n; n = next) {
+         next = n->next;
+         if (n->data && free_data)
+            free_data(n->data);
+         dFree(n->label);
+         dFree(n);
+      }
+   }
+   dFree(t->buckets);
+   dFree(t);
+}
+
+/*
+ * Return the data slot for 'domain', creating the nodes as needed.
+ * The slot holds NULL for new nodes.
+ */
+void **a_Domtrie_slot(Domtrie *t, const char *domain)
+{
+   DomtrieNode *n, *node = &t->root;
+   const char *end = domain + strlen(domain), *p;
+
+   while (end > domain) {
+      for (p = end; p > domain && p[-1] != '.'; p--) ;
+      if (!(n = Domtrie_child(t, node, p, end - p))) {
+         int i, len = end - p;
+
+         if (t->num_nodes >= t->num_buckets)
+            Domtrie_grow(t);
+         n = dNew0(DomtrieNode, 1);
+         n->parent = node;
+         n->hash = Domtrie_hash(node, p, len);
+         n->label = dStrndup(p, len);
+         for (i = 0; i < len; i++)
+            n->label[i] = D_ASCII_TOLOWER(n->label[i]);
+         n->next = t->buckets[n->hash & (t->num_buckets - 1)];
+         t->buckets[n->hash & (t->num_buckets - 1)] = n;
+         t->num_nodes++;
+      }
+      node = n;
+      end = (p > domain) ? p - 1 : domain;
+   }
+   return &node->data;
+}
+
+/*
+ * Return the data for exactly 'domain' (NULL if not present).
+ */
+void *a_Domtrie_get(Domtrie *t, const char *domain)
+{
+   DomtrieMatch m[DOMTRIE_MAX_LABELS];
+   int n = t ? a_Domtrie_match(t, domain, m, DOMTRIE_MAX_LABELS) : 0;
+
+   return (n > 0 && m[0].Exact) ? m[0].Data : NULL;
+}
+
+/*
+ * Walk 'host' down the trie, collecting the data of every node on the way:
+ * the host itself and each of its parent domains present in the trie.
+ * Matches are stored deepest (most specific) first.
+ * Return value: the number of matches.
+ */
+int a_Domtrie_match(Domtrie *t, const char *host, DomtrieMatch *matches,
+                    int max)
+{
+   DomtrieNode *node = &t->root;
+   const char *end = host + strlen(host), *p;
+   int i, num = 0;
+
+   if (end == host)
+      return 0;
+   while (node) {
+      for (p = end; p > host && p[-1] != '.'; p--) ;
+      if ((node = Domtrie_child(t, node, p, end - p))) {
+         if (node->data && num < max) {
+            matches[num].Data = node->data;
+            matches[num].Exact = (p == host);
+            num++;
+         }
+         if (p == host)
+            break;
+         end = p - 1;
+      }
+   }
+   /* reverse, so the most specific match comes first */
+   for (i = 0; i < num / 2; i++) {
+      DomtrieMatch m = matches[i];
+      matches[i] = matches[num - 1 - i];
+      matches[num - 1 - i] = m;
+   }
+   return num;
+}
@@ -0,0 +1,39 @@
+#ifndef __DOMTRIE_H__
+#define __DOMTRIE_H__
+
+#include "../dlib/dlib.h"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Maximum number of labels in a host name (RFC 1035 limits it to 127)
+ */
+#define DOMTRIE_MAX_LABELS 128
+
+typedef struct Domtrie Domtrie;
+
+typedef struct {
+   void *Data;     /* data reference */
+   bool_t Exact;   /* TRUE if the node is the whole host, not a parent */
+} DomtrieMatch;
+
+
+/*
+ * Function prototypes
+ */
+Domtrie*  a_Domtrie_new(void);
+void      a_Domtrie_free(Domtrie *t, void (*free_data)(void *));
+void**    a_Domtrie_slot(Domtrie *t, const char *domain);
+void*     a_Domtrie_get(Domtrie *t, const char *domain);
+int       a_Domtrie_match(Domtrie *t, const char *host,
+                          DomtrieMatch *matches, int max);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif /* __DOMTRIE_H__ */
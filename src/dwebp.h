@@ -0,0 +1,19 @@
+#ifndef __WEBP_H__
+#define __WEBP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "url.h"
+#include "image.hh"
+
+
+void *a_Webp_new(DilloImage *Image, DilloUrl *url, int version);
+void a_Webp_callback(int Op, CacheClient_t *Client);
+
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+#endif /* !__WEBP_H__ */
@@ -13,6 +13,9 @@
 #include "html_common.hh"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include <iconv.h>
 
 #include "lout/misc.hh"
@@ -79,7 +82,7 @@ class DilloHtmlForm {
    bool enabled;
    void eventHandler(Resource *resource, EventButton *event);
    DilloUrl *buildQueryUrl(DilloHtmlInput *active_input);
-   Dstr *buildQueryData(DilloHtmlInput *active_submit);
+   Dstr *buildQueryData(DilloHtmlInput *active_submit, Dlist **files);
    char *makeMultipartBoundary(iconv_t char_encoder,
                                DilloHtmlInput *active_submit);
    Dstr *encodeText(iconv_t char_encoder, Dstr **input);
@@ -88,8 +91,8 @@ class DilloHtmlForm {
    void inputMultipartAppend(Dstr *data, const char *boundary,
                              const char *name, const char *value);
    void filesInputMultipartAppend(Dstr* data, const char *boundary,
-                                  const char *name, Dstr *file,
-                                  const char *filename);
+                                  const char *name, const char *path,
+                                  const char *filename, Dlist *files);
    void imageInputUrlencodeAppend(Dstr *data, Dstr *name, Dstr *x, Dstr *y);
    void imageInputMultipartAppend(Dstr *data, const char *boundary, Dstr *name,
                                   Dstr *x, Dstr *y);
@@ -149,7 +152,7 @@ public:  //BUG: for now everything is public
                          entries, it is the initial value */
    DilloHtmlSelect *select;
    bool init_val;     /* only meaningful for buttons */
-   Dstr *file_data;   /* only meaningful for file inputs.
+   char *file_path;   /* only meaningful for file inputs.
                          TODO: may become a list... */
 
 private:
@@ -1076,6 +1079,7 @@ DilloUrl *DilloHtmlForm::buildQueryUrl(DilloHtmlInput *active_input)
    if ((method == DILLO_HTML_METHOD_GET) ||
        (method == DILLO_HTML_METHOD_POST)) {
       Dstr *DataStr;
+      Dlist *files = NULL;
       DilloHtmlInput *active_submit = NULL;
 
       _MSG("DilloHtmlForm::buildQueryUrl: action=%s\n",URL_STR_(action));
@@ -1088,7 +1092,7 @@ DilloUrl *DilloHtmlForm::buildQueryUrl(DilloHtmlInput *active_input)
          }
       }
 
-      DataStr = buildQueryData(active_submit);
+      DataStr = buildQueryData(active_submit, &files);
       if (DataStr) {
          /* action was previously resolved against base URL */
          char *action_str = dStrdup(URL_STR(action));
@@ -1097,6 +1101,8 @@ DilloUrl *DilloHtmlForm::buildQueryUrl(DilloHtmlInput *active_input)
             new_url = a_Url_new(action_str, NULL);
             /* new_url keeps the dStr and sets DataStr to NULL */
             a_Url_set_data(new_url, &DataStr);
+            if (files)
+               a_Url_set_data_files(new_url, &files);
             a_Url_set_flags(new_url, URL_FLAGS(new_url) | URL_Post);
             if (content_type == DILLO_HTML_ENC_MULTIPART)
                a_Url_set_flags(new_url, URL_FLAGS(new_url) | URL_MultipartEnc);
@@ -1125,8 +1131,10 @@ DilloUrl *DilloHtmlForm::buildQueryUrl(DilloHtmlInput *active_input)
 
 /*
  * Construct the data for a query URL
+ * (multipart file contents are left out; they're returned in 'files')
  */
-Dstr *DilloHtmlForm::buildQueryData(DilloHtmlInput *active_submit)
+Dstr *DilloHtmlForm::buildQueryData(DilloHtmlInput *active_submit,
+                                    Dlist **files)
 {
    Dstr *DataStr = NULL;
    char *boundary = NULL;
@@ -1176,24 +1184,27 @@ Dstr *DilloHtmlForm::buildQueryData(DilloHtmlInput *active_submit)
             if (input->type == DILLO_HTML_INPUT_FILE) {
                if (valcount > 1)
                   MSG_WARN("multiple files per form control not supported\n");
-               Dstr *file = (Dstr *) dList_nth_data(values, 0);
-               dList_remove(values, file);
+               Dstr *path = (Dstr *) dList_nth_data(values, 0);
+               dList_remove(values, path);
 
                /* Get filename and encode it. Do not encode file contents. */
                LabelButtonResource *lbr =
                             (LabelButtonResource*) input->embed->getResource();
                const char *filename = lbr->getLabel();
-               if (filename[0] && strcmp(filename, input->init_str)) {
+               if (boundary && filename[0] &&
+                   strcmp(filename, input->init_str)) {
                   const char *p = strrchr(filename, '/');
                   if (p)
                      filename = p + 1;     /* don't reveal path */
                   Dstr *dfilename = dStr_new(filename);
                   dfilename = encodeText(char_encoder, &dfilename);
+                  if (!*files)
+                     *files = dList_new(2);
                   filesInputMultipartAppend(DataStr, boundary, name->str,
-                                            file, dfilename->str);
+                                            path->str, dfilename->str, *files);
                   dStr_free(dfilename, 1);
                }
-               dStr_free(file, 1);
+               dStr_free(path, 1);
             } else if (input->type == DILLO_HTML_INPUT_INDEX) {
                /* no name */
                Dstr *val = (Dstr *) dList_nth_data(values, 0);
@@ -1245,6 +1256,59 @@ Dstr *DilloHtmlForm::buildQueryData(DilloHtmlInput *active_submit)
    return DataStr;
 }
 
+/*
+ * Scan a file for 'str' in chunks, without loading it whole.
+ */
+static bool Form_file_contains(const char *path, Dstr *str)
+{
+   char buf[16384];
+   bool found = false;
+   Dstr *chunk;
+   ssize_t n;
+   int fd;
+
+   if (str->len == 0 || (fd = open(path, O_RDONLY)) < 0)
+      return false;
+   chunk = dStr_sized_new(sizeof(buf) + str->len);
+   while (!found) {
+      do
+         n = read(fd, buf, sizeof(buf));
+      while (n < 0 && errno == EINTR);
+      if (n <= 0)
+         break;
+      dStr_append_l(chunk, buf, n);
+      found = dStr_memmem(chunk, str) != NULL;
+      /* keep a tail so matches across chunk boundaries are seen */
+      if (chunk->len >= str->len)
+         dStr_erase(chunk, 0, chunk->len - (str->len - 1));
+   }
+   dClose(fd);
+   dStr_free(chunk, 1);
+   return found;
+}
+
+/*
+ * Read the first bytes of a file (for content-type sniffing).
+ */
+static Dstr *Form_file_head(const char *path, int max)
+{
+   Dstr *head = dStr_sized_new(max);
+   int fd = open(path, O_RDONLY);
+   ssize_t n;
+
+   if (fd >= 0) {
+      do
+         n = read(fd, head->str, max);
+      while (n < 0 && errno == EINTR);
+      if (n > 0) {
+         head->len = n;
+         head->str[n] = 0;
+      }
+      dClose(fd);
+   }
+   return head;
+}
+
 /*
  * Generate a boundary string for use in separating the parts of a
  * multipart/form-data submission.
@@ -1253,7 +1317,7 @@ char *DilloHtmlForm::makeMultipartBoundary(iconv_t char_encoder,
                                            DilloHtmlInput *active_submit)
 {
    const int max_tries = 10;
-   Dlist *values = dList_new(5);
+   Dlist *values = dList_new(5), *paths = dList_new(2);
    Dstr *DataStr = dStr_new("");
    Dstr *boundary = dStr_new("");
    char *ret = NULL;
@@ -1286,8 +1350,12 @@ char *DilloHtmlForm::makeMultipartBoundary(iconv_t char_encoder,
       for (int i = 0; i < length; i++) {
          dstr = (Dstr *) dList_nth_data(values, 0);
          dList_remove(values, dstr);
-         if (input->type != DILLO_HTML_INPUT_FILE)
-            dstr = encodeText(char_encoder, &dstr);
+         if (input->type == DILLO_HTML_INPUT_FILE) {
+            /* file contents are scanned from disk below */
+            dList_append(paths, dstr);
+            continue;
+         }
+         dstr = encodeText(char_encoder, &dstr);
          dStr_append_l(DataStr, dstr->str, dstr->len);
          dStr_free(dstr, 1);
       }
@@ -1299,9 +1367,20 @@ char *DilloHtmlForm::makeMultipartBoundary(iconv_t char_encoder,
       dStr_sprintf(boundary, "---------------------------%d%d%d",
                    rand(), rand(), rand());
       dStr_truncate(boundary, 70);
-      if (dStr_memmem(DataStr, boundary) == NULL)
+      if (dStr_memmem(DataStr, boundary) == NULL) {
          ret = boundary->str;
+         for (int j = 0; ret && j < dList_length(paths); j++) {
+            Dstr *path = (Dstr *) dList_nth_data(paths, j);
+            if (Form_file_contains(path->str, boundary))
+               ret = NULL;
+         }
+      }
+   }
+   for (Dstr *path; (path = (Dstr *) dList_nth_data(paths, 0)); ) {
+      dList_remove(paths, path);
+      dStr_free(path, 1);
    }
+   dList_free(paths);
    dList_free(values);
    dStr_free(DataStr, 1);
    dStr_free(boundary, (ret == NULL));
@@ -1404,17 +1483,23 @@ void DilloHtmlForm::inputUrlencodeAppend(Dstr *data, const char *name,
 /*
  * Append files to URL data using multipart encoding.
  * Currently only accepts one file.
+ * The file contents aren't copied: a DilloUrlDataFile is added to 'files'
+ * so they can be streamed from disk when the request is sent.
  */
 void DilloHtmlForm::filesInputMultipartAppend(Dstr* data,
                                               const char *boundary,
                                               const char *name,
-                                              Dstr *file,
-                                              const char *filename)
+                                              const char *path,
+                                              const char *filename,
+                                              Dlist *files)
 {
    const char *ctype, *ext;
+   struct stat sb;
 
    if (name && name[0]) {
-      (void)a_Misc_get_content_type_from_data(file->str, file->len, &ctype);
+      Dstr *head = Form_file_head(path, 1024);
+      (void)a_Misc_get_content_type_from_data(head->str, head->len, &ctype);
+      dStr_free(head, 1);
       /* Heuristic: text/plain with ".htm[l]" extension -> text/html */
       if ((ext = strrchr(filename, '.')) &&
           !dStrAsciiCasecmp(ctype, "text/plain") &&
@@ -1446,7 +1531,15 @@ void DilloHtmlForm::filesInputMultipartAppend(Dstr* data,
                     "Content-Type: %s\r\n"
                     "\r\n", ctype);
 
-      dStr_append_l(data, file->str, file->len);
+      if (stat(path, &sb) == 0 && sb.st_size > 0) {
+         DilloUrlDataFile *file = dNew(DilloUrlDataFile, 1);
+         file->offset = data->len;
+         file->path = dStrdup(path);
+         file->size = (long)sb.st_size;
+         dList_append(files, file);
+      } else {
+         MSG("FORM file input: can't stat \"%s\"\n", path);
+      }
 
       dStr_sprintfa(data,
                     "\r\n"
@@ -1664,7 +1757,7 @@ DilloHtmlInput::DilloHtmlInput (DilloHtmlInputType type2, Embed *embed2,
    default:
       break;
    }
-   file_data = NULL;
+   file_path = NULL;
    reset ();
 }
 
@@ -1675,7 +1768,7 @@ DilloHtmlInput::~DilloHtmlInput ()
 {
    dFree(name);
    dFree(init_str);
-   dStr_free(file_data, 1);
+   dFree(file_path);
    if (select)
       delete select;
 }
@@ -1735,17 +1828,21 @@ void DilloHtmlInput::activate(DilloHtmlForm *form, int num_entry_fields,
 }
 
 /*
- * Read a file into cache
+ * Select a file for upload.
+ * Only its path is kept; the contents are streamed from disk on submit.
  */
 void DilloHtmlInput::readFile (BrowserWindow *bw)
 {
    const char *filename = a_UIcmd_select_file();
    if (filename) {
-      a_UIcmd_set_msg(bw, "Loading file...");
-      dStr_free(file_data, 1);
-      file_data = a_Misc_file2dstr(filename);
-      if (file_data) {
-         a_UIcmd_set_msg(bw, "File loaded.");
+      struct stat sb;
+
+      dFree(file_path);
+      file_path = NULL;
+      if (stat(filename, &sb) == 0 && S_ISREG(sb.st_mode) &&
+          access(filename, R_OK) == 0) {
+         file_path = dStrdup(filename);
+         a_UIcmd_set_msg(bw, "File selected.");
          LabelButtonResource *lbr = (LabelButtonResource*)embed->getResource();
          lbr->setLabel(filename);
       } else {
@@ -1803,10 +1900,8 @@ void DilloHtmlInput::appendValuesTo(Dlist *values, bool is_active_submit)
          LabelButtonResource *lbr = (LabelButtonResource*)embed->getResource();
          const char *filename = lbr->getLabel();
          if (filename[0] && strcmp(filename, init_str)) {
-            if (file_data) {
-               Dstr *file = dStr_sized_new(file_data->len);
-               dStr_append_l(file, file_data->str, file_data->len);
-               dList_append(values, file);
+            if (file_path) {
+               dList_append(values, dStr_new(file_path));
             } else {
                MSG("FORM file input \"%s\" not loaded.\n", filename);
             }
@@ -2019,7 +2114,7 @@ static Embed *Html_input_image(DilloHtml *html, const char *tag, int tagsize)
 
    /* create new image and add it to the button */
    a_Html_common_image_attrs(html, tag, tagsize);
-   if ((Image = a_Html_image_new(html, tag, tagsize))) {
+   if ((Image = a_Html_image_new(html, tag, tagsize, false))) {
       // At this point, we know that Image->ir represents an image
       // widget. Notice that the order of the casts matters, because
       // of multiple inheritance.
@@ -89,10 +89,10 @@ typedef struct {
    uint_t Flags;
 
    uchar_t input_code_size;
-   uchar_t *linebuf;
    int pass;
 
    uint_t y;
+   uint_t rows;             /* Lines sent to the dicache */
 
    /* state for lwz_read_byte */
    int code_size;
@@ -104,7 +104,6 @@ typedef struct {
    uint_t ColorResolution;
    uint_t NumColors;
    int    Background;
-   uint_t spill_line_index;
 #if 0
    uint_t AspectRatio;    /* AspectRatio (not used) */
 #endif
@@ -123,11 +122,16 @@ typedef struct {
    uint_t window;
    int bits_in_window;
    uint_t last_code;        /* Last "compressed" code in the look up table */
-   uint_t line_index;
-   uchar_t **spill_lines;
-   int num_spill_lines_max;
    int length[(1 << MAX_LWZ_BITS) + 1];
    int code_and_byte[(1 << MAX_LWZ_BITS) + 1];
+   uint_t pos[(1 << MAX_LWZ_BITS) + 1];
+
+   /* The decoded stream: the current line, and some history before it */
+   uchar_t *out;
+   uint_t out_size;
+   uint_t out_base;         /* Stream offset of out[0] */
+   uint_t out_end;          /* Stream offset of the next byte */
+   uint_t line_start;       /* Stream offset of the current line */
 } DilloGif;
 
 /* Some invariants:
@@ -135,6 +139,10 @@ typedef struct {
  * last_code <= code_mask
  *
  * code_and_byte is stored packed: (code << 8) | byte
+ *
+ * pos[code] is where the string of a code was last written to the stream.
+ * While it's still in 'out' (pos >= out_base) the string can be copied
+ * from there; otherwise it's rebuilt backwards from code_and_byte.
  */
 
 
@@ -162,11 +170,9 @@ void *a_Gif_new(DilloImage *Image, DilloUrl *url, int version)
    gif->Flags = 0;
    gif->state = 0;
    gif->Start_Ofs = 0;
-   gif->linebuf = NULL;
+   gif->out = NULL;
    gif->Background = Image->bg_color;
    gif->transparent = -1;
-   gif->num_spill_lines_max = 0;
-   gif->spill_lines = NULL;
    gif->window = 0;
    gif->packet_size = 0;
    gif->ColorMap_ofs = 0;
@@ -179,16 +185,9 @@ void *a_Gif_new(DilloImage *Image, DilloUrl *url, int version)
  */
 static void Gif_free(DilloGif *gif)
 {
-   int i;
-
    _MSG("Gif_free: gif=%p\n", gif);
 
-   dFree(gif->linebuf);
-   if (gif->spill_lines != NULL) {
-      for (i = 0; i < gif->num_spill_lines_max; i++)
-         dFree(gif->spill_lines[i]);
-      dFree(gif->spill_lines);
-   }
+   dFree(gif->out);
    dFree(gif);
 }
 
@@ -367,10 +366,11 @@ static size_t Gif_do_extension(DilloGif *gif, uint_t Label,
  */
 static void Gif_lwz_init(DilloGif *gif)
 {
-   gif->num_spill_lines_max = 1;
-   gif->spill_lines = dMalloc(sizeof(uchar_t *) * gif->num_spill_lines_max);
-
-   gif->spill_lines[0] = dMalloc(gif->Width);
+   /* Room for two lines and the longest string, at the least */
+   gif->out_size = MAX(64 * 1024, 2 * (gif->Width + (1 << MAX_LWZ_BITS)));
+   gif->out = dMalloc(gif->out_size);
+   gif->out_base = gif->out_end = gif->line_start = 0;
+   gif->rows = 0;
    gif->bits_in_window = 0;
 
    /* First code in table = clear_code +1
@@ -381,7 +381,6 @@ static void Gif_lwz_init(DilloGif *gif)
    memset(gif->code_and_byte, 0,
           (1 + gif->last_code) * sizeof(gif->code_and_byte[0]));
    gif->code_size = gif->input_code_size + 1;
-   gif->line_index = 0;
 }
 
 /*
@@ -390,6 +389,7 @@ static void Gif_lwz_init(DilloGif *gif)
 static void Gif_emit_line(DilloGif *gif, const uchar_t *linebuf)
 {
    a_Dicache_write(gif->url, gif->version, linebuf, gif->y);
+   gif->rows++;
    if (gif->Flags & INTERLACE) {
       switch (gif->pass) {
       case 0:
@@ -428,175 +428,145 @@ static void Gif_emit_line(DilloGif *gif, const uchar_t *linebuf)
 }
 
 /*
- * Decode the packetized lwz bytes
+ * Make room in 'out' for the longest string: drop the oldest history,
+ * but keep the current line.
  */
-static void Gif_literal(DilloGif *gif, uint_t code)
+static void Gif_out_compact(DilloGif *gif, uint_t end)
 {
-   gif->linebuf[gif->line_index++] = code;
-   if (gif->line_index >= gif->Width) {
-      Gif_emit_line(gif, gif->linebuf);
-      gif->line_index = 0;
-   }
-   gif->length[gif->last_code + 1] = 2;
-   gif->code_and_byte[gif->last_code + 1] = (code << 8);
-   gif->code_and_byte[gif->last_code] |= code;
+   uint_t base = MIN(gif->line_start, end - gif->out_size / 2);
+
+   memmove(gif->out, gif->out + (base - gif->out_base), end - base);
+   gif->out_base = base;
 }
 
 /*
- * ?
+ * Decode the lwz codes in 'buf' (bytes from inside a single data block).
+ * Codes are taken from a bit buffer that's filled several bytes at a time.
+ * The string of a code is copied from where it was last written to the
+ * stream, and a new code is the string just written plus the next byte,
+ * so the table only needs the position and length of each string. Only
+ * strings that have left the history are rebuilt from the code table.
+ *
+ * Return Value:
+ *   1 -- okay, more codes may follow
+ *   2 -- end code, or the image is complete
+ *  -1 -- the code was not in the lookup table
  */
-/* Profiling reveals over half the GIF time is spent here: */
-static void Gif_sequence(DilloGif *gif, uint_t code)
+static int Gif_decode_codes(DilloGif *gif, const uchar_t *buf, size_t nbytes,
+                            uint_t *p_window, int *p_bits_in_window,
+                            int *p_code_size)
 {
-   uint_t o_index, o_size, orig_code;
-   uint_t sequence_length = gif->length[code];
-   uint_t line_index = gif->line_index;
-   int num_spill_lines;
-   int spill_line_index = gif->spill_line_index;
-   uchar_t *last_byte_ptr, *obuf;
-
-   gif->length[gif->last_code + 1] = sequence_length + 1;
-   gif->code_and_byte[gif->last_code + 1] = (code << 8);
-
-   /* We're going to traverse the sequence backwards. Thus,
-    * we need to allocate spill lines if the sequence won't
-    * fit entirely within the present scan line. */
-   if (line_index + sequence_length <= gif->Width) {
-      num_spill_lines = 0;
-      obuf = gif->linebuf;
-      o_index = line_index + sequence_length;
-      o_size = sequence_length - 1;
-   } else {
-      num_spill_lines = (line_index + sequence_length - 1) /
-          gif->Width;
-      o_index = (line_index + sequence_length - 1) % gif->Width + 1;
-      if (num_spill_lines > gif->num_spill_lines_max) {
-         /* Allocate more spill lines. */
-         spill_line_index = gif->num_spill_lines_max;
-         gif->num_spill_lines_max = num_spill_lines << 1;
-         gif->spill_lines = dRealloc(gif->spill_lines,
-                                      gif->num_spill_lines_max *
-                                      sizeof(uchar_t *));
-
-         for (; spill_line_index < gif->num_spill_lines_max;
-              spill_line_index++)
-            gif->spill_lines[spill_line_index] =
-                dMalloc(gif->Width);
-      }
-      spill_line_index = num_spill_lines - 1;
-      obuf = gif->spill_lines[spill_line_index];
-      o_size = o_index;
-   }
-   gif->line_index = o_index;   /* for afterwards */
-
-   /* for fixing up later if last_code == code */
-   orig_code = code;
-   last_byte_ptr = obuf + o_index - 1;
-
-   /* spill lines are allocated, and we are clear to
-    * write. This loop does not write the first byte of
-    * the sequence, however (last byte traversed). */
-   while (sequence_length > 1) {
-      sequence_length -= o_size;
-      /* Write o_size bytes to
-       * obuf[o_index - o_size..o_index). */
-      for (; o_size > 0 && o_index > 0; o_size--) {
-         uint_t code_and_byte = gif->code_and_byte[code];
-
-         _MSG("%d ", gif->code_and_byte[code] & 255);
-
-         obuf[--o_index] = code_and_byte & 255;
-         code = code_and_byte >> 8;
+   const uint_t clear_code = 1 << gif->input_code_size;
+   const uint_t width = gif->Width;
+   uint_t window = *p_window;
+   int bits_in_window = *p_bits_in_window;
+   int code_size = *p_code_size;
+   uint_t code_mask = (1 << code_size) - 1;
+   uint_t last_code = gif->last_code;
+   uint_t end = gif->out_end;
+   int *length = gif->length;
+   int *code_and_byte = gif->code_and_byte;
+   uint_t *pos = gif->pos;
+   uint_t code, c, len, i;
+   uchar_t *dst, *src;
+   int ret = 1;
+
+   while (1) {
+      /* Push as many bytes as fit onto the "end" of the window (MSB).
+       * The low order bits always come first in the LZW stream. */
+      while (bits_in_window <= 24 && nbytes > 0) {
+         window = (window >> 8) | ((uint_t)*buf++ << 24);
+         bits_in_window += 8;
+         nbytes--;
       }
-      /* Prepare for writing to next line. */
-      if (o_index == 0) {
-         if (spill_line_index > 0) {
-            spill_line_index--;
-            obuf = gif->spill_lines[spill_line_index];
-            o_size = gif->Width;
+      if (bits_in_window < code_size)
+         break;
+
+      /* Extract the code.  The code is code_size (3 to 12) bits long,
+       * at the start of the window */
+      code = (window >> (32 - bits_in_window)) & code_mask;
+      bits_in_window -= code_size;
+
+      if (end - gif->out_base + (1 << MAX_LWZ_BITS) > gif->out_size)
+         Gif_out_compact(gif, end);
+      dst = gif->out + (end - gif->out_base);
+
+      /* code < clear_code  : This is uncompressed, raw data
+       * code== clear_code  : Reset the decompression table
+       * code== clear_code+1: End of data stream
+       * code > clear_code+1: Compressed code; look up in table
+       */
+      if (code < clear_code) {
+         *dst = c = code;
+         len = 1;
+      } else if (code >= clear_code + 2) {
+         if (code > last_code) {
+            ret = -1;
+            break;
+         }
+         len = length[code];
+         if (pos[code] >= gif->out_base) {
+            /* Copy forwards: when code == last_code the string overlaps
+             * its own copy, and its last byte is the first one. */
+            src = gif->out + (pos[code] - gif->out_base);
+            if (code == last_code || len < 16) {
+               for (i = 0; i < len; i++)
+                  dst[i] = src[i];
+            } else {
+               memcpy(dst, src, len);
+            }
+            c = *dst;
          } else {
-            obuf = gif->linebuf;
-            o_size = sequence_length - 1;
+            /* Walk the table backwards; the first byte is a literal */
+            for (c = code, i = len; --i > 0; c = code_and_byte[c] >> 8)
+               dst[i] = code_and_byte[c] & 255;
+            dst[0] = c;
+            /* If the code was last_code, its last byte wasn't known yet */
+            if (code == last_code)
+               dst[len - 1] = c;
          }
-         o_index = gif->Width;
+      } else if (code == clear_code) {
+         /* Reset codes size and mask */
+         last_code = clear_code + 1;
+         code_size = gif->input_code_size + 1;
+         code_mask = (1 << code_size) - 1;
+         continue;
+      } else {
+         ret = 2;
+         break;
       }
-   }
-   /* Ok, now we write the first byte of the sequence. */
-   /* We are sure that the code is literal. */
-   _MSG("%d", code);
-   obuf[--o_index] = code;
-   gif->code_and_byte[gif->last_code] |= code;
-
-   /* Fix up the output if the original code was last_code. */
-   if (orig_code == gif->last_code) {
-      *last_byte_ptr = code;
-      _MSG(" fixed (%d)!", code);
-   }
-   _MSG("\n");
 
-   /* Output any full lines. */
-   if (gif->line_index >= gif->Width) {
-      Gif_emit_line(gif, gif->linebuf);
-      gif->line_index = 0;
-   }
-   if (num_spill_lines) {
-      if (gif->line_index)
-         Gif_emit_line(gif, gif->linebuf);
-      for (spill_line_index = 0;
-           spill_line_index < num_spill_lines - (gif->line_index ? 1 : 0);
-           spill_line_index++)
-         Gif_emit_line(gif, gif->spill_lines[spill_line_index]);
-   }
-   if (num_spill_lines) {
-      /* Swap the last spill line with the gif line, using
-       * linebuf as the swap temporary. */
-      uchar_t *linebuf = gif->spill_lines[num_spill_lines - 1];
-
-      gif->spill_lines[num_spill_lines - 1] = gif->linebuf;
-      gif->linebuf = linebuf;
-   }
-   gif->spill_line_index = spill_line_index;
-}
+      /* This string plus the first byte of the next one is a new code */
+      code_and_byte[last_code] |= c;
+      if (last_code < (1 << MAX_LWZ_BITS)) {
+         length[last_code + 1] = len + 1;
+         code_and_byte[last_code + 1] = (code << 8);
+         pos[last_code + 1] = end;
+      }
+      end += len;
 
-/*
- * ?
- *
- * Return Value:
- *   2 -- quit
- *   1 -- new last code needs to be done
- *   0 -- okay, but reset the code table
- *   < 0 on error
- *   -1 if the decompression code was not in the lookup table
- */
-static int Gif_process_code(DilloGif *gif, uint_t code, uint_t clear_code)
-{
+      /* Output any full lines. */
+      for (; end - gif->line_start >= width; gif->line_start += width)
+         Gif_emit_line(gif, gif->out + (gif->line_start - gif->out_base));
+      if (gif->rows >= gif->Height) {
+         ret = 2;
+         break;
+      }
 
-   /* A short table describing what to do with the code:
-    * code < clear_code  : This is uncompressed, raw data
-    * code== clear_code  : Reset the decompression table
-    * code== clear_code+1: End of data stream
-    * code > clear_code+1: Compressed code; look up in table
-    */
-   if (code < clear_code) {
-      /* a literal code. */
-      _MSG("literal\n");
-      Gif_literal(gif, code);
-      return 1;
-   } else if (code >= clear_code + 2) {
-      /* a sequence code. */
-      if (code > gif->last_code)
-         return -1;
-      Gif_sequence(gif, code);
-      return 1;
-   } else if (code == clear_code) {
-      /* clear code. Resets the whole table */
-      _MSG("clear\n");
-      return 0;
-   } else {
-      /* end code. */
-      _MSG("end\n");
-      return 2;
+      /* Increment last code */
+      if (last_code < (1 << MAX_LWZ_BITS) && ++last_code < (1 << MAX_LWZ_BITS)
+          && (last_code & code_mask) == 0) {
+         code_size++;
+         code_mask = (1 << code_size) - 1;
+      }
    }
+
+   gif->last_code = last_code;
+   gif->out_end = end;
+   *p_window = window;
+   *p_bits_in_window = bits_in_window;
+   *p_code_size = code_size;
+   return ret;
 }
 
 /*
@@ -610,12 +580,9 @@ static int Gif_decode(DilloGif *gif, const uchar_t *buf, size_t bsize)
     * of the data block.  0 == the last data block.
     */
    size_t bufsize, packet_size;
-   uint_t clear_code;
    uint_t window;
    int bits_in_window;
-   uint_t code;
    int code_size;
-   uint_t code_mask;
 
    bufsize = bsize;
 
@@ -624,8 +591,6 @@ static int Gif_decode(DilloGif *gif, const uchar_t *buf, size_t bsize)
    window = gif->window;
    bits_in_window = gif->bits_in_window;
    code_size = gif->code_size;
-   code_mask = (1 << code_size) - 1;
-   clear_code = 1 << gif->input_code_size;
 
    /* If packet size == 0, we are at the start of a data block.
     * The first byte of the data block indicates how big it is (0 == last
@@ -639,51 +604,17 @@ static int Gif_decode(DilloGif *gif, const uchar_t *buf, size_t bsize)
 
       bufsize -= lwz_bytes;
       packet_size -= lwz_bytes;
-      for (; lwz_bytes > 0; lwz_bytes--) {
-         /* printf ("%d ", *buf) would print the depacketized lwz stream. */
-
-         /* Push the byte onto the "end" of the window (MSB).  The low order
-          * bits always come first in the LZW stream. */
-         window = (window >> 8) | (*buf++ << 24);
-         bits_in_window += 8;
-
-         while (bits_in_window >= code_size) {
-            /* Extract the code.  The code is code_size (3 to 12) bits long,
-             * at the start of the window */
-            code = (window >> (32 - bits_in_window)) & code_mask;
-
-            _MSG("code = %d, ", code);
-
-            bits_in_window -= code_size;
-            switch (Gif_process_code(gif, code, clear_code)) {
-            case 1:             /* Increment last code */
-               gif->last_code++;
-               /*gif->code_and_byte[gif->last_code+1]=0; */
-
-               if ((gif->last_code & code_mask) == 0) {
-                  if (gif->last_code == (1 << MAX_LWZ_BITS))
-                     gif->last_code--;
-                  else {
-                     code_size++;
-                     code_mask = (1 << code_size) - 1;
-                  }
-               }
-               break;
-
-            case 0:         /* Reset codes size and mask */
-               gif->last_code = clear_code + 1;
-               code_size = gif->input_code_size + 1;
-               code_mask = (1 << code_size) - 1;
-               break;
-
-            case 2:         /* End code... consume remaining data chunks..? */
-               goto error;  /* Could clean up better? */
-            default:
-               MSG("Gif_decode: error!\n");
-               goto error;
-            }
-         }
+      switch (Gif_decode_codes(gif, buf, lwz_bytes,
+                               &window, &bits_in_window, &code_size)) {
+      case 1:
+         break;
+      case 2:         /* End code... consume remaining data chunks..? */
+         goto error;  /* Could clean up better? */
+      default:
+         MSG("Gif_decode: error!\n");
+         goto error;
       }
+      buf += lwz_bytes;
 
       /* We reach here if
        * a) We have reached the end of the data block;
@@ -844,8 +775,6 @@ static size_t Gif_do_img_desc(DilloGif *gif, void *Buf,
    }
    gif->y = 0;
    Gif_lwz_init(gif);
-   gif->spill_line_index = 0;
-   gif->linebuf = dMalloc(gif->Width);
    gif->state = 3;              /*Process the lzw data next */
    if (gif->ColorMap_ofs) {
       a_Dicache_set_cmap(gif->url, gif->version, gif->Background,
@@ -23,10 +23,15 @@
 #include <limits.h> /* for INT_MAX */
 #include <ctype.h> /* for isspace */
 #include <stdlib.h> /* for strtol */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include "hsts.h"
 #include "msg.h"
 #include "../dlib/dlib.h"
+#include "domtrie.h"
+#include "hsts_table.h"
 #include "IO/tls.h"
 
 typedef struct {
@@ -39,50 +44,129 @@ typedef struct {
  * most likely latest representable time of January 19, 2038.
  */
 static time_t hsts_latest_representable_time;
-static Dlist *domains;
+static Domtrie *domains;
 
-static void Hsts_free_policy(HstsData_t *p)
+/* The compiled preload table, queried in place. Policies learned with
+ * a_Hsts_set() live in 'domains' and take precedence over it; a policy
+ * with expires_at == 0 there marks a preloaded host the site removed. */
+static const uchar_t *preload_map = NULL;
+static size_t preload_map_len;
+static uint_t preload_count, preload_pool_len;
+static const uchar_t *preload_entries, *preload_pool;
+
+static uint_t Hsts_get32(const uchar_t *p)
 {
-   dFree(p->host);
-   dFree(p);
+   return ((uint_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
 }
 
-void a_Hsts_freeall()
+/*
+ * Map a compiled preload table (see hsts_table.h).
+ * Return value: TRUE if 'fp' holds a compiled table, valid or rejected
+ * as corrupt, so that it isn't parsed as text; FALSE otherwise.
+ */
+static bool_t Hsts_preload_map(FILE *fp)
 {
-   if (prefs.http_strict_transport_security) {
-      HstsData_t *policy;
-      int i, n = dList_length(domains);
+   struct stat sb;
+   void *map;
+   uint_t count, pool_len;
+
+   if (fstat(fileno(fp), &sb) != 0 || sb.st_size < HSTS_TABLE_HDR_LEN)
+      return FALSE;
+   map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+   if (map == MAP_FAILED)
+      return FALSE;
+   if (memcmp(map, HSTS_TABLE_MAGIC, HSTS_TABLE_MAGIC_LEN)) {
+      munmap(map, sb.st_size);
+      return FALSE;
+   }
+   count = Hsts_get32((uchar_t *)map + 8);
+   pool_len = Hsts_get32((uchar_t *)map + 12);
+   if ((sb.st_size - HSTS_TABLE_HDR_LEN) / 4 < count ||
+       (size_t)sb.st_size != HSTS_TABLE_HDR_LEN + 4 * (size_t)count +
+                             pool_len ||
+       (pool_len && ((uchar_t *)map)[sb.st_size - 1] != '\0')) {
+      MSG_WARN("HSTS: corrupt preload table, ignoring it.\n");
+      munmap(map, sb.st_size);
+      return TRUE;
+   }
+   preload_map = map;
+   preload_map_len = sb.st_size;
+   preload_count = count;
+   preload_pool_len = pool_len;
+   preload_entries = preload_map + HSTS_TABLE_HDR_LEN;
+   preload_pool = preload_entries + 4 * count;
+   _MSG("HSTS: mapped %u preloaded hosts\n", count);
+   return TRUE;
+}
 
-      for (i = 0; i < n; i++) {
-         policy = dList_nth_data(domains, i);
-         Hsts_free_policy(policy);
-      }
-      dList_free(domains);
+/*
+ * Compare 'host' (ASCII case-folded) against a lowercase table string.
+ */
+static int Hsts_preload_cmp(const char *host, const uchar_t *str)
+{
+   int c;
+
+   while ((c = (uchar_t)D_ASCII_TOLOWER(*host)) == *str && c) {
+      host++;
+      str++;
    }
+   return c - *str;
 }
 
 /*
- * Compare function for searching a domain node by domain string
+ * Look 'host' up in the preload table.
+ * Return value: -1 if absent, else whether it includes subdomains.
  */
-static int Domain_node_domain_str_cmp(const void *v1, const void *v2)
+static int Hsts_preload_find(const char *host)
 {
-   const HstsData_t *node = v1;
-   const char *host = v2;
+   uint_t low = 0, high = preload_count;
+
+   while (low < high) {
+      uint_t mid = low + (high - low) / 2;
+      uint_t word = Hsts_get32(preload_entries + 4 * mid);
+      uint_t offset = word & ~HSTS_TABLE_SUBDOMAINS;
+      int st;
+
+      if (offset >= preload_pool_len)
+         return -1;
+      if ((st = Hsts_preload_cmp(host, preload_pool + offset)) == 0)
+         return (word & HSTS_TABLE_SUBDOMAINS) ? 1 : 0;
+      if (st < 0)
+         high = mid;
+      else
+         low = mid + 1;
+   }
+   return -1;
+}
+
+static void Hsts_free_policy(void *data)
+{
+   HstsData_t *p = data;
+
+   dFree(p->host);
+   dFree(p);
+}
 
-   return dStrAsciiCasecmp(node->host, host);
+void a_Hsts_freeall()
+{
+   if (prefs.http_strict_transport_security) {
+      a_Domtrie_free(domains, Hsts_free_policy);
+      if (preload_map)
+         munmap((void *)preload_map, preload_map_len);
+   }
 }
 
 static HstsData_t *Hsts_get_policy(const char *host)
 {
-   return dList_find_sorted(domains, host, Domain_node_domain_str_cmp);
+   return a_Domtrie_get(domains, host);
 }
 
 static void Hsts_remove_policy(HstsData_t *policy)
 {
    if (policy) {
       _MSG("HSTS: removed policy for %s\n", policy->host);
+      *a_Domtrie_slot(domains, policy->host) = NULL;
       Hsts_free_policy(policy);
-      dList_remove(domains, policy);
    }
 }
 
@@ -106,16 +190,6 @@ static time_t Hsts_future_time(long seconds_from_now)
    return ret;
 }
 
-/*
- * Compare function for searching domains.
- */
-static int Domain_node_cmp(const void *v1, const void *v2)
-{
-   const HstsData_t *node1 = v1, *node2 = v2;
-
-   return dStrAsciiCasecmp(node1->host, node2->host);
-}
-
 static void Hsts_set_policy(const char *host, long max_age, bool_t subdomains)
 {
    time_t exp = Hsts_future_time(max_age);
@@ -127,7 +201,7 @@ static void Hsts_set_policy(const char *host, long max_age, bool_t subdomains)
    if (policy == NULL) {
       policy = dNew0(HstsData_t, 1);
       policy->host = dStrdup(host);
-      dList_insert_sorted(domains, policy, Domain_node_cmp);
+      *a_Domtrie_slot(domains, host) = policy;
    }
    policy->subdomains = subdomains;
    policy->expires_at = exp;
@@ -245,10 +319,15 @@ void a_Hsts_set(const char *header, const DilloUrl *url)
          header++;
    }
    if (max_age_valid) {
-      if (max_age > 0)
+      if (max_age > 0) {
          Hsts_set_policy(host, max_age, subdomains);
-      else
+      } else if (preload_map && Hsts_preload_find(host) != -1) {
+         /* can't edit the table: shadow its entry */
+         Hsts_set_policy(host, 0, FALSE);
+         Hsts_get_policy(host)->expires_at = 0;
+      } else {
          Hsts_remove_policy(Hsts_get_policy(host));
+      }
    }
 }
 
@@ -263,39 +342,47 @@ static bool_t Hsts_expired(HstsData_t *policy)
    return ret;
 }
 
+/*
+ * Check the host and its parent domains, most specific first.
+ * The learned policies come from a single trie walk; the preload table
+ * is searched for the levels they don't cover.
+ */
 bool_t a_Hsts_require_https(const char *host)
 {
+   DomtrieMatch m[DOMTRIE_MAX_LABELS];
    bool_t ret = FALSE;
+   const char *s;
+   int i = 0, n;
 
    if (host) {
-      HstsData_t *policy = Hsts_get_policy(host);
-
-      if (policy) {
-         _MSG("HSTS: matched host %s\n", host);
-         if (Hsts_expired(policy))
+      n = domains ? a_Domtrie_match(domains, host, m, DOMTRIE_MAX_LABELS) : 0;
+      for (s = host; s && !ret; ) {
+         HstsData_t *policy = NULL;
+         bool_t exact = (s == host);
+
+         if (i < n && !dStrAsciiCasecmp(((HstsData_t *)m[i].Data)->host, s))
+            policy = m[i++].Data;
+         if (policy && policy->expires_at != 0 && Hsts_expired(policy)) {
             Hsts_remove_policy(policy);
-         else
-            ret = TRUE;
-      }
-      if (!ret) {
-         const char *domain_str;
-
-         for (domain_str = strchr(host+1, '.');
-              domain_str != NULL && *domain_str;
-              domain_str = strchr(domain_str+1, '.')) {
-            policy = Hsts_get_policy(domain_str+1);
-
-            if (policy && policy->subdomains) {
-               _MSG("HSTS: matched %s under %s subdomain rule\n", host,
-                   policy->host);
-               if (Hsts_expired(policy)) {
-                  Hsts_remove_policy(policy);
-               } else {
-                  ret = TRUE;
-                  break;
-               }
+            policy = NULL;
+         }
+
+         if (policy) {
+            /* expires_at == 0: a preloaded policy that was removed */
+            if (policy->expires_at != 0 && (exact || policy->subdomains)) {
+               _MSG("HSTS: matched %s under %s rule\n", host, policy->host);
+               ret = TRUE;
+            }
+         } else if (preload_map) {
+            int st = Hsts_preload_find(s);
+
+            if (st == 1 || (st == 0 && exact)) {
+               _MSG("HSTS: matched %s under preloaded %s\n", host, s);
+               ret = TRUE;
             }
          }
+         if ((s = strchr(s, '.')))
+            s++;
       }
    }
    return ret;
@@ -355,10 +442,14 @@ void a_Hsts_init(FILE *preload_file)
       struct tm future_tm = {7, 14, 3, 19, 0, 138, 0, 0, 0, 0, 0};
 
       hsts_latest_representable_time = mktime(&future_tm);
-      domains = dList_new(32);
+      domains = a_Domtrie_new();
 
       if (preload_file) {
-         Hsts_preload(preload_file);
+         /* Prefer the compiled table; fall back to parsing the text list */
+         if (!Hsts_preload_map(preload_file)) {
+            rewind(preload_file);
+            Hsts_preload(preload_file);
+         }
          fclose(preload_file);
       }
    }
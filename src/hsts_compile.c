@@ -0,0 +1,124 @@
+/*
+ * File: hsts_compile.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Build-time tool: compile the text hsts_preload list into the binary
+ * table that a_Hsts_init() maps in place (see hsts_table.h).
+ *
+ * Usage: hsts_compile <hsts_preload> <output>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "hsts_table.h"
+
+typedef struct {
+   char *host;
+   int subdomains;
+   int order;        /* input line, so later duplicates win */
+} Entry;
+
+static int Entry_cmp(const void *v1, const void *v2)
+{
+   const Entry *e1 = v1, *e2 = v2;
+   int st = strcmp(e1->host, e2->host);
+
+   return st ? st : e1->order - e2->order;
+}
+
+static void put32(FILE *fp, unsigned long v)
+{
+   putc((v >> 24) & 0xff, fp);
+   putc((v >> 16) & 0xff, fp);
+   putc((v >> 8) & 0xff, fp);
+   putc(v & 0xff, fp);
+}
+
+int main(int argc, char **argv)
+{
+   char line[4096], host[4096], flag[4096];
+   Entry *entries = NULL;
+   int i, j, num = 0, max = 0, lineno = 0;
+   unsigned long pool_len = 0;
+   FILE *in, *out;
+
+   if (argc != 3) {
+      fprintf(stderr, "Usage: %s <hsts_preload> <output>\n", argv[0]);
+      return 2;
+   }
+   if (!(in = fopen(argv[1], "r"))) {
+      fprintf(stderr, "hsts_compile: %s: %s\n", argv[1], strerror(errno));
+      return 1;
+   }
+
+   /* Same format as accepted by Hsts_preload() */
+   while (fgets(line, sizeof(line), in)) {
+      lineno++;
+      flag[0] = '\0';
+      if (sscanf(line, " %4095s %4095s", host, flag) < 1 || host[0] == '#')
+         continue;
+      for (i = 0; flag[i]; i++)
+         flag[i] = tolower((unsigned char)flag[i]);
+      if (strcmp(flag, "true") && strcmp(flag, "false")) {
+         fprintf(stderr, "hsts_compile: ignoring line %d\n", lineno);
+         continue;
+      }
+      if (num == max) {
+         max = max ? max * 2 : 1024;
+         entries = realloc(entries, max * sizeof(Entry));
+      }
+      for (i = 0; host[i]; i++)
+         host[i] = tolower((unsigned char)host[i]);
+      entries[num].host = strdup(host);
+      entries[num].subdomains = !strcmp(flag, "true");
+      entries[num].order = num;
+      num++;
+   }
+   fclose(in);
+
+   qsort(entries, num, sizeof(Entry), Entry_cmp);
+   /* drop duplicates, keeping the last one in the input */
+   for (i = j = 0; i < num; i++) {
+      if (i + 1 < num && !strcmp(entries[i].host, entries[i + 1].host)) {
+         free(entries[i].host);
+         continue;
+      }
+      entries[j++] = entries[i];
+   }
+   num = j;
+
+   if (!(out = fopen(argv[2], "wb"))) {
+      fprintf(stderr, "hsts_compile: %s: %s\n", argv[2], strerror(errno));
+      return 1;
+   }
+   for (i = 0; i < num; i++)
+      pool_len += strlen(entries[i].host) + 1;
+   fwrite(HSTS_TABLE_MAGIC, 1, HSTS_TABLE_MAGIC_LEN, out);
+   put32(out, num);
+   put32(out, pool_len);
+   for (i = 0, pool_len = 0; i < num; i++) {
+      put32(out, pool_len |
+                 (entries[i].subdomains ? HSTS_TABLE_SUBDOMAINS : 0));
+      pool_len += strlen(entries[i].host) + 1;
+   }
+   for (i = 0; i < num; i++) {
+      fwrite(entries[i].host, 1, strlen(entries[i].host) + 1, out);
+      free(entries[i].host);
+   }
+   free(entries);
+   if (fclose(out) != 0) {
+      fprintf(stderr, "hsts_compile: %s: %s\n", argv[2], strerror(errno));
+      return 1;
+   }
+   return 0;
+}
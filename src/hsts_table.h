@@ -0,0 +1,22 @@
+#ifndef __HSTS_TABLE_H__
+#define __HSTS_TABLE_H__
+
+/*
+ * Compiled HSTS preload table, as written by hsts_compile and mmapped by
+ * hsts.c. All integers are 32-bit big-endian:
+ *
+ *   magic      HSTS_TABLE_MAGIC (8 bytes)
+ *   count      number of entries
+ *   pool_len   size of the string pool
+ *   entries    'count' words: pool offset | HSTS_TABLE_SUBDOMAINS
+ *   pool       NUL-terminated, lowercase hosts
+ *
+ * Entries are sorted by strcmp() of their hosts, for binary search.
+ */
+
+#define HSTS_TABLE_MAGIC      "DHSTS01\n"
+#define HSTS_TABLE_MAGIC_LEN  8
+#define HSTS_TABLE_HDR_LEN    16
+#define HSTS_TABLE_SUBDOMAINS 0x80000000U
+
+#endif /* __HSTS_TABLE_H__ */
@@ -21,12 +21,15 @@
 #include <stdlib.h>
 #include <stdio.h>      /* for sprintf */
 #include <errno.h>
+#include <sys/time.h>   /* for gettimeofday */
 
 #include "bw.h"         /* for BrowserWindow */
 #include "msg.h"
 #include "binaryconst.h"
 #include "colors.h"
 #include "html_charrefs.h"
+#include "html_hash.h"
+#include "html_hashes.h"
 #include "utf8.hh"
 
 #include "misc.h"
@@ -35,6 +38,7 @@
 #include "menu.hh"
 #include "prefs.h"
 #include "capi.h"
+#include "timeout.hh"
 #include "html.hh"
 #include "html_common.hh"
 #include "form.hh"
@@ -56,6 +60,9 @@
 
 #define TAB_SIZE 8
 
+/* Tokens parsed between checks of the time left in a parsing slice */
+#define HTML_SLICE_TOKENS 64
+
 /*-----------------------------------------------------------------------------
  * Name spaces
  *---------------------------------------------------------------------------*/
@@ -72,16 +79,6 @@ class DilloHtml;
 typedef void (*TagOpenFunct) (DilloHtml *html, const char *tag, int tagsize);
 typedef void (*TagCloseFunct) (DilloHtml *html);
 
-typedef enum {
-   SEEK_ATTR_START,
-   MATCH_ATTR_NAME,
-   SEEK_TOKEN_START,
-   SEEK_VALUE_START,
-   SKIP_VALUE,
-   GET_VALUE,
-   FINISHED
-} DilloHtmlTagParsingState;
-
 typedef enum {
    HTML_LeftTrim      = 1 << 0,
    HTML_RightTrim     = 1 << 1,
@@ -100,15 +97,25 @@ void *a_Html_text(const char *type, void *P, CA_Callback_t *Call,void **Data);
  * Forward declarations
  *---------------------------------------------------------------------------*/
 static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof);
+static void Html_write_tokens(DilloHtml *html, char *buf, int bufsize);
 static bool Html_load_image(BrowserWindow *bw, DilloUrl *url,
                             const DilloUrl *requester, DilloImage *image);
 static void Html_callback(int Op, CacheClient_t *Client);
+static double Html_slice_start();
+static bool Html_slice_over(DilloHtml *html, int tokens);
+static void Html_tokens_cb(void *data);
+static void Html_slice_schedule(DilloHtml *html);
 static void Html_tag_cleanup_at_close(DilloHtml *html, int TagIdx);
 int a_Html_tag_index(const char *tag);
 
 /*-----------------------------------------------------------------------------
  * Local Data
  *---------------------------------------------------------------------------*/
+/* Time-sliced parsing (see Html_slice_cb) */
+static Dlist *Html_sliced = NULL;  /* parsers with received data left */
+static double Html_slice = 0;      /* parsing time per slice, in seconds */
+static double Html_slice_end = 0;  /* when the last slice ended */
+
 /* Parsing table structure */
 typedef struct {
    const char *name;      /* element name */
@@ -427,15 +434,23 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    base_url = a_Url_dup(url);
    dw = NULL;
 
-   /* Init event receiver */
+   /* Init event receivers */
    linkReceiver.html = this;
    HT2LT(this)->connectLink (&linkReceiver);
+   layoutReceiver.html = this;
+   HT2LT(this)->connect (&layoutReceiver);
 
    a_Bw_add_doc(p_bw, this);
 
    /* Init for-parsing variables */
    Start_Buf = NULL;
    Start_Ofs = 0;
+   SliceEnd = 0;
+   SliceExpired = false;
+   EofKey = 0;
+   Tokenizer = a_Html_tokenizer_new(Html_tokens_cb, this);
+   Preload = (prefs.load_images || prefs.load_stylesheets) ?
+             a_Html_preload_new(this) : NULL;
 
    _MSG("DilloHtml(): content type: %s\n", content_type);
    this->content_type = dStrdup(content_type);
@@ -452,6 +467,7 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    DocTypeVersion = 0.0f;
 
    styleEngine = new StyleEngine (HT2LT (this), page_url, base_url);
+   styleEngine->setQuirksMode (true); /* until a DOCTYPE says otherwise */
 
    cssUrls = new misc::SimpleVector <DilloUrl*> (1);
 
@@ -488,6 +504,9 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    Num_HTML = Num_HEAD = Num_BODY = Num_TITLE = 0;
 
    attr_data = dStr_sized_new(1024);
+   attrs_tag = NULL;
+   attrs_tagsize = 0;
+   attrs = new misc::SimpleVector <DilloHtmlAttr> (8);
 
    non_css_link_color = -1;
    non_css_visited_color = -1;
@@ -498,6 +517,7 @@ DilloHtml::DilloHtml(BrowserWindow *p_bw, const DilloUrl *url,
    inputs_outside_form = new misc::SimpleVector <DilloHtmlInput*> (1);
    links = new misc::SimpleVector <DilloUrl*> (64);
    images = new misc::SimpleVector <DilloHtmlImage*> (16);
+   lazyImages = 0;
 
    /* Initialize the main widget */
    initDw();
@@ -526,6 +546,9 @@ DilloHtml::~DilloHtml()
 {
    _MSG("::~DilloHtml(this=%p)\n", this);
 
+   dList_remove(Html_sliced, this);
+   a_Html_tokenizer_free(Tokenizer);
+   a_Html_preload_free(Preload);
    freeParseData();
 
    a_Bw_remove_doc(bw, this);
@@ -567,8 +590,6 @@ DilloHtml::~DilloHtml()
 void DilloHtml::write(char *Buf, int BufSize, int Eof)
 {
    int token_start;
-   char *buf = Buf + Start_Ofs;
-   int bufsize = BufSize - Start_Ofs;
 
    _MSG("DilloHtml::write BufSize=%d Start_Ofs=%d\n", BufSize, Start_Ofs);
 #if 0
@@ -580,11 +601,26 @@ void DilloHtml::write(char *Buf, int BufSize, int Eof)
    /* Update Start_Buf. It may be used after the parser is stopped */
    Start_Buf = Buf;
 
+   SliceExpired = false;
    dReturn_if (dw == NULL);
    dReturn_if (stop_parser == true);
 
-   token_start = Html_write_raw(this, buf, bufsize, Eof);
-   Start_Ofs += token_start;
+   if (Preload)
+      a_Html_preload_scan(Preload, Buf, BufSize, Eof);
+
+   SliceEnd = Html_slice_start();
+   if (Tokenizer) {
+      Html_write_tokens(this, Buf, BufSize);
+      if (Tokenizer)
+         a_Html_tokenizer_feed(Tokenizer, Buf, BufSize, Eof);
+   }
+   if (!Tokenizer && !SliceExpired) {
+      token_start = Html_write_raw(this, Buf + Start_Ofs, BufSize - Start_Ofs,
+                                   Eof);
+      Start_Ofs += token_start;
+   }
+   if (SliceExpired)
+      Html_slice_schedule(this);
 }
 
 /*
@@ -619,6 +655,7 @@ void DilloHtml::freeParseData()
 
    dStr_free(Stash, TRUE);
    dStr_free(attr_data, TRUE);
+   delete(attrs);
    dFree(content_type);
    dFree(charset);
 }
@@ -631,6 +668,11 @@ void DilloHtml::finishParsing(int ClientKey)
 {
    int si;
 
+   a_Html_tokenizer_free(Tokenizer);
+   Tokenizer = NULL;
+   a_Html_preload_free(Preload);
+   Preload = NULL;
+
    dReturn_if (stop_parser == true);
 
    /* flag we've already parsed up to the last byte */
@@ -706,16 +748,73 @@ void DilloHtml::loadImages (const DilloUrl *pattern)
 
       if (hi->image) {
          assert(hi->url);
-         if ((!pattern) || (!a_Url_cmp(hi->url, pattern))) {
-            if (Html_load_image(bw, hi->url, requester, hi->image)) {
-               a_Image_unref (hi->image);
-               hi->image = NULL;  // web owns it now
-            }
-         }
+         if ((!pattern) || (!a_Url_cmp(hi->url, pattern)))
+            loadImage(hi, requester);
+      }
+   }
+}
+
+/*
+ * Request an image that wasn't loaded yet.
+ */
+bool DilloHtml::loadImage (DilloHtmlImage *hi, const DilloUrl *requester)
+{
+   if (!Html_load_image(bw, hi->url, requester, hi->image))
+      return false;
+
+   a_Image_unref (hi->image);
+   hi->image = NULL;  // web owns it now
+   if (hi->lazy) {
+      hi->lazy = false;
+      lazyImages--;
+   }
+   return true;
+}
+
+/*
+ * Load the lazy images that are within prefs.lazy_images_distance of the
+ * viewport. Images that haven't been laid out yet wait for the next call.
+ */
+void DilloHtml::loadLazyImages ()
+{
+   Layout *layout = HT2LT(this);
+   int d = prefs.lazy_images_distance;
+   int x1 = layout->getScrollPosX () - d, y1 = layout->getScrollPosY () - d;
+   int x2 = layout->getScrollPosX () + layout->getWidthViewport () + d,
+       y2 = layout->getScrollPosY () + layout->getHeightViewport () + d;
+
+   dReturn_if (lazyImages == 0 || a_Bw_expecting(bw));
+
+   for (int i = 0; i < images->size() && lazyImages > 0; i++) {
+      DilloHtmlImage *hi = images->get(i);
+
+      if (hi->lazy) {
+         // Notice that the order of the casts matters, because of
+         // multiple inheritance.
+         dw::Image *dwi = (dw::Image*)(dw::core::ImgRenderer*)
+            hi->image->img_rndr;
+         Allocation *a = dwi->getAllocation ();
+
+         if (dwi->wasAllocated () &&
+             a->x + a->width >= x1 && a->x <= x2 &&
+             a->y + a->ascent + a->descent >= y1 && a->y <= y2)
+            loadImage(hi, page_url);
       }
    }
 }
 
+void DilloHtml::HtmlLayoutReceiver::canvasSizeChanged (int width, int ascent,
+                                                       int descent)
+{
+   html->loadLazyImages ();
+}
+
+void DilloHtml::HtmlLayoutReceiver::viewportChanged (int x, int y,
+                                                     int width, int height)
+{
+   html->loadLazyImages ();
+}
+
 /*
  * Save URL in a vector (may be loaded later).
  */
@@ -942,23 +1041,17 @@ static const char *Html_parse_numeric_charref(DilloHtml *html, char *tok,
 }
 
 /*
- * Comparison function for binary search
- */
-static int Html_charref_comp(const void *a, const void *b)
-{
-   return strcmp(((Charref_t *)a)->ref, ((Charref_t *)b)->ref);
-}
-
-/*
- * Binary search of 'key' in charref list
+ * Look 'key' up in the charref list (see html_hash.h)
  */
-static Charref_t *Html_charref_search(char *key)
+static const Charref_t *Html_charref_search(const char *key)
 {
-   Charref_t RefKey;
+   const Charref_t *p;
+   int slot;
 
-   RefKey.ref = key;
-   return (Charref_t*) bsearch(&RefKey, Charrefs, NumRef,
-                       sizeof(Charref_t), Html_charref_comp);
+   slot = Html_hash_slot(Html_hash(key, strlen(key), 0), Html_charref_disp,
+                         HTML_CHARREF_BUCKETS, HTML_CHARREF_KEYS);
+   p = &Charrefs[Html_charref_slots[slot]];
+   return strcmp(p->ref, key) ? NULL : p;
 }
 
 /*
@@ -968,7 +1061,7 @@ static Charref_t *Html_charref_search(char *key)
 static const char *Html_parse_named_charref(DilloHtml *html, char *tok,
                                             bool_t is_attr, int *entsize)
 {
-   Charref_t *p;
+   const Charref_t *p;
    char c;
    char *s = tok;
    const char *ret = NULL;
@@ -1300,24 +1393,6 @@ static void Html_process_word(DilloHtml *html, const char *word, int size)
    }
 }
 
-/*
- * Does the tag in tagstr (e.g. "p") match the tag in the tag, tagsize
- * structure, with the initial < skipped over (e.g. "P align=center>")?
- */
-static bool Html_match_tag(const char *tagstr, char *tag, int tagsize)
-{
-   int i;
-
-   for (i = 0; i < tagsize && tagstr[i] != '\0'; i++) {
-      if (D_ASCII_TOLOWER(tagstr[i]) != D_ASCII_TOLOWER(tag[i]))
-         return false;
-   }
-   /* The test for '/' is for xml compatibility: "empty/>" will be matched. */
-   if (i < tagsize && (isspace(tag[i]) || tag[i] == '>' || tag[i] == '/'))
-      return true;
-   return false;
-}
-
 /*
  * This function is called after popping the stack, to
  * handle nested Textblock widgets.
@@ -1586,6 +1661,10 @@ static void Html_parse_doctype(DilloHtml *html, const char *tag, int tagsize)
       html->DocType = DT_UNRECOGNIZED;
       BUG_MSG("DOCTYPE not recognized: ('%s').", ntag);
    }
+   /* Quirks mode for those that are not standards-compliant (see above) */
+   html->styleEngine->setQuirksMode(!(html->DocType == DT_XHTML ||
+                                      (html->DocType == DT_HTML &&
+                                       html->DocTypeVersion >= 4.01f)));
    dFree(ntag);
 }
 
@@ -2115,7 +2194,12 @@ void a_Html_common_image_attrs(DilloHtml *html, const char *tag, int tagsize)
    dFree(height_ptr);
 }
 
-DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize)
+/*
+ * Create the Image for an image tag, and request it unless images are
+ * disabled or it's lazy (see DilloHtml::loadLazyImages()).
+ */
+DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize,
+                             bool lazy)
 {
    bool load_now;
    char *alt_ptr;
@@ -2144,6 +2228,7 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize)
 
    DilloHtmlImage *hi = dNew(DilloHtmlImage, 1);
    hi->url = url;
+   hi->lazy = false;
    html->images->increase();
    html->images->set(html->images->size() - 1, hi);
 
@@ -2151,7 +2236,13 @@ DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize)
               !dStrAsciiCasecmp(URL_SCHEME(url), "data") ||
               (a_Capi_get_flags_with_redirection(url) & CAPI_IsCached);
 
-   if (load_now && Html_load_image(html->bw, url, html->page_url, image)) {
+   if (load_now && lazy) {
+      // it only reserves its space until it comes near the viewport
+      hi->image = image;
+      hi->lazy = true;
+      html->lazyImages++;
+   } else if (load_now &&
+              Html_load_image(html->bw, url, html->page_url, image)) {
       // hi->image is NULL if dillo tries to load the image immediately
       hi->image = NULL;
       a_Image_unref(image);
@@ -2243,6 +2334,46 @@ static void Html_tag_open_img(DilloHtml *html, const char *tag, int tagsize)
 
 }
 
+/*
+ * Tell the image decoders the size the style displays this image at
+ * (the image data isn't dispatched before the main loop runs again).
+ */
+static void Html_image_display_size(DilloImage *Image, Style *style)
+{
+   int w = 0, h = 0;
+
+   /* min-width and min-height may enlarge it, but not fix it alone */
+   if (isAbsLength(style->width)) {
+      w = absLengthVal(style->width);
+      if (isAbsLength(style->minWidth))
+         w = MAX(w, absLengthVal(style->minWidth));
+   }
+   if (isAbsLength(style->height)) {
+      h = absLengthVal(style->height);
+      if (isAbsLength(style->minHeight))
+         h = MAX(h, absLengthVal(style->minHeight));
+   }
+   Image->display_width = MAX(w, 0);
+   Image->display_height = MAX(h, 0);
+}
+
+/*
+ * Should this image wait until it comes near the viewport?
+ * (the loading attribute overrides the lazy_images preference)
+ */
+static bool Html_image_lazy(DilloHtml *html, const char *tag, int tagsize)
+{
+   const char *attrbuf;
+
+   if ((attrbuf = a_Html_get_attr(html, tag, tagsize, "loading"))) {
+      if (!dStrAsciiCasecmp(attrbuf, "lazy"))
+         return true;
+      if (!dStrAsciiCasecmp(attrbuf, "eager"))
+         return false;
+   }
+   return prefs.lazy_images;
+}
+
 /*
  * Create a new Image struct and request the image-url to the cache
  * (If it either hits or misses, is not relevant here; that's up to the
@@ -2258,7 +2389,8 @@ static void Html_tag_content_img(DilloHtml *html, const char *tag, int tagsize)
    if (URL_FLAGS(html->base_url) & URL_SpamSafe)
       return;
 
-   Image = a_Html_image_new(html, tag, tagsize);
+   Image = a_Html_image_new(html, tag, tagsize,
+                            Html_image_lazy(html, tag, tagsize));
    if (!Image)
       return;
 
@@ -2273,6 +2405,7 @@ static void Html_tag_content_img(DilloHtml *html, const char *tag, int tagsize)
    dw::Image *dwi = (dw::Image*)(dw::core::ImgRenderer*)Image->img_rndr;
    HT2TB(html)->addWidget(dwi, html->style());
    HT2TB(html)->addBreakOption (html->style (), false);
+   Html_image_display_size(Image, html->style());
 
    /* Image maps */
    if (a_Html_get_attr(html, tag, tagsize, "ismap")) {
@@ -3414,7 +3547,8 @@ static void Html_tag_content_wbr(DilloHtml *html, const char *tag, int tagsize)
 
 /*
  * Function index for the open, content, and close functions for each tag
- * (Alphabetically sorted for a binary search).
+ * (Alphabetically sorted. html_hash_gen reads the names from here, one
+ * entry per line, for a_Html_tag_index(); see html_hash.h).
  * The open and close functions are always called. They are used for style
  * handling and HTML bug reporting.
  * Content creation (e.g. adding new widgets or text) is done in the content
@@ -3549,7 +3683,6 @@ static const TagInfo Tags[] = {
  {"video", B8(01111),'R', Html_tag_open_video, NULL, Html_tag_close_media},
  {"wbr", B8(01011),'F', Html_tag_open_default, Html_tag_content_wbr, NULL}
 };
-#define NTAGS (sizeof(Tags)/sizeof(Tags[0]))
 
 
 /*
@@ -3574,21 +3707,13 @@ static int Html_tag_compare(const char *p1, const char *p2)
  */
 int a_Html_tag_index(const char *tag)
 {
-   int low, high, mid, cond;
-
-   /* Binary search */
-   low = 0;
-   high = NTAGS - 1;          /* Last tag index */
-   while (low <= high) {
-      mid = (low + high) / 2;
-      if ((cond = Html_tag_compare(tag, Tags[mid].name)) < 0 )
-         high = mid - 1;
-      else if (cond > 0)
-         low = mid + 1;
-      else
-         return mid;
-   }
-   return -1;
+   int ni, slot;
+
+   /* Perfect hash lookup (see html_hash.h) */
+   slot = Html_hash_slot(Html_hash_tag(tag), Html_tag_disp,
+                         HTML_TAG_BUCKETS, HTML_TAG_KEYS);
+   ni = Html_tag_slots[slot];
+   return Html_tag_compare(tag, Tags[ni].name) ? -1 : ni;
 }
 
 /*
@@ -4113,6 +4238,20 @@ static void Html_process_tag(DilloHtml *html, char *tag, int tagsize)
          html->ReqTagClose = false;
       }
    }
+
+   /* The attributes table is only valid while the tag is processed */
+   html->attrs_tag = NULL;
+}
+
+/*
+ * Split the attributes of a tag into html->attrs, so that the many lookups
+ * made while the tag is processed don't scan it again and again.
+ */
+static void Html_scan_attrs(DilloHtml *html, const char *tag, int tagsize)
+{
+   a_Html_split_attrs(html->attrs, tag, tagsize);
+   html->attrs_tag = tag;
+   html->attrs_tagsize = tagsize;
 }
 
 /*
@@ -4131,87 +4270,47 @@ static const char *Html_get_attr2(DilloHtml *html,
                                   const char *attrname,
                                   int tag_parsing_flags)
 {
-   int i, entsize, Found = 0, delimiter = 0, attr_pos = 0;
+   int i, n, len, entsize;
+   uint_t hash;
    Dstr *Buf = html->attr_data;
-   DilloHtmlTagParsingState state = SEEK_ATTR_START;
+   DilloHtmlAttr *attr = NULL;
 
    dReturn_val_if_fail(*attrname, NULL);
 
-   dStr_truncate(Buf, 0);
+   if (tag != html->attrs_tag || tagsize != html->attrs_tagsize)
+      Html_scan_attrs(html, tag, tagsize);
 
-   for (i = 1; i < tagsize; ++i) {
-      switch (state) {
-      case SEEK_ATTR_START:
-         if (isspace(tag[i]))
-            state = SEEK_TOKEN_START;
-         else if (tag[i] == '=')
-            state = SEEK_VALUE_START;
+   len = strlen(attrname);
+   hash = a_Html_attr_hash(attrname, len);
+   for (n = 0; n < html->attrs->size(); ++n) {
+      attr = html->attrs->getRef(n);
+      if (attr->hash == hash && attr->name_len == len &&
+          !dStrnAsciiCasecmp(tag + attr->name, attrname, len))
          break;
+   }
+   if (n == html->attrs->size())
+      return NULL;
 
-      case MATCH_ATTR_NAME:
-         if (!attrname[attr_pos] &&
-             (tag[i] == '=' || isspace(tag[i]) || tag[i] == '>')) {
-            Found = 1;
-            state = SEEK_TOKEN_START;
-            --i;
-         } else if (!tag[i]) {
-            state = SEEK_ATTR_START; // NULL byte is not allowed
-         } else {
-            if (D_ASCII_TOLOWER(tag[i]) != D_ASCII_TOLOWER(attrname[attr_pos]))
-               state = SEEK_ATTR_START;
-            attr_pos++;
-         }
-         break;
+   dStr_truncate(Buf, 0);
 
-      case SEEK_TOKEN_START:
-         if (tag[i] == '=') {
-            state = SEEK_VALUE_START;
-         } else if (!isspace(tag[i])) {
-            attr_pos = 0;
-            state = (Found) ? FINISHED : MATCH_ATTR_NAME;
-            --i;
-         }
-         break;
-      case SEEK_VALUE_START:
-         if (!isspace(tag[i])) {
-            delimiter = (tag[i] == '"' || tag[i] == '\'') ? tag[i] : ' ';
-            i -= (delimiter == ' ');
-            state = (Found) ? GET_VALUE : SKIP_VALUE;
-         }
-         break;
+   for (i = attr->value; i >= 0 && i < attr->value_end; ++i) {
+      if (tag[i] == '&' && (tag_parsing_flags & HTML_ParseEntities)) {
+         const char *entstr;
+         const bool_t is_attr = TRUE;
 
-      case SKIP_VALUE:
-         if ((delimiter == ' ' && isspace(tag[i])) || tag[i] == delimiter)
-            state = SEEK_TOKEN_START;
-         break;
-      case GET_VALUE:
-         if ((delimiter == ' ' && (isspace(tag[i]) || tag[i] == '>')) ||
-             tag[i] == delimiter) {
-            state = FINISHED;
-         } else if (tag[i] == '&' &&
-                    (tag_parsing_flags & HTML_ParseEntities)) {
-            const char *entstr;
-            const bool_t is_attr = TRUE;
-
-            if ((entstr = Html_parse_entity(html, tag+i, tagsize-i, &entsize,
-                                            is_attr))) {
-               dStr_append(Buf, entstr);
-               i += entsize-1;
-            } else {
-               dStr_append_c(Buf, tag[i]);
-            }
-         } else if (tag[i] == '\r' || tag[i] == '\t') {
-            dStr_append_c(Buf, ' ');
-         } else if (tag[i] == '\n') {
-            /* ignore */
+         if ((entstr = Html_parse_entity(html, tag+i, tagsize-i, &entsize,
+                                         is_attr))) {
+            dStr_append(Buf, entstr);
+            i += entsize-1;
          } else {
             dStr_append_c(Buf, tag[i]);
          }
-         break;
-
-      case FINISHED:
-         i = tagsize;
-         break;
+      } else if (tag[i] == '\r' || tag[i] == '\t') {
+         dStr_append_c(Buf, ' ');
+      } else if (tag[i] == '\n') {
+         /* ignore */
+      } else {
+         dStr_append_c(Buf, tag[i]);
       }
    }
 
@@ -4222,7 +4321,7 @@ static const char *Html_get_attr2(DilloHtml *html,
       while (Buf->len && isspace(Buf->str[Buf->len - 1]))
          dStr_truncate(Buf, Buf->len - 1);
 
-   return (Found) ? Buf->str : NULL;
+   return Buf->str;
 }
 
 /*
@@ -4253,6 +4352,126 @@ char *a_Html_get_attr_wdef(DilloHtml *html,
    return attrbuf ? dStrdup(attrbuf) : dStrdup(def);
 }
 
+/*
+ * Current time, in seconds.
+ */
+static double Html_now()
+{
+   struct timeval tv;
+
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Return when a parsing slice starting now must end (0 for no limit).
+ */
+static double Html_slice_start()
+{
+   if (prefs.parse_time_slice <= 0)
+      return 0;
+   if (Html_slice <= 0)
+      Html_slice = prefs.parse_time_slice / 1000.0;
+   return Html_now() + Html_slice;
+}
+
+/*
+ * Is the current slice over? Checked every HTML_SLICE_TOKENS tokens.
+ * (The META hack's buffer is not in the cache; it's parsed at once)
+ */
+static bool Html_slice_over(DilloHtml *html, int tokens)
+{
+   if (html->SliceEnd > 0 && tokens % HTML_SLICE_TOKENS == 0 &&
+       !(html->InFlags & IN_META_HACK) && Html_now() >= html->SliceEnd) {
+      html->SliceExpired = true;
+      return true;
+   }
+   return false;
+}
+
+/*
+ * Is there received data left for the parser?
+ */
+static bool Html_parse_pending(DilloHtml *html)
+{
+   return !html->stop_parser &&
+          (html->SliceExpired ||
+           (html->Tokenizer && !a_Html_tokenizer_done(html->Tokenizer)));
+}
+
+/*
+ * Parse more of the data 'html' has received, and finish parsing if it
+ * was waiting for that.
+ */
+static void Html_resume(DilloHtml *html)
+{
+   char *buf;
+   int bufsize, key;
+
+   html->SliceExpired = false;
+   if (a_Cache_get_buf(html->page_url, &buf, &bufsize)) {
+      if (bufsize >= html->Start_Ofs)
+         html->write(buf, bufsize, html->EofKey != 0);
+      a_Cache_unref_buf(html->page_url);
+   } else {
+      /* The data is gone */
+      a_Html_tokenizer_free(html->Tokenizer);
+      html->Tokenizer = NULL;
+   }
+   if ((key = html->EofKey) && !Html_parse_pending(html)) {
+      html->EofKey = 0;
+      html->finishParsing(key);
+   }
+}
+
+/*
+ * Tokenizer callback: there are new tokens.
+ */
+static void Html_tokens_cb(void *data)
+{
+   Html_resume((DilloHtml *)data);
+}
+
+/*
+ * Timeout callback: give another slice to the parsers that ran out of time.
+ *
+ * The time the main loop took to handle events and paint since the last
+ * slice is what the parser leaves of a frame (prefs.parse_time_slice),
+ * so the next slices take the rest, but at least a quarter of it.
+ */
+static void Html_slice_cb(void *data)
+{
+   double frame = prefs.parse_time_slice / 1000.0;
+   DilloHtml *html;
+   int n;
+
+   Html_slice = MAX(frame / 4, frame - (Html_now() - Html_slice_end));
+   _MSG("Html_slice_cb: slice=%.1fms\n", Html_slice * 1000);
+
+   /* Parsers that run out of time again get back at the end of the list */
+   for (n = dList_length(Html_sliced); n > 0; --n) {
+      if (!(html = (DilloHtml *)dList_nth_data(Html_sliced, 0)))
+         break;
+      dList_remove(Html_sliced, html);
+      Html_resume(html);
+   }
+}
+
+/*
+ * Resume the parsing of 'html', whose slice is over, after the main loop
+ * has had its turn.
+ */
+static void Html_slice_schedule(DilloHtml *html)
+{
+   if (!Html_sliced)
+      Html_sliced = dList_new(4);
+   if (dList_length(Html_sliced) == 0)
+      a_Timeout_add(0.0, Html_slice_cb, NULL);
+   if (!dList_find(Html_sliced, html))
+      dList_append(Html_sliced, html);
+   Html_slice_end = Html_now();
+}
+
 /*
  * Dispatch the apropriate function for 'Op'
  * This function is a Cache client and gets called whenever new data arrives
@@ -4267,144 +4486,138 @@ static void Html_callback(int Op, CacheClient_t *Client)
 
    if (Op) { /* EOF */
       html->write((char*)Client->Buf, Client->BufSize, 1);
-      html->finishParsing(Client->Key);
+      if (Html_parse_pending(html))
+         html->EofKey = Client->Key;  /* finished by Html_resume() */
+      else
+         html->finishParsing(Client->Key);
    } else {
       html->write((char*)Client->Buf, Client->BufSize, 0);
    }
 }
 
+/*
+ * Process a token from a_Html_lex(). Its offsets are into 'buf', which
+ * starts at the offset 'ofs' of the page.
+ */
+static void Html_process_token(DilloHtml *html, char *buf, int ofs,
+                               const HtmlToken *tk)
+{
+   char ch, *p, *text;
+   int size = tk->end - tk->start;
+
+   switch (tk->type) {
+   case HTML_TK_SPACE:
+      Html_process_space(html, buf + tk->start, size);
+      break;
+   case HTML_TK_VERBATIM:
+      /* copy VERBATIM text into the stash buffer */
+      text = dStrndup(buf + tk->start, size);
+      dStr_append(html->Stash, text);
+      dFree(text);
+      break;
+   case HTML_TK_TAG:
+      html->CurrOfs = ofs + tk->start;
+      if (tk->flags & HTML_TK_UNTERMINATED_VALUE)
+         BUG_MSG("Attribute lacks closing quote.");
+      if (tk->flags & HTML_TK_UNTERMINATED_TAG) {
+         p = dStrndup(buf + tk->start + 1,
+                      strcspn(buf + tk->start + 1, " <\n\r\t"));
+         BUG_MSG("<%s> lacks its closing '>'.", p);
+         dFree(p);
+      }
+      Html_process_tag(html, buf + tk->start, size);
+      break;
+   case HTML_TK_WORD:
+      html->CurrOfs = ofs + tk->start;
+      ch = buf[tk->end];
+      buf[tk->end] = 0;
+      Html_process_word(html, buf + tk->start, size);
+      buf[tk->end] = ch;
+      break;
+   case HTML_TK_COMMENT:
+      /* Got the whole comment. Let's throw it away! :) */
+      break;
+   }
+}
+
+/*
+ * The element whose content is being read verbatim, if any.
+ */
+static const char *Html_verbatim(DilloHtml *html)
+{
+   if (S_TOP(html)->parse_mode == DILLO_HTML_PARSE_MODE_VERBATIM)
+      return Tags[S_TOP(html)->tag_idx].name;
+   return NULL;
+}
+
 /*
  * Here's where we parse the html and put it into the Textblock structure.
  * Return value: number of bytes parsed
  */
 static int Html_write_raw(DilloHtml *html, char *buf, int bufsize, int Eof)
 {
-   char ch = 0, *p, *text;
-   int token_start, buf_index;
+   HtmlToken tk;
+   int token_start = 0, tokens = 0;
 
    /* Now, 'buf' and 'bufsize' define a buffer aligned to start at a token
     * boundary. Iterate through tokens until end of buffer is reached. */
-   buf_index = 0;
-   token_start = buf_index;
-   while ((buf_index < bufsize) && !html->stop_parser) {
-      /* invariant: buf_index == bufsize || token_start == buf_index */
-
-      if (S_TOP(html)->parse_mode ==
-          DILLO_HTML_PARSE_MODE_VERBATIM) {
-         /* Non HTML code here, let's skip until closing tag */
-         do {
-            const char *tag = Tags[S_TOP(html)->tag_idx].name;
-            buf_index += strcspn(buf + buf_index, "<");
-            if (buf_index + (int)strlen(tag) + 3 > bufsize) {
-               buf_index = bufsize;
-            } else if (strncmp(buf + buf_index, "</", 2) == 0 &&
-                       Html_match_tag(tag, buf+buf_index+2, strlen(tag)+1)) {
-               /* copy VERBATIM text into the stash buffer */
-               text = dStrndup(buf + token_start, buf_index - token_start);
-               dStr_append(html->Stash, text);
-               dFree(text);
-               token_start = buf_index;
-               break;
-            } else
-               ++buf_index;
-         } while (buf_index < bufsize);
+   while (token_start < bufsize && !html->stop_parser) {
+      if (Html_slice_over(html, ++tokens))
+         break;
+      if (!a_Html_lex(buf, token_start, bufsize, Eof, Html_verbatim(html),
+                      &tk))
+         break;
+      Html_process_token(html, buf, html->Start_Ofs, &tk);
+      token_start = tk.end;
+   }
 
-         if (buf_index == bufsize)
-            break;
+   HT2TB(html)->flush ();
+
+   return token_start;
+}
+
+/*
+ * Take the tokens that html->Tokenizer has ready, and parse them.
+ * 'buf' holds the page's data; html->Start_Ofs follows the tokens.
+ *
+ * When the tokenizer's guess of verbatim mode turns out wrong, it's
+ * dropped, and the caller parses the rest with Html_write_raw().
+ */
+static void Html_write_tokens(DilloHtml *html, char *buf, int bufsize)
+{
+   HtmlTokenizer *tkz = html->Tokenizer;
+   const HtmlToken *tk;
+   const char *verbatim;
+   int tokens = 0;
+
+   while (!html->stop_parser && (tk = a_Html_tokenizer_peek(tkz))) {
+      if (Html_slice_over(html, ++tokens))
+         break;
+
+      verbatim = Html_verbatim(html);
+      if (tk->type == HTML_TK_VERBATIM ?
+          !verbatim || !a_Html_lex_verbatim_end(buf, tk->end, bufsize,
+                                                verbatim) :
+          verbatim && !a_Html_lex_verbatim_end(buf, tk->start, bufsize,
+                                               verbatim)) {
+         _MSG("Html_write_tokens: wrong verbatim guess at %d\n", tk->start);
+         a_Html_tokenizer_free(tkz);
+         html->Tokenizer = NULL;
+         break;
       }
 
-      if (isspace(buf[buf_index])) {
-         /* whitespace: group all available whitespace */
-         while (++buf_index < bufsize && isspace(buf[buf_index])) ;
-         Html_process_space(html, buf + token_start, buf_index - token_start);
-         token_start = buf_index;
-
-      } else if (buf[buf_index] == '<' && (ch = buf[buf_index + 1]) &&
-                 (isalpha(ch) || strchr("/!?", ch)) ) {
-         /* Tag */
-         if (buf_index + 3 < bufsize && !strncmp(buf + buf_index, "<!--", 4)) {
-            /* Comment: search for close of comment, skipping over
-             * everything except a matching "-->" tag. */
-            while ( (p = (char*) memchr(buf + buf_index, '>',
-                                        bufsize - buf_index)) ){
-               buf_index = p - buf + 1;
-               if (p[-1] == '-' && p[-2] == '-') break;
-            }
-            if (p) {
-               /* Got the whole comment. Let's throw it away! :) */
-               token_start = buf_index;
-            } else
-               buf_index = bufsize;
-         } else {
-            /* Tag: search end of tag (skipping over quoted strings) */
-            html->CurrOfs = html->Start_Ofs + token_start;
-
-            while ( buf_index < bufsize ) {
-               buf_index++;
-               buf_index += strcspn(buf + buf_index, ">\"'<");
-               if ((ch = buf[buf_index]) == '>') {
-                  break;
-               } else if (ch == '"' || ch == '\'') {
-                  /* Skip over quoted string */
-                  buf_index++;
-                  buf_index += strcspn(buf + buf_index,
-                                       (ch == '"') ? "\">" : "'>");
-                  if (buf[buf_index] == '>') {
-                     /* Unterminated string value? Let's look ahead and test:
-                      * (<: unterminated, closing-quote: terminated) */
-                     int offset = buf_index + 1;
-                     offset += strcspn(buf + offset,
-                                       (ch == '"') ? "\"<" : "'<");
-                     if (buf[offset] == ch || !buf[offset]) {
-                        buf_index = offset;
-                     } else {
-                        BUG_MSG("Attribute lacks closing quote.");
-                        break;
-                     }
-                  }
-               } else if (ch == '<') {
-                  /* unterminated tag detected */
-                  p = dStrndup(buf+token_start+1,
-                               strcspn(buf+token_start+1, " <\n\r\t"));
-                  BUG_MSG("<%s> lacks its closing '>'.", p);
-                  dFree(p);
-                  --buf_index;
-                  break;
-               }
-            }
-            if (buf_index < bufsize) {
-               buf_index++;
-               Html_process_tag(html, buf + token_start,
-                                buf_index - token_start);
-               token_start = buf_index;
-            }
-         }
-      } else {
-         /* A Word: search for whitespace or tag open */
-         html->CurrOfs = html->Start_Ofs + token_start;
-
-         while (++buf_index < bufsize) {
-            buf_index += strcspn(buf + buf_index, " <\n\r\t\f\v");
-            if (buf[buf_index] == '<' && (ch = buf[buf_index + 1]) &&
-                !isalpha(ch) && !strchr("/!?", ch))
-               continue;
-            break;
-         }
-         if (buf_index < bufsize || Eof) {
-            /* successfully found end of token */
-            ch = buf[buf_index];
-            buf[buf_index] = 0;
-            Html_process_word(html, buf + token_start,
-                              buf_index - token_start);
-            buf[buf_index] = ch;
-            token_start = buf_index;
-         }
+      if (tk->type == HTML_TK_TAG && tk->nattrs >= 0) {
+         /* Its attributes are already split */
+         a_Html_tokenizer_get_attrs(tkz, tk, html->attrs);
+         html->attrs_tag = buf + tk->start;
+         html->attrs_tagsize = tk->end - tk->start;
       }
-   }/*while*/
+      Html_process_token(html, buf, 0, tk);
+      html->Start_Ofs = tk->end;
+      a_Html_tokenizer_next(tkz);
+   }
 
    HT2TB(html)->flush ();
-
-   return token_start;
 }
 
 
@@ -15,6 +15,9 @@
 
 #include "styleengine.hh"
 
+#include "html_tokenizer.hh"
+#include "html_preload.hh"
+
 /*
  * Macros
  */
@@ -100,6 +103,7 @@ typedef enum {
 typedef struct {
    DilloUrl *url;
    DilloImage *image;
+   bool lazy;           /* waiting to come near the viewport */
 } DilloHtmlImage;
 
 typedef struct {
@@ -143,6 +147,15 @@ private:
    };
    HtmlLinkReceiver linkReceiver;
 
+   class HtmlLayoutReceiver: public dw::core::Layout::Receiver {
+   public:
+      DilloHtml *html;
+
+      void canvasSizeChanged (int width, int ascent, int descent);
+      void viewportChanged (int x, int y, int width, int height);
+   };
+   HtmlLayoutReceiver layoutReceiver;
+
 public:  //BUG: for now everything is public
 
    BrowserWindow *bw;
@@ -154,6 +167,11 @@ public:  //BUG: for now everything is public
    /* -------------------------------------------------------------------*/
    char *Start_Buf;
    int Start_Ofs;
+   double SliceEnd;       /* when the current parsing slice ends (0: never) */
+   bool SliceExpired;     /* the last slice ended before the data did */
+   int EofKey;            /* cache client key, once EOF waits on the parser */
+   HtmlTokenizer *Tokenizer; /* background tokenizer, if there's one */
+   HtmlPreload *Preload;  /* requests resources ahead of the parser */
    char *content_type, *charset;
    bool stop_parser;
 
@@ -189,6 +207,9 @@ public:  //BUG: for now everything is public
    uchar_t Num_HTML, Num_HEAD, Num_BODY, Num_TITLE;
 
    Dstr *attr_data;       /* Buffer for attribute value */
+   const char *attrs_tag; /* The tag whose attributes are in 'attrs' */
+   int attrs_tagsize;
+   lout::misc::SimpleVector<DilloHtmlAttr> *attrs;
 
    int32_t non_css_link_color; /* as provided by link attribute in BODY */
    int32_t non_css_visited_color; /* as provided by vlink attribute in BODY */
@@ -201,11 +222,13 @@ public:  //BUG: for now everything is public
    lout::misc::SimpleVector<DilloHtmlInput*> *inputs_outside_form;
    lout::misc::SimpleVector<DilloUrl*> *links;
    lout::misc::SimpleVector<DilloHtmlImage*> *images;
+   int lazyImages;  /* images waiting to come near the viewport */
    dw::ImageMapsList maps;
 
 private:
    void freeParseData();
    void initDw();  /* Used by the constructor */
+   bool loadImage (DilloHtmlImage *hi, const DilloUrl *requester);
 
 public:
    DilloHtml(BrowserWindow *bw, const DilloUrl *url, const char *content_type);
@@ -220,6 +243,7 @@ public:
    DilloHtmlForm *getCurrentForm ();
    bool_t unloadedImages();
    void loadImages (const DilloUrl *pattern);
+   void loadLazyImages ();
    void addCssUrl(const DilloUrl *url);
 
    // useful shortcuts
@@ -261,7 +285,8 @@ DilloUrl *a_Html_url_new(DilloHtml *html,
                          int use_base_url);
 
 void a_Html_common_image_attrs(DilloHtml *html, const char *tag, int tagsize);
-DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize);
+DilloImage *a_Html_image_new(DilloHtml *html, const char *tag, int tagsize,
+                             bool lazy);
 
 char *a_Html_parse_entities(DilloHtml *html, const char *token, int toksize);
 void a_Html_pop_tag(DilloHtml *html, int TagIdx);
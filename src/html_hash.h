@@ -0,0 +1,71 @@
+#ifndef __HTML_HASH_H__
+#define __HTML_HASH_H__
+
+/*
+ * Minimal perfect hashes for the element names of Tags[] (html.cc) and
+ * for the named character references of Charrefs[] (html_charrefs.h).
+ *
+ * html_hash_gen builds, at build time, the tables of html_hashes.h from
+ * those two: a key goes to the bucket Html_hash_mix(h, 0) % buckets,
+ * and the bucket's displacement 'd' leads it to the slot
+ * Html_hash_mix(h, d) % keys, where the index of its entry is stored.
+ * A lookup still has to compare the key with the entry it gets.
+ */
+
+/*
+ * FNV-1a hash of 'len' bytes of 's', optionally lowercasing ASCII.
+ */
+static inline unsigned int Html_hash(const char *s, int len, int fold)
+{
+   unsigned int h = 2166136261U;
+   int i;
+
+   for (i = 0; i < len; i++) {
+      unsigned char c = s[i];
+
+      if (fold && c >= 'A' && c <= 'Z')
+         c += 'a' - 'A';
+      h = (h ^ c) * 16777619U;
+   }
+   return h;
+}
+
+/*
+ * Html_hash() of an element name, lowercased, up to the first of
+ * " >/\n\r\t" or the end of the string.
+ */
+static inline unsigned int Html_hash_tag(const char *s)
+{
+   unsigned int h = 2166136261U;
+   unsigned char c;
+
+   for (; (c = *s) && c != ' ' && c != '>' && c != '/' && c != '\n' &&
+          c != '\r' && c != '\t'; s++) {
+      if (c >= 'A' && c <= 'Z')
+         c += 'a' - 'A';
+      h = (h ^ c) * 16777619U;
+   }
+   return h;
+}
+
+static inline unsigned int Html_hash_mix(unsigned int h, unsigned int d)
+{
+   h ^= d * 0x9e3779b9U;
+   h ^= h >> 16;
+   h *= 0x85ebca6bU;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35U;
+   h ^= h >> 16;
+   return h;
+}
+
+/*
+ * The slot for hash 'h' in a table of 'keys' slots.
+ */
+static inline int Html_hash_slot(unsigned int h, const unsigned short *disp,
+                                 int buckets, int keys)
+{
+   return Html_hash_mix(h, disp[Html_hash_mix(h, 0) % buckets]) % keys;
+}
+
+#endif /* __HTML_HASH_H__ */
@@ -0,0 +1,208 @@
+/*
+ * File: html_hash_gen.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * Build-time tool: generate the minimal perfect hash tables for the
+ * element names of Tags[] and for the character references of
+ * Charrefs[] (see html_hash.h).
+ *
+ * Usage: html_hash_gen <html.cc> <output>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "html_charrefs.h"
+#include "html_hash.h"
+
+#define MAX_DISP 65535
+
+typedef struct {
+   int bucket;
+   int size;
+} Bucket;
+
+static int Bucket_cmp(const void *v1, const void *v2)
+{
+   const Bucket *b1 = v1, *b2 = v2;
+
+   /* largest buckets first */
+   if (b1->size != b2->size)
+      return b2->size - b1->size;
+   return b1->bucket - b2->bucket;
+}
+
+/*
+ * Try to place every key with 'buckets' buckets.
+ * Return 0 on success, with the displacements and slots filled in.
+ */
+static int Try_build(const unsigned int *hash, int keys, int buckets,
+                     unsigned short *disp, int *slot_key)
+{
+   Bucket *order = calloc(buckets, sizeof(Bucket));
+   int *members = malloc(keys * sizeof(int));
+   int *slots = malloc(keys * sizeof(int));
+   int i, j, k, b, n, d, st = 0;
+
+   for (i = 0; i < buckets; i++)
+      order[i].bucket = i;
+   for (i = 0; i < keys; i++)
+      order[Html_hash_mix(hash[i], 0) % buckets].size++;
+   qsort(order, buckets, sizeof(Bucket), Bucket_cmp);
+   for (i = 0; i < keys; i++)
+      slot_key[i] = -1;
+   memset(disp, 0, buckets * sizeof(unsigned short));
+
+   for (b = 0; b < buckets && order[b].size && !st; b++) {
+      for (i = n = 0; i < keys; i++)
+         if ((int)(Html_hash_mix(hash[i], 0) % buckets) == order[b].bucket)
+            members[n++] = i;
+
+      for (d = 1; d <= MAX_DISP; d++) {
+         for (j = 0; j < n; j++) {
+            slots[j] = Html_hash_mix(hash[members[j]], d) % keys;
+            if (slot_key[slots[j]] != -1)
+               break;
+            for (k = 0; k < j && slots[k] != slots[j]; k++) ;
+            if (k < j)
+               break;
+         }
+         if (j == n)
+            break;
+      }
+      if (d > MAX_DISP) {
+         st = 1;
+      } else {
+         disp[order[b].bucket] = d;
+         for (j = 0; j < n; j++)
+            slot_key[slots[j]] = members[j];
+      }
+   }
+   free(order);
+   free(members);
+   free(slots);
+   return st;
+}
+
+/*
+ * Build the hash for 'keys' names and write its tables as 'prefix'_disp
+ * and 'prefix'_slots, with 'PREFIX'_BUCKETS and 'PREFIX'_KEYS.
+ */
+static int Write_hash(FILE *out, const char *prefix, const char *PREFIX,
+                      const char **names, int keys, int fold)
+{
+   unsigned int *hash = malloc(keys * sizeof(unsigned int));
+   unsigned short *disp = malloc(keys * sizeof(unsigned short));
+   int *slot_key = malloc(keys * sizeof(int));
+   int i, j, buckets;
+
+   for (i = 0; i < keys; i++) {
+      hash[i] = Html_hash(names[i], strlen(names[i]), fold);
+      for (j = 0; j < i; j++) {
+         if (hash[j] == hash[i]) {
+            fprintf(stderr, "html_hash_gen: \"%s\" and \"%s\" collide\n",
+                    names[j], names[i]);
+            return 1;
+         }
+      }
+   }
+   for (buckets = keys / 4 + 1; buckets <= keys; buckets++)
+      if (!Try_build(hash, keys, buckets, disp, slot_key))
+         break;
+   if (buckets > keys) {
+      fprintf(stderr, "html_hash_gen: can't build the %s hash\n", prefix);
+      return 1;
+   }
+
+   fprintf(out, "#define %s_BUCKETS %d\n", PREFIX, buckets);
+   fprintf(out, "#define %s_KEYS %d\n\n", PREFIX, keys);
+   fprintf(out, "static const unsigned short %s_disp[%d] = {", prefix,
+           buckets);
+   for (i = 0; i < buckets; i++)
+      fprintf(out, "%s%u,", i % 12 ? " " : "\n   ", disp[i]);
+   fprintf(out, "\n};\n\n");
+   fprintf(out, "static const unsigned %s %s_slots[%d] = {",
+           keys <= 256 ? "char" : "short", prefix, keys);
+   for (i = 0; i < keys; i++)
+      fprintf(out, "%s%d,", i % 12 ? " " : "\n   ", slot_key[i]);
+   fprintf(out, "\n};\n\n");
+
+   free(hash);
+   free(disp);
+   free(slot_key);
+   return 0;
+}
+
+/*
+ * Read the element names of Tags[], in order, from html.cc.
+ */
+static int Read_tags(const char *filename, const char ***names)
+{
+   char line[1024], name[128];
+   int num = 0, max = 0, in_table = 0;
+   FILE *in;
+
+   if (!(in = fopen(filename, "r"))) {
+      fprintf(stderr, "html_hash_gen: %s: %s\n", filename, strerror(errno));
+      return -1;
+   }
+   while (fgets(line, sizeof(line), in)) {
+      if (!in_table) {
+         in_table = !strncmp(line, "static const TagInfo Tags[] = {", 31);
+      } else if (line[0] == '}') {
+         break;
+      } else if (sscanf(line, " {\"%127[^\"]\",", name) == 1) {
+         if (num == max) {
+            max = max ? max * 2 : 128;
+            *names = realloc(*names, max * sizeof(char *));
+         }
+         (*names)[num++] = strdup(name);
+      }
+   }
+   fclose(in);
+   if (num == 0)
+      fprintf(stderr, "html_hash_gen: no Tags[] found in %s\n", filename);
+   return num;
+}
+
+int main(int argc, char **argv)
+{
+   const char **tags = NULL, *refs[NumRef];
+   int i, num_tags;
+   FILE *out;
+
+   if (argc != 3) {
+      fprintf(stderr, "Usage: %s <html.cc> <output>\n", argv[0]);
+      return 2;
+   }
+   if ((num_tags = Read_tags(argv[1], &tags)) <= 0)
+      return 1;
+   for (i = 0; i < NumRef; i++)
+      refs[i] = Charrefs[i].ref;
+
+   if (!(out = fopen(argv[2], "w"))) {
+      fprintf(stderr, "html_hash_gen: %s: %s\n", argv[2], strerror(errno));
+      return 1;
+   }
+   fprintf(out, "/* Generated by html_hash_gen from html.cc and "
+                "html_charrefs.h. Don't edit. */\n\n");
+   if (Write_hash(out, "Html_tag", "HTML_TAG", tags, num_tags, 1) ||
+       Write_hash(out, "Html_charref", "HTML_CHARREF", refs, NumRef, 0)) {
+      fclose(out);
+      remove(argv[2]);
+      return 1;
+   }
+   if (fclose(out) != 0) {
+      fprintf(stderr, "html_hash_gen: %s: %s\n", argv[2], strerror(errno));
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,336 @@
+/*
+ * File: html_preload.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The preload scanner: it goes over the received data ahead of the parser,
+ * and requests the stylesheets (LINK and @import in STYLE) and images it
+ * finds. The parser is often behind, waiting for its next time slice or
+ * for the HEAD to end, and by the time it gets to those resources they're
+ * on their way, or in the cache.
+ *
+ * It follows the parser's rules for what gets loaded, and leaves alone
+ * the URLs it can't resolve the same way (e.g. values with entities).
+ * The HTTP queue gives stylesheets priority over images.
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "html_common.hh"
+#include "html_preload.hh"
+#include "prefs.h"
+#include "capi.h"
+#include "web.hh"
+#include "bw.h"
+#include "msg.h"
+
+using namespace lout::misc;
+
+struct HtmlPreload {
+   DilloHtml *html;
+   DilloUrl *BaseUrl;           /* As set by BASE, if it was seen */
+   int ScanOfs;                 /* Where the next token starts */
+   const char *Verbatim;        /* The element whose content is skipped */
+   bool InBody;                 /* LINK and BASE don't count anymore */
+   bool Stopped;                /* Its URLs would be guesses */
+   SimpleVector<DilloHtmlAttr> *Attrs;
+   Dlist *Images;               /* Found in this pass, requested last */
+};
+
+/* The elements that don't end the HEAD (see Html_test_section()) */
+static const char *const Html_preload_head_tags[] = {
+   "html", "head", "title", "base", "link", "meta", "style", "script",
+   "noscript", "template"
+};
+
+/*
+ * A cache client with no use for the data but to have it cached.
+ */
+static void Html_preload_callback(int Op, CacheClient_t *Client)
+{
+   if (Op == CA_Close)
+      a_Bw_close_client(((DilloWeb *)Client->Web)->bw, Client->Key);
+}
+
+/*
+ * Request 'url', unless it's already in the cache.
+ */
+static void Html_preload_url(HtmlPreload *pl, DilloUrl *url, int flags)
+{
+   BrowserWindow *bw = pl->html->bw;
+   DilloWeb *Web;
+   int ClientKey;
+
+   if ((a_Capi_get_flags_with_redirection(url) & CAPI_IsCached) ||
+       (dStrAsciiCasecmp(URL_SCHEME(url), "http") &&
+        dStrAsciiCasecmp(URL_SCHEME(url), "https")))
+      return;
+
+   _MSG("Html_preload_url: %s\n", URL_STR(url));
+   Web = a_Web_new(bw, url, pl->html->page_url);
+   Web->flags |= flags;
+   if ((ClientKey = a_Capi_open_url(Web, Html_preload_callback, NULL))) {
+      a_Bw_add_preload_client(bw, ClientKey);
+      a_Bw_add_url(bw, url);
+   }
+}
+
+/*
+ * Get the value of an attribute of the tag whose attributes are in
+ * pl->Attrs, trimmed. Values with character references are left alone
+ * (NULL).
+ */
+static char *Html_preload_attr(HtmlPreload *pl, const char *tag,
+                               const char *name)
+{
+   int i, len = strlen(name);
+   uint_t hash = a_Html_attr_hash(name, len);
+   DilloHtmlAttr *attr;
+
+   for (i = 0; i < pl->Attrs->size(); i++) {
+      attr = pl->Attrs->getRef(i);
+      if (attr->hash == hash && attr->name_len == len &&
+          !dStrnAsciiCasecmp(tag + attr->name, name, len)) {
+         if (attr->value == -1 ||
+             memchr(tag + attr->value, '&', attr->value_end - attr->value))
+            return NULL;
+         return dStrstrip(dStrndup(tag + attr->value,
+                                   attr->value_end - attr->value));
+      }
+   }
+   return NULL;
+}
+
+/*
+ * Resolve a URL against the document's base.
+ */
+static DilloUrl *Html_preload_url_new(HtmlPreload *pl, const char *url_str)
+{
+   const DilloUrl *base = pl->BaseUrl ? pl->BaseUrl : pl->html->base_url;
+
+   return a_Url_new(url_str, URL_STR_(base));
+}
+
+/*
+ * Does the tag have this name? (with the initial '<' skipped over)
+ */
+static bool Html_preload_is(const char *tag, int tagsize, const char *name)
+{
+   int len = strlen(name);
+
+   return (tagsize > len && !dStrnAsciiCasecmp(tag, name, len) &&
+           (isspace(tag[len]) || tag[len] == '>' || tag[len] == '/'));
+}
+
+/*
+ * Look at a tag for something to preload
+ * (see Html_tag_open_link(), Html_tag_open_base() and a_Html_image_new()).
+ */
+static void Html_preload_tag(HtmlPreload *pl, const char *tag, int tagsize)
+{
+   char *rel, *type, *media, *href, *loading;
+   DilloUrl *url;
+   bool lazy;
+   uint_t i;
+
+   if (tagsize < 3 || !isalpha(tag[1]))
+      return;
+
+   if (!pl->InBody) {
+      for (i = 0; i < sizeof(Html_preload_head_tags) / sizeof(char *); i++)
+         if (Html_preload_is(tag + 1, tagsize - 1, Html_preload_head_tags[i]))
+            break;
+      pl->InBody = (i == sizeof(Html_preload_head_tags) / sizeof(char *));
+   }
+
+   if (Html_preload_is(tag + 1, tagsize - 1, "base")) {
+      a_Html_split_attrs(pl->Attrs, tag, tagsize);
+      if (!pl->InBody && !pl->BaseUrl &&
+          (href = Html_preload_attr(pl, tag, "href"))) {
+         url = Html_preload_url_new(pl, href);
+         if (strstr(href, "://")) {
+            pl->BaseUrl = url;
+         } else {
+            /* A relative BASE depends on the DOCTYPE */
+            a_Url_free(url);
+            pl->Stopped = true;
+         }
+         dFree(href);
+      }
+   } else if (Html_preload_is(tag + 1, tagsize - 1, "link")) {
+      if (pl->InBody || !prefs.load_stylesheets ||
+          (URL_FLAGS(pl->html->base_url) & URL_SpamSafe))
+         return;
+      a_Html_split_attrs(pl->Attrs, tag, tagsize);
+      rel = Html_preload_attr(pl, tag, "rel");
+      type = Html_preload_attr(pl, tag, "type");
+      media = Html_preload_attr(pl, tag, "media");
+      if (rel && !dStrAsciiCasecmp(rel, "stylesheet") &&
+          (!type || !dStrAsciiCasecmp(type, "text/css")) &&
+          (!media || dStriAsciiStr(media, "screen") ||
+           !dStrAsciiCasecmp(media, "all")) &&
+          (href = Html_preload_attr(pl, tag, "href"))) {
+         url = Html_preload_url_new(pl, href);
+         Html_preload_url(pl, url, WEB_Stylesheet);
+         a_Url_free(url);
+         dFree(href);
+      }
+      dFree(rel);
+      dFree(type);
+      dFree(media);
+   } else if (Html_preload_is(tag + 1, tagsize - 1, "img")) {
+      if (!prefs.load_images ||
+          (URL_FLAGS(pl->html->base_url) & URL_SpamSafe))
+         return;
+      a_Html_split_attrs(pl->Attrs, tag, tagsize);
+      /* Lazy images wait for the viewport (see Html_image_lazy()) */
+      lazy = prefs.lazy_images;
+      if ((loading = Html_preload_attr(pl, tag, "loading"))) {
+         if (!dStrAsciiCasecmp(loading, "lazy"))
+            lazy = true;
+         else if (!dStrAsciiCasecmp(loading, "eager"))
+            lazy = false;
+         dFree(loading);
+      }
+      if (!lazy && (href = Html_preload_attr(pl, tag, "src"))) {
+         dList_append(pl->Images, Html_preload_url_new(pl, href));
+         dFree(href);
+      }
+   }
+}
+
+/*
+ * Preload the stylesheets that the leading @import rules of a STYLE
+ * element bring in (see CssParser::parseImport()).
+ */
+static void Html_preload_imports(HtmlPreload *pl, const char *css, int size)
+{
+   const char *p = css, *end = css + size, *s;
+   char *url_str, *media;
+   DilloUrl *url;
+   bool in_url;
+
+   if (!prefs.load_stylesheets ||
+       (URL_FLAGS(pl->html->base_url) & URL_SpamSafe))
+      return;
+
+   while (p < end) {
+      if (isspace(*p)) {
+         p++;
+      } else if (end - p >= 4 && (!strncmp(p, "<!--", 4))) {
+         p += 4;
+      } else if (end - p >= 3 && (!strncmp(p, "-->", 3))) {
+         p += 3;
+      } else if (end - p >= 2 && !strncmp(p, "/*", 2)) {
+         for (p += 2; end - p >= 2 && strncmp(p, "*/", 2); p++) ;
+         p += 2;
+      } else if (end - p >= 8 && !dStrnAsciiCasecmp(p, "@charset", 8)) {
+         for (p += 8; p < end && *p != ';'; p++) ;
+         p++;
+      } else if (end - p >= 7 && !dStrnAsciiCasecmp(p, "@import", 7)) {
+         for (p += 7; p < end && isspace(*p); p++) ;
+         if ((in_url = end - p >= 4 && !dStrnAsciiCasecmp(p, "url(", 4)))
+            for (p += 4; p < end && isspace(*p); p++) ;
+         if (p < end && (*p == '"' || *p == '\'')) {
+            for (s = ++p; p < end && *p != s[-1]; p++) ;
+            url_str = (p < end) ? dStrndup(s, p++ - s) : NULL;
+         } else {
+            for (s = p; p < end && !isspace(*p) && *p != ')' && *p != ';'; p++)
+               ;
+            url_str = dStrndup(s, p - s);
+         }
+         if (in_url) {
+            for ( ; p < end && *p != ')'; p++) ;
+            p++;
+         }
+         for (s = p; p < end && *p != ';'; p++) ;
+         media = (p < end) ? dStrstrip(dStrndup(s, p - s)) : NULL;
+
+         /* Only for all media, or the screen */
+         if (url_str && *url_str && !strchr(url_str, '\\') && media &&
+             (!*media || dStriAsciiStr(media, "screen") ||
+              dStriAsciiStr(media, "all"))) {
+            url = Html_preload_url_new(pl, url_str);
+            Html_preload_url(pl, url, WEB_Stylesheet);
+            a_Url_free(url);
+         }
+         dFree(url_str);
+         dFree(media);
+         p++;
+      } else {
+         break;
+      }
+   }
+}
+
+/*
+ * Create the preload scanner of a document.
+ */
+HtmlPreload *a_Html_preload_new(DilloHtml *html)
+{
+   HtmlPreload *pl = dNew0(HtmlPreload, 1);
+
+   pl->html = html;
+   pl->Attrs = new SimpleVector<DilloHtmlAttr> (8);
+   pl->Images = dList_new(8);
+   return pl;
+}
+
+void a_Html_preload_free(HtmlPreload *pl)
+{
+   if (pl) {
+      a_Url_free(pl->BaseUrl);
+      delete pl->Attrs;
+      dList_free(pl->Images);
+      dFree(pl);
+   }
+}
+
+/*
+ * Scan the data that's new since the last call. 'buf' is all the data
+ * received so far (NUL-terminated), and 'eof' tells it's complete.
+ */
+void a_Html_preload_scan(HtmlPreload *pl, const char *buf, int bufsize,
+                         int eof)
+{
+   HtmlToken tk;
+   const char *p;
+   DilloUrl *url;
+
+   while (!pl->Stopped && pl->ScanOfs < bufsize) {
+      if (!pl->Verbatim && buf[pl->ScanOfs] != '<') {
+         /* text, skip it */
+         p = (const char *)memchr(buf + pl->ScanOfs, '<',
+                                  bufsize - pl->ScanOfs);
+         pl->ScanOfs = p ? p - buf : bufsize;
+         continue;
+      }
+      if (!a_Html_lex(buf, pl->ScanOfs, bufsize, eof, pl->Verbatim, &tk))
+         break;
+      if (tk.type == HTML_TK_TAG) {
+         Html_preload_tag(pl, buf + tk.start, tk.end - tk.start);
+         pl->Verbatim = a_Html_lex_verbatim_start(buf + tk.start,
+                                                  tk.end - tk.start);
+      } else if (tk.type == HTML_TK_VERBATIM) {
+         if (!strcmp(pl->Verbatim, "style"))
+            Html_preload_imports(pl, buf + tk.start, tk.end - tk.start);
+         pl->Verbatim = NULL;
+      }
+      /* A word that starts with '<' may end before the next one */
+      pl->ScanOfs = MAX(tk.end, tk.start + 1);
+   }
+
+   /* The stylesheets went first */
+   while ((url = (DilloUrl *)dList_nth_data(pl->Images, 0))) {
+      dList_remove(pl->Images, url);
+      if (!pl->Stopped)
+         Html_preload_url(pl, url, WEB_Image);
+      a_Url_free(url);
+   }
+}
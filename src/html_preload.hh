@@ -0,0 +1,16 @@
+#ifndef __HTML_PRELOAD_HH__
+#define __HTML_PRELOAD_HH__
+
+class DilloHtml;
+
+/*
+ * Preload scanner
+ */
+typedef struct HtmlPreload HtmlPreload;
+
+HtmlPreload *a_Html_preload_new(DilloHtml *html);
+void a_Html_preload_free(HtmlPreload *pl);
+void a_Html_preload_scan(HtmlPreload *pl, const char *buf, int bufsize,
+                         int eof);
+
+#endif /* __HTML_PRELOAD_HH__ */
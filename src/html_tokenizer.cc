@@ -0,0 +1,720 @@
+/*
+ * File: html_tokenizer.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The HTML lexer: it splits the page's data into tokens (whitespace,
+ * words, tags, comments and verbatim text) for the parser in html.cc.
+ *
+ * With D_HTML_THREADED, a worker thread runs it ahead of the parser:
+ * the main thread hands the new data over, and gets back the tokens, with
+ * the attributes of the tags already split, from a ring that needs no
+ * locking. Whether a tag turns the parser to verbatim mode is decided by
+ * its handler, so the worker guesses it (SCRIPT, STYLE and TEXTAREA), and
+ * the parser checks the guess.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef D_HTML_THREADED
+#include <pthread.h>
+#endif
+
+#include "../dlib/dlib.h"
+#include "msg.h"
+#include "html_tokenizer.hh"
+#include "IO/iowatch.hh"
+
+using namespace lout::misc;
+
+/*
+ * Scanners for the lexer. Each one returns the index of the first
+ * byte in buf[i..size) that ends what's being scanned, or 'size'.
+ * With SSE2, sixteen bytes are classified at a time.
+ */
+#ifdef __SSE2__
+/*
+ * 0xff for the bytes that are whitespace in the C locale.
+ */
+static inline __m128i Html_space_mask(__m128i v)
+{
+   __m128i t = _mm_sub_epi8(v, _mm_set1_epi8('\t'));  /* \t..\r -> 0..4 */
+
+   return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                       _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t));
+}
+#endif
+
+/*
+ * Skip whitespace.
+ */
+static inline int Html_skip_space(const char *buf, int i, int size)
+{
+#ifdef __SSE2__
+   for (; i + 16 <= size; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+      int mask = ~_mm_movemask_epi8(Html_space_mask(v)) & 0xffff;
+
+      if (mask)
+         return i + __builtin_ctz(mask);
+   }
+#endif
+   while (i < size && isspace(buf[i]))
+      ++i;
+   return i;
+}
+
+/*
+ * Find the end of a word: whitespace, '<' or a NULL byte.
+ */
+static inline int Html_word_end(const char *buf, int i, int size)
+{
+#ifdef __SSE2__
+   for (; i + 16 <= size; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+      __m128i m = _mm_or_si128(
+                     Html_space_mask(v),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('<')),
+                                  _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+      int mask = _mm_movemask_epi8(m);
+
+      if (mask)
+         return i + __builtin_ctz(mask);
+   }
+#endif
+   while (i < size && buf[i] && buf[i] != '<' && !isspace(buf[i]))
+      ++i;
+   return i;
+}
+
+/*
+ * Find any of four characters (they may be repeated).
+ */
+static inline int Html_find_any(const char *buf, int i, int size,
+                                char c1, char c2, char c3, char c4)
+{
+#ifdef __SSE2__
+   const __m128i v1 = _mm_set1_epi8(c1), v2 = _mm_set1_epi8(c2),
+                 v3 = _mm_set1_epi8(c3), v4 = _mm_set1_epi8(c4);
+
+   for (; i + 16 <= size; i += 16) {
+      __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+      __m128i m12 = _mm_or_si128(_mm_cmpeq_epi8(v, v1),
+                                 _mm_cmpeq_epi8(v, v2));
+      __m128i m34 = _mm_or_si128(_mm_cmpeq_epi8(v, v3),
+                                 _mm_cmpeq_epi8(v, v4));
+      __m128i m = _mm_or_si128(m12, m34);
+      int mask = _mm_movemask_epi8(m);
+
+      if (mask)
+         return i + __builtin_ctz(mask);
+   }
+#endif
+   for (; i < size; ++i)
+      if (buf[i] == c1 || buf[i] == c2 || buf[i] == c3 || buf[i] == c4)
+         break;
+   return i;
+}
+
+/*
+ * Find the '>' of a "-->", looking back at most two bytes before buf[i].
+ * Returns the index past it, or -1.
+ */
+static inline int Html_comment_end(const char *buf, int i, int size)
+{
+#ifdef __SSE2__
+   const __m128i gt = _mm_set1_epi8('>'), dash = _mm_set1_epi8('-');
+
+   for (; i + 16 <= size; i += 16) {
+      __m128i v0 = _mm_loadu_si128((const __m128i *)(buf + i));
+      __m128i v1 = _mm_loadu_si128((const __m128i *)(buf + i - 1));
+      __m128i v2 = _mm_loadu_si128((const __m128i *)(buf + i - 2));
+      __m128i m = _mm_and_si128(_mm_cmpeq_epi8(v0, gt),
+                                _mm_and_si128(_mm_cmpeq_epi8(v1, dash),
+                                              _mm_cmpeq_epi8(v2, dash)));
+      int mask = _mm_movemask_epi8(m);
+
+      if (mask)
+         return i + __builtin_ctz(mask) + 1;
+   }
+#endif
+   for (; i < size; ++i)
+      if (buf[i] == '>' && buf[i-1] == '-' && buf[i-2] == '-')
+         return i + 1;
+   return -1;
+}
+
+/*
+ * Does the tag in tagstr (e.g. "p") match the tag in the tag, tagsize
+ * structure, with the initial < skipped over (e.g. "P align=center>")?
+ */
+static bool Html_match_tag(const char *tagstr, const char *tag, int tagsize)
+{
+   int i;
+
+   for (i = 0; i < tagsize && tagstr[i] != '\0'; i++) {
+      if (D_ASCII_TOLOWER(tagstr[i]) != D_ASCII_TOLOWER(tag[i]))
+         return false;
+   }
+   /* The test for '/' is for xml compatibility: "empty/>" will be matched. */
+   if (i < tagsize && (isspace(tag[i]) || tag[i] == '>' || tag[i] == '/'))
+      return true;
+   return false;
+}
+
+/*
+ * Is there the closing tag of the verbatim element 'verbatim' at buf[i]?
+ */
+bool a_Html_lex_verbatim_end(const char *buf, int i, int size,
+                             const char *verbatim)
+{
+   int len = strlen(verbatim);
+
+   return (i + len + 3 <= size && strncmp(buf + i, "</", 2) == 0 &&
+           Html_match_tag(verbatim, buf + i + 2, len + 1));
+}
+
+/*
+ * Get the token starting at buf[start]. 'buf' must be NUL-terminated.
+ * 'verbatim' is the element whose content is being read (or NULL), and
+ * 'eof' tells there's no more data to come.
+ * Return value: 1 for a token, 0 when more data is needed to get it.
+ */
+int a_Html_lex(const char *buf, int start, int size, int eof,
+               const char *verbatim, HtmlToken *tk)
+{
+   int i = start;
+   char ch;
+
+   if (i >= size)
+      return 0;
+
+   tk->flags = 0;
+   tk->start = start;
+   tk->attr = 0;
+   tk->nattrs = -1;
+
+   if (verbatim && !a_Html_lex_verbatim_end(buf, i, size, verbatim)) {
+      /* Non HTML code here, let's skip until closing tag */
+      int len = strlen(verbatim);
+
+      do {
+         i = Html_find_any(buf, i, size, '<', '<', '<', '<');
+         if (i + len + 3 > size) {
+            return 0;
+         } else if (a_Html_lex_verbatim_end(buf, i, size, verbatim)) {
+            tk->type = HTML_TK_VERBATIM;
+            tk->end = i;
+            return 1;
+         }
+      } while (++i < size);
+      return 0;
+   }
+
+   if (isspace(buf[i])) {
+      /* whitespace: group all available whitespace */
+      tk->type = HTML_TK_SPACE;
+      tk->end = Html_skip_space(buf, i + 1, size);
+      return 1;
+
+   } else if (buf[i] == '<' && (ch = buf[i + 1]) &&
+              (isalpha(ch) || strchr("/!?", ch))) {
+      if (i + 3 < size && !strncmp(buf + i, "<!--", 4)) {
+         /* Comment: search for close of comment, skipping over
+          * everything except a matching "-->" tag. ("<!-->" is one) */
+         if ((tk->end = Html_comment_end(buf, i + 4, size)) == -1)
+            return 0;
+         tk->type = HTML_TK_COMMENT;
+         return 1;
+      }
+
+      /* Tag: search end of tag (skipping over quoted strings) */
+      while (i < size) {
+         i = Html_find_any(buf, i + 1, size, '>', '"', '\'', '<');
+         if ((ch = buf[i]) == '>') {
+            break;
+         } else if (ch == '"' || ch == '\'') {
+            /* Skip over quoted string */
+            i = Html_find_any(buf, i + 1, size, ch, '>', 0, 0);
+            if (buf[i] == '>') {
+               /* Unterminated string value? Let's look ahead and test:
+                * (<: unterminated, closing-quote: terminated) */
+               int offset = Html_find_any(buf, i + 1, size, ch, '<', 0, 0);
+               if (buf[offset] == ch || !buf[offset]) {
+                  i = offset;
+               } else {
+                  tk->flags |= HTML_TK_UNTERMINATED_VALUE;
+                  break;
+               }
+            }
+         } else if (ch == '<') {
+            /* unterminated tag detected */
+            tk->flags |= HTML_TK_UNTERMINATED_TAG;
+            --i;
+            break;
+         }
+      }
+      if (i >= size)
+         return 0;
+      tk->type = HTML_TK_TAG;
+      tk->end = i + 1;
+      return 1;
+   }
+
+   /* A Word: search for whitespace or tag open */
+   while (++i < size) {
+      i = Html_word_end(buf, i, size);
+      if (buf[i] == '<' && i + 1 == size && !eof)
+         return 0;              /* it may be a tag */
+      if (buf[i] == '<' && (ch = buf[i + 1]) &&
+          !isalpha(ch) && !strchr("/!?", ch))
+         continue;
+      break;
+   }
+   if (i >= size && !eof)
+      return 0;
+   tk->type = HTML_TK_WORD;
+   tk->end = i;
+   return 1;
+}
+
+/*
+ * Hash of an attribute name, ignoring case.
+ */
+uint_t a_Html_attr_hash(const char *name, int len)
+{
+   uint_t hash = 0;
+
+   for (int i = 0; i < len; i++)
+      hash = hash * 31 + D_ASCII_TOLOWER(name[i]);
+   return hash;
+}
+
+/*
+ * Split the attributes of a tag into 'attrs'.
+ * Values are kept as spans of the tag, and decoded when they're looked up.
+ */
+void a_Html_split_attrs(SimpleVector<DilloHtmlAttr> *attrs,
+                        const char *tag, int tagsize)
+{
+   int i, name, value, delimiter;
+   bool nul;
+   DilloHtmlAttr *attr;
+
+   attrs->setSize(0);
+
+   /* skip the element name */
+   for (i = 1; i < tagsize && !isspace(tag[i]) && tag[i] != '='; ++i) ;
+
+   while (i < tagsize) {
+      attr = NULL;
+      if (isspace(tag[i])) {
+         ++i;
+         continue;
+      } else if (tag[i] != '=') {
+         nul = !tag[i];
+         for (name = i++; i < tagsize && tag[i] != '=' && tag[i] != '>' &&
+                        !isspace(tag[i]); ++i)
+            nul |= !tag[i];
+
+         attrs->increase();
+         attr = attrs->getRef(attrs->size() - 1);
+         attr->name = name;
+         /* NULL bytes are not allowed: such a name is never found */
+         attr->name_len = nul ? 0 : i - name;
+         attr->hash = a_Html_attr_hash(tag + name, attr->name_len);
+         attr->value = attr->value_end = -1;
+
+         while (i < tagsize && isspace(tag[i]))
+            ++i;
+         if (i == tagsize || tag[i] != '=')
+            continue;
+      }
+
+      /* tag[i] is '=' */
+      for (++i; i < tagsize && isspace(tag[i]); ++i) ;
+      if (i == tagsize)
+         break;
+      delimiter = (tag[i] == '"' || tag[i] == '\'') ? tag[i++] : ' ';
+      for (value = i; i < tagsize; ++i)
+         if (delimiter == ' ' ? (isspace(tag[i]) || tag[i] == '>') :
+                                tag[i] == delimiter)
+            break;
+      if (attr) {
+         attr->value = value;
+         attr->value_end = i;
+      }
+      ++i;
+   }
+}
+
+/* The elements whose handlers switch the parser to verbatim mode */
+static const char *const Html_verbatim_tags[] = {
+   "script", "style", "textarea"
+};
+
+/*
+ * Guess whether the tag opens an element with verbatim content (its
+ * handler decides it). Return the element's name, or NULL.
+ */
+const char *a_Html_lex_verbatim_start(const char *tag, int tagsize)
+{
+   uint_t i;
+
+   if (tag[1] != '/')
+      for (i = 0; i < sizeof(Html_verbatim_tags) / sizeof(char *); i++)
+         if (Html_match_tag(Html_verbatim_tags[i], tag + 1, tagsize - 1))
+            return Html_verbatim_tags[i];
+   return NULL;
+}
+
+#ifdef D_HTML_THREADED
+
+#define HTML_TK_RING   4096     /* Tokens in the ring */
+#define HTML_TK_ATTRS  8192     /* Attributes in the ring */
+
+/* Each side of a ring stores its own counter, and loads the other's */
+#define HTML_TK_LOAD(p)      __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define HTML_TK_STORE(p, v)  __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+struct HtmlTokenizer {
+   HtmlTokenizerCb_t cb;        /* Called when there are new tokens */
+   void *cbdata;
+
+   /* Only touched by the main thread */
+   int Fed;                     /* Bytes handed over */
+   uint_t NotifiedHead;         /* Head when cb was last called */
+   bool_t NotifiedDone;         /* cb has been called for Done */
+
+   /* The rings. Head and Tail count the tokens (attributes) ever written
+    * by the worker and read by the main thread. */
+   HtmlToken Tokens[HTML_TK_RING];
+   DilloHtmlAttr Attrs[HTML_TK_ATTRS];
+   uint_t Head, Tail;
+   uint_t AttrHead, AttrTail;
+
+   /* Shared, guarded by html_tk_mutex */
+   Dstr *Input;                 /* Data handed over, not yet tokenized */
+   bool_t Completed;            /* No more data will come */
+   bool_t Busy;                 /* The worker is tokenizing it */
+   bool_t Full;                 /* The worker stopped on a full ring */
+   bool_t Done;                 /* All the data has been tokenized */
+
+   /* Only touched by the worker */
+   Dstr *Data;                  /* All the data handed over */
+   int ScanOfs;                 /* Where the next token starts */
+   const char *Verbatim;        /* The element whose content is read */
+};
+
+static bool_t html_tk_init_done = FALSE;
+static bool_t html_tk_threaded = FALSE;
+static pthread_mutex_t html_tk_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t html_tk_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t html_tk_idle_cond = PTHREAD_COND_INITIALIZER;
+static Dlist *html_tk_live;           /* Live tokenizers (main thread) */
+static Dlist *html_tk_run_queue;      /* Tokenizers with pending input */
+static int html_tk_notify_pipe[2];
+
+/* Worker side ------------------------------------------------------------ */
+
+/*
+ * Tokenize the data until more is needed, or the ring is full.
+ * Return value: the number of tokens written; 'full' tells which.
+ */
+static int Html_tokenizer_run(HtmlTokenizer *tkz, int eof, bool_t *full,
+                              SimpleVector<DilloHtmlAttr> *attrs)
+{
+   const char *buf = tkz->Data->str;
+   HtmlToken tk;
+   uint_t head = tkz->Head;
+   int i, n = 0;
+
+   *full = FALSE;
+   while (1) {
+      if (head - HTML_TK_LOAD(&tkz->Tail) == HTML_TK_RING) {
+         *full = TRUE;
+         break;
+      }
+      if (!a_Html_lex(buf, tkz->ScanOfs, tkz->Data->len, eof, tkz->Verbatim,
+                      &tk))
+         break;
+
+      if (tk.type == HTML_TK_TAG) {
+         a_Html_split_attrs(attrs, buf + tk.start, tk.end - tk.start);
+         if (attrs->size() <= HTML_TK_ATTRS) {
+            if (tkz->AttrHead + attrs->size() - HTML_TK_LOAD(&tkz->AttrTail)
+                > HTML_TK_ATTRS) {
+               *full = TRUE;
+               break;
+            }
+            tk.attr = tkz->AttrHead;
+            tk.nattrs = attrs->size();
+            for (i = 0; i < attrs->size(); i++)
+               tkz->Attrs[(tkz->AttrHead + i) % HTML_TK_ATTRS] =
+                  attrs->get(i);
+            tkz->AttrHead += attrs->size();
+         }
+         tkz->Verbatim = a_Html_lex_verbatim_start(buf + tk.start,
+                                                   tk.end - tk.start);
+      } else if (tk.type == HTML_TK_VERBATIM) {
+         tkz->Verbatim = NULL;
+      }
+
+      tkz->Tokens[head % HTML_TK_RING] = tk;
+      HTML_TK_STORE(&tkz->Head, ++head);
+      tkz->ScanOfs = tk.end;
+      ++n;
+   }
+   return n;
+}
+
+/*
+ * Tokenizer thread: tokenize the queued data, one tokenizer at a time.
+ * Every pass that produces tokens ends with a single notification.
+ */
+static void *Html_tokenizer_worker(void *data)
+{
+   SimpleVector<DilloHtmlAttr> attrs(16);
+   HtmlTokenizer *tkz;
+   bool_t full, eof;
+   int n;
+
+   pthread_mutex_lock(&html_tk_mutex);
+   while (1) {
+      while (!(tkz = (HtmlTokenizer *)dList_nth_data(html_tk_run_queue, 0)))
+         pthread_cond_wait(&html_tk_work_cond, &html_tk_mutex);
+      dList_remove(html_tk_run_queue, tkz);
+      dStr_append_l(tkz->Data, tkz->Input->str, tkz->Input->len);
+      dStr_truncate(tkz->Input, 0);
+      eof = tkz->Completed;
+      tkz->Busy = TRUE;
+      pthread_mutex_unlock(&html_tk_mutex);
+
+      n = Html_tokenizer_run(tkz, eof, &full, &attrs);
+
+      pthread_mutex_lock(&html_tk_mutex);
+      tkz->Busy = FALSE;
+      tkz->Full = full;
+      if (eof && !full && tkz->Input->len == 0)
+         tkz->Done = TRUE;
+      pthread_cond_broadcast(&html_tk_idle_cond);
+      if (n > 0 || tkz->Done)
+         write(html_tk_notify_pipe[1], ".", 1);
+   }
+   return NULL;                 /* (avoids a compiler warning) */
+}
+
+/* Main thread side ------------------------------------------------------- */
+
+/*
+ * Read the worker's notifications, and let the parsers whose tokenizers
+ * have new tokens (or are done) take them.
+ */
+static void Html_tokenizer_notify_cb(int fd, void *data)
+{
+   char buf[16];
+   HtmlTokenizer *tkz;
+   uint_t head;
+   bool_t done;
+   int i;
+
+   while (read(html_tk_notify_pipe[0], buf, sizeof(buf)) > 0);
+
+   /* A parser may free its tokenizer from the callback */
+   for (i = dList_length(html_tk_live) - 1; i >= 0; --i) {
+      if (!(tkz = (HtmlTokenizer *)dList_nth_data(html_tk_live, i)))
+         continue;
+      head = HTML_TK_LOAD(&tkz->Head);
+      pthread_mutex_lock(&html_tk_mutex);
+      done = tkz->Done;
+      pthread_mutex_unlock(&html_tk_mutex);
+      if (head != tkz->NotifiedHead || done != tkz->NotifiedDone) {
+         tkz->NotifiedHead = head;
+         tkz->NotifiedDone = done;
+         tkz->cb(tkz->cbdata);
+      }
+   }
+}
+
+/*
+ * Start the tokenizer thread (tokenizing stays synchronous if it fails,
+ * or if there's a single CPU)
+ */
+static void Html_tokenizer_init(void)
+{
+   pthread_attr_t thrATTR;
+   pthread_t th;
+
+   html_tk_init_done = TRUE;
+   if (sysconf(_SC_NPROCESSORS_ONLN) < 2) {
+      /* With a single CPU, the thread would only add overhead */
+      return;
+   }
+   if (pipe(html_tk_notify_pipe) < 0) {
+      MSG("Html_tokenizer_init: pipe failed, tokenizing in the main thread\n");
+      return;
+   }
+   fcntl(html_tk_notify_pipe[0], F_SETFL, O_NONBLOCK);
+   /* a full pipe already has a notification pending */
+   fcntl(html_tk_notify_pipe[1], F_SETFL, O_NONBLOCK);
+
+   html_tk_live = dList_new(4);
+   html_tk_run_queue = dList_new(4);
+
+   pthread_attr_init(&thrATTR);
+   pthread_attr_setdetachstate(&thrATTR, PTHREAD_CREATE_DETACHED);
+   if (pthread_create(&th, &thrATTR, Html_tokenizer_worker, NULL) == 0) {
+      html_tk_threaded = TRUE;
+      a_IOwatch_add_fd(html_tk_notify_pipe[0], DIO_READ,
+                       Html_tokenizer_notify_cb, NULL);
+   } else {
+      MSG("Html_tokenizer_init: no thread, tokenizing in the main thread\n");
+      dClose(html_tk_notify_pipe[0]);
+      dClose(html_tk_notify_pipe[1]);
+   }
+   pthread_attr_destroy(&thrATTR);
+}
+
+/*
+ * Create a tokenizer; 'cb' is called with 'data' when it has new tokens.
+ * Return value: NULL if there's no tokenizer thread.
+ */
+HtmlTokenizer *a_Html_tokenizer_new(HtmlTokenizerCb_t cb, void *data)
+{
+   HtmlTokenizer *tkz;
+
+   if (!html_tk_init_done)
+      Html_tokenizer_init();
+   if (!html_tk_threaded)
+      return NULL;
+
+   tkz = dNew0(HtmlTokenizer, 1);
+   tkz->cb = cb;
+   tkz->cbdata = data;
+   tkz->Input = dStr_sized_new(8 * 1024);
+   tkz->Data = dStr_sized_new(8 * 1024);
+   dList_append(html_tk_live, tkz);
+   return tkz;
+}
+
+/*
+ * Stop tokenizing, and free the tokenizer.
+ */
+void a_Html_tokenizer_free(HtmlTokenizer *tkz)
+{
+   dReturn_if (tkz == NULL);
+
+   pthread_mutex_lock(&html_tk_mutex);
+   dList_remove(html_tk_run_queue, tkz);
+   while (tkz->Busy)
+      pthread_cond_wait(&html_tk_idle_cond, &html_tk_mutex);
+   pthread_mutex_unlock(&html_tk_mutex);
+
+   dList_remove(html_tk_live, tkz);
+   dStr_free(tkz->Input, 1);
+   dStr_free(tkz->Data, 1);
+   dFree(tkz);
+}
+
+/*
+ * Hand the data in buf[0..size) that's new over to the worker ('eof' when
+ * it's all), and restart it if it was waiting for room in the ring.
+ */
+void a_Html_tokenizer_feed(HtmlTokenizer *tkz, const char *buf, int size,
+                           int eof)
+{
+   bool_t run;
+
+   pthread_mutex_lock(&html_tk_mutex);
+   run = (size > tkz->Fed || tkz->Full || (eof && !tkz->Completed));
+   if (size > tkz->Fed) {
+      dStr_append_l(tkz->Input, buf + tkz->Fed, size - tkz->Fed);
+      tkz->Fed = size;
+   }
+   tkz->Completed |= (eof != 0);
+   if (run && !tkz->Done) {
+      tkz->Full = FALSE;
+      if (!dList_find(html_tk_run_queue, tkz))
+         dList_append(html_tk_run_queue, tkz);
+      pthread_cond_signal(&html_tk_work_cond);
+   }
+   pthread_mutex_unlock(&html_tk_mutex);
+}
+
+/*
+ * Return the next token, or NULL if there's none yet.
+ */
+const HtmlToken *a_Html_tokenizer_peek(HtmlTokenizer *tkz)
+{
+   if (tkz->Tail == HTML_TK_LOAD(&tkz->Head))
+      return NULL;
+   return &tkz->Tokens[tkz->Tail % HTML_TK_RING];
+}
+
+/*
+ * Copy the attributes of the tag 'tk', the token from peek(), to 'attrs'.
+ */
+void a_Html_tokenizer_get_attrs(HtmlTokenizer *tkz, const HtmlToken *tk,
+                                SimpleVector<DilloHtmlAttr> *attrs)
+{
+   attrs->setSize(tk->nattrs);
+   for (int i = 0; i < tk->nattrs; i++)
+      attrs->set(i, tkz->Attrs[(tk->attr + i) % HTML_TK_ATTRS]);
+}
+
+/*
+ * Done with the token from peek(): give its room back to the worker.
+ */
+void a_Html_tokenizer_next(HtmlTokenizer *tkz)
+{
+   const HtmlToken *tk = &tkz->Tokens[tkz->Tail % HTML_TK_RING];
+
+   if (tk->type == HTML_TK_TAG && tk->nattrs >= 0)
+      HTML_TK_STORE(&tkz->AttrTail, tk->attr + tk->nattrs);
+   HTML_TK_STORE(&tkz->Tail, tkz->Tail + 1);
+
+   /* Once half of the ring is free, a worker that filled it may go on */
+   if (tkz->Tail % (HTML_TK_RING / 2) == 0)
+      a_Html_tokenizer_feed(tkz, NULL, tkz->Fed, 0);
+}
+
+/*
+ * Have all the tokens been taken, with no more data to come?
+ */
+bool a_Html_tokenizer_done(HtmlTokenizer *tkz)
+{
+   bool_t done;
+
+   pthread_mutex_lock(&html_tk_mutex);
+   done = tkz->Done;
+   pthread_mutex_unlock(&html_tk_mutex);
+   return done && a_Html_tokenizer_peek(tkz) == NULL;
+}
+
+#else /* D_HTML_THREADED */
+
+HtmlTokenizer *a_Html_tokenizer_new(HtmlTokenizerCb_t cb, void *data)
+{
+   return NULL;
+}
+
+void a_Html_tokenizer_free(HtmlTokenizer *tkz) {}
+void a_Html_tokenizer_feed(HtmlTokenizer *tkz, const char *buf, int size,
+                           int eof) {}
+const HtmlToken *a_Html_tokenizer_peek(HtmlTokenizer *tkz) { return NULL; }
+void a_Html_tokenizer_get_attrs(HtmlTokenizer *tkz, const HtmlToken *tk,
+                                SimpleVector<DilloHtmlAttr> *attrs) {}
+void a_Html_tokenizer_next(HtmlTokenizer *tkz) {}
+bool a_Html_tokenizer_done(HtmlTokenizer *tkz) { return true; }
+
+#endif /* D_HTML_THREADED */
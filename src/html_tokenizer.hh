@@ -0,0 +1,61 @@
+#ifndef __HTML_TOKENIZER_HH__
+#define __HTML_TOKENIZER_HH__
+
+#include "d_size.h"
+#include "lout/misc.hh"
+
+/*
+ * An attribute of the tag being processed, as offsets into the tag.
+ */
+typedef struct {
+   uint_t hash;         /* of the lowercased name */
+   int name, name_len;
+   int value, value_end; /* value is -1 when there's none */
+} DilloHtmlAttr;
+
+typedef enum {
+   HTML_TK_SPACE,       /* a run of whitespace */
+   HTML_TK_WORD,
+   HTML_TK_TAG,
+   HTML_TK_COMMENT,
+   HTML_TK_VERBATIM     /* the content of SCRIPT, STYLE or TEXTAREA */
+} HtmlTokenType;
+
+/* Flags for the tags the lexer had to repair */
+#define HTML_TK_UNTERMINATED_VALUE  1  /* an attribute lacks its quote */
+#define HTML_TK_UNTERMINATED_TAG    2  /* the tag lacks its '>' */
+
+typedef struct {
+   HtmlTokenType type;
+   int flags;
+   int start, end;      /* offsets in the page's data */
+   uint_t attr;         /* HTML_TK_TAG: the first of its attributes */
+   int nattrs;          /*  in the tokenizer's table (-1: not split) */
+} HtmlToken;
+
+int a_Html_lex(const char *buf, int start, int size, int eof,
+               const char *verbatim, HtmlToken *tk);
+const char *a_Html_lex_verbatim_start(const char *tag, int tagsize);
+bool a_Html_lex_verbatim_end(const char *buf, int i, int size,
+                             const char *verbatim);
+uint_t a_Html_attr_hash(const char *name, int len);
+void a_Html_split_attrs(lout::misc::SimpleVector<DilloHtmlAttr> *attrs,
+                        const char *tag, int tagsize);
+
+/*
+ * Background tokenizer (D_HTML_THREADED)
+ */
+typedef struct HtmlTokenizer HtmlTokenizer;
+typedef void (*HtmlTokenizerCb_t)(void *data);
+
+HtmlTokenizer *a_Html_tokenizer_new(HtmlTokenizerCb_t cb, void *data);
+void a_Html_tokenizer_free(HtmlTokenizer *tkz);
+void a_Html_tokenizer_feed(HtmlTokenizer *tkz, const char *buf, int size,
+                           int eof);
+const HtmlToken *a_Html_tokenizer_peek(HtmlTokenizer *tkz);
+void a_Html_tokenizer_get_attrs(HtmlTokenizer *tkz, const HtmlToken *tk,
+                               lout::misc::SimpleVector<DilloHtmlAttr> *attrs);
+void a_Html_tokenizer_next(HtmlTokenizer *tkz);
+bool a_Html_tokenizer_done(HtmlTokenizer *tkz);
+
+#endif /* __HTML_TOKENIZER_HH__ */
@@ -18,6 +18,7 @@
 #include "msg.h"
 
 #include "image.hh"
+#include "timeout.hh"
 #include "dw/core.hh"
 #include "dw/image.hh"
 
@@ -26,6 +27,13 @@ using namespace dw::core;
 // Image to Object-ImgRenderer macro
 #define I2IR(Image)  ((dw::core::ImgRenderer*)(Image->img_rndr))
 
+/*
+ * Written rows are drawn once per frame, as a single area per image.
+ */
+#define IMAGE_DRAW_FRAME  (1.0 / 30)
+
+static Dlist *ImagesToDraw = NULL;   /* Images with rows to draw */
+
 
 /*
  * Create and initialize a new image structure.
@@ -40,7 +48,10 @@ DilloImage *a_Image_new(void *layout, void *img_rndr, int32_t bg_color)
    Image->width = 0;
    Image->height = 0;
    Image->bg_color = bg_color;
+   Image->display_width = 0;
+   Image->display_height = 0;
    Image->ScanNumber = 0;
+   Image->DrawFrom = Image->DrawTo = 0;
    Image->BitVec = NULL;
    Image->State = IMG_Empty;
 
@@ -69,11 +80,37 @@ void *a_Image_get_dw(DilloImage *Image)
 {
    return (dw::Image*)(dw::core::ImgRenderer*)Image->img_rndr;
 }
+
+/*
+ * Draw the rows written since the last frame.
+ */
+static void Image_draw_rows(DilloImage *Image)
+{
+   if (Image->DrawFrom < Image->DrawTo) {
+      I2IR(Image)->drawRows(Image->DrawFrom, Image->DrawTo - 1);
+      Image->DrawFrom = Image->DrawTo = 0;
+      dList_remove(ImagesToDraw, Image);
+   }
+}
+
+/*
+ * Timeout callback: a frame has passed, draw the images.
+ */
+static void Image_draw_frame_cb(void *data)
+{
+   DilloImage *Image;
+
+   while ((Image = (DilloImage *)dList_nth_data(ImagesToDraw, 0)))
+      Image_draw_rows(Image);
+}
+
 /*
  * Deallocate an Image structure
  */
 static void Image_free(DilloImage *Image)
 {
+   if (Image->DrawFrom < Image->DrawTo)
+      dList_remove(ImagesToDraw, Image);
    a_Bitvec_free(Image->BitVec);
    dFree(Image);
 }
@@ -109,6 +146,9 @@ void a_Image_set_parms(DilloImage *Image, void *v_imgbuf, DilloUrl *url,
    _MSG("a_Image_set_parms: width=%d height=%d iw=%d ih=%d\n",
         width, height, Image->width, Image->height);
 
+   /* Pending rows belong to the old buffer */
+   Image_draw_rows(Image);
+
    /* Resize from 0,0 to width,height */
    bool resize = true;
    I2IR(Image)->setBuffer((Imgbuf*)v_imgbuf, resize);
@@ -128,8 +168,19 @@ void a_Image_write(DilloImage *Image, uint_t y)
    _MSG("a_Image_write\n");
    dReturn_if_fail ( y < Image->height );
 
-   /* Update the row in DwImage */
-   I2IR(Image)->drawRow(y);
+   /* Queue the row for DwImage; it's drawn with the next frame */
+   if (Image->DrawFrom < Image->DrawTo) {
+      Image->DrawFrom = MIN(Image->DrawFrom, y);
+      Image->DrawTo = MAX(Image->DrawTo, y + 1);
+   } else {
+      if (!ImagesToDraw)
+         ImagesToDraw = dList_new(8);
+      if (dList_length(ImagesToDraw) == 0)
+         a_Timeout_add(IMAGE_DRAW_FRAME, Image_draw_frame_cb, NULL);
+      dList_append(ImagesToDraw, Image);
+      Image->DrawFrom = y;
+      Image->DrawTo = y + 1;
+   }
    a_Bitvec_set_bit(Image->BitVec, y);
    Image->State = IMG_Write;
 }
@@ -140,6 +191,7 @@ void a_Image_write(DilloImage *Image, uint_t y)
 void a_Image_close(DilloImage *Image)
 {
    _MSG("a_Image_close\n");
+   Image_draw_rows(Image);
    I2IR(Image)->finish();
 }
 
@@ -149,6 +201,7 @@ void a_Image_close(DilloImage *Image)
 void a_Image_abort(DilloImage *Image)
 {
    _MSG("a_Image_abort\n");
+   Image_draw_rows(Image);
    I2IR(Image)->fatal();
 }
 
@@ -51,8 +51,11 @@ struct _DilloImage {
    uint_t height;
 
    int32_t bg_color;        /* Background color */
+   uint_t display_width;    /* Size requested by the page, */
+   uint_t display_height;   /* zero when it depends on the image */
    bitvec_t *BitVec;        /* Bit vector for decoded rows */
    uint_t ScanNumber;       /* Current decoding scan */
+   uint_t DrawFrom, DrawTo; /* Rows written but not drawn yet (if From<To) */
    ImageState State;        /* Processing status */
 
    int RefCount;            /* Reference counter */
@@ -9,6 +9,11 @@
  * (at your option) any later version.
  */
 
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "msg.h"
 #include "imgbuf.hh"
 #include "dw/core.hh"
@@ -17,50 +22,76 @@
 using namespace dw::core;
 
 /*
- * Local data
+ * Scale a color channel by the "white" one: c * w / 255, rounded.
+ * (a fixed-point multiply; t + (t >> 8) stays within 16 bits)
  */
-static size_t linebuf_size = 0;
-static uchar_t *linebuf = NULL;
-
+#define IMGBUF_SCALE(c, w) \
+   ((((c) * (w) + 128) + (((c) * (w) + 128) >> 8)) >> 8)
 
 /*
- * Decode 'buf' (an image line) into RGB format.
+ * Convert a line of CMYK_INV pixels into RGB.
+ *
+ * We treat CMYK as if it were "RGBW", and it works. Everyone who is
+ * trying to handle CMYK jpegs is confused by this, and supposedly
+ * the issue is that Adobe CMYK is "wrong" but ubiquitous.
  */
-static uchar_t *Imgbuf_rgb_line(const uchar_t *buf,
-                                DilloImgType type, uchar_t *cmap,
-                                uint_t width, uint_t y)
+static void Imgbuf_cmyk_inv_line(const uchar_t *buf, uchar_t *linebuf,
+                                 uint_t width)
 {
-   uint_t x;
+   uint_t x = 0;
+
+#ifdef __SSE2__
+   /* Four pixels at a time, in 16 bit lanes. The results are written as
+    * RGBW words, each one overlapping the next pixel; so the loop stops
+    * before the last pixel, which would overflow 'linebuf'. */
+   const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi16(128);
+   uchar_t rgbw[16];
+
+   for (; x + 4 < width; x += 4) {
+      __m128i in = _mm_loadu_si128((const __m128i *)(buf + 4 * x));
+      __m128i lo = _mm_unpacklo_epi8(in, zero);
+      __m128i hi = _mm_unpackhi_epi8(in, zero);
+      __m128i wlo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xff), 0xff);
+      __m128i whi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xff), 0xff);
+
+      lo = _mm_add_epi16(_mm_mullo_epi16(lo, wlo), round);
+      hi = _mm_add_epi16(_mm_mullo_epi16(hi, whi), round);
+      lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+      hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+      _mm_storeu_si128((__m128i *)rgbw, _mm_packus_epi16(lo, hi));
+      memcpy(linebuf + 3 * x, rgbw, 4);
+      memcpy(linebuf + 3 * x + 3, rgbw + 4, 4);
+      memcpy(linebuf + 3 * x + 6, rgbw + 8, 4);
+      memcpy(linebuf + 3 * x + 9, rgbw + 12, 4);
+   }
+#endif
+   for (; x < width; x++) {
+      uint_t white = buf[x * 4 + 3];
+      linebuf[x * 3] = IMGBUF_SCALE(buf[x * 4], white);
+      linebuf[x * 3 + 1] = IMGBUF_SCALE(buf[x * 4 + 1], white);
+      linebuf[x * 3 + 2] = IMGBUF_SCALE(buf[x * 4 + 2], white);
+   }
+}
 
+/*
+ * Decode 'buf' (an image line) into the imgbuf's format.
+ * Indexed and gray lines are kept at one byte per pixel; the imgbuf
+ * expands them when drawing. 'linebuf' has room for 3 * width bytes.
+ */
+static const uchar_t *Imgbuf_rgb_line(const uchar_t *buf,
+                                      DilloImgType type,
+                                      uint_t width, uchar_t *linebuf)
+{
    switch (type) {
    case DILLO_IMG_TYPE_INDEXED:
-      if (cmap) {
-         for (x = 0; x < width; x++)
-            memcpy(linebuf + x * 3, cmap + buf[x] * 3, 3);
-      } else {
-         MSG_WARN("Gif:: image lacks a color map\n");
-      }
-      break;
    case DILLO_IMG_TYPE_GRAY:
-      for (x = 0; x < width; x++)
-         memset(linebuf + x * 3, buf[x], 3);
-      break;
+      return buf;
    case DILLO_IMG_TYPE_CMYK_INV:
-      /*
-       * We treat CMYK as if it were "RGBW", and it works. Everyone who is
-       * trying to handle CMYK jpegs is confused by this, and supposedly
-       * the issue is that Adobe CMYK is "wrong" but ubiquitous.
-       */
-      for (x = 0; x < width; x++) {
-         uint_t white = buf[x * 4 + 3];
-         linebuf[x * 3] = buf[x * 4] * white / 0x100;
-         linebuf[x * 3 + 1] = buf[x * 4 + 1] * white / 0x100;
-         linebuf[x * 3 + 2] = buf[x * 4 + 2] * white / 0x100;
-      }
+      Imgbuf_cmyk_inv_line(buf, linebuf, width);
       break;
    case DILLO_IMG_TYPE_RGB:
       /* avoid a memcpy here!  --Jcid */
-      return (uchar_t *)buf;
+      return buf;
    case DILLO_IMG_TYPE_NOTSET:
       MSG_ERR("Imgbuf_rgb_line: type not set...\n");
       break;
@@ -90,21 +121,27 @@ void a_Imgbuf_unref(void *v_imgbuf)
 /*
  * Create a new Imgbuf
  */
-void *a_Imgbuf_new(void *layout, int img_type, uint_t width, uint_t height,
-                   double gamma)
+void *a_Imgbuf_new(void *layout, DilloImgType img_type, uint_t width,
+                   uint_t height, double gamma)
 {
+   Imgbuf::Type type;
+
    if (!layout) {
       MSG_ERR("a_Imgbuf_new: layout is NULL.\n");
       exit(1);
    }
-   // Assert linebuf is wide enough.
-   if (3 * width > linebuf_size) {
-      linebuf_size = 3 * width;
-      linebuf = (uchar_t*) dRealloc(linebuf, linebuf_size);
+   switch (img_type) {
+   case DILLO_IMG_TYPE_INDEXED:
+      type = Imgbuf::INDEXED;
+      break;
+   case DILLO_IMG_TYPE_GRAY:
+      type = Imgbuf::GRAY;
+      break;
+   default:
+      type = Imgbuf::RGB;
+      break;
    }
-
-   return (void*)((Layout*)layout)->createImgbuf(Imgbuf::RGB, width, height,
-                                                 gamma);
+   return (void*)((Layout*)layout)->createImgbuf(type, width, height, gamma);
 }
 
 /*
@@ -115,18 +152,42 @@ int a_Imgbuf_last_reference(void *v_imgbuf)
    return ((Imgbuf*)v_imgbuf)->lastReference () ? 1 : 0;
 }
 
+/*
+ * Set the colormap of an indexed imgbuf ('cmap' holds red, green, blue).
+ */
+void a_Imgbuf_set_cmap(void *v_imgbuf, const uchar_t *cmap, uint_t num_colors)
+{
+   int colors[256];
+   uint_t i;
+
+   for (i = 0; i < num_colors && i < 256; i++)
+      colors[i] =
+         (cmap[3 * i] << 16) | (cmap[3 * i + 1] << 8) | cmap[3 * i + 2];
+   ((Imgbuf*)v_imgbuf)->setCMap(colors, (int)i);
+}
+
 /*
  * Update the root buffer of an imgbuf.
  */
 void a_Imgbuf_update(void *v_imgbuf, const uchar_t *buf, DilloImgType type,
-                     uchar_t *cmap, uint_t width, uint_t height, uint_t y)
+                     uint_t width, uint_t height, uint_t y)
 
 {
+   uchar_t stackbuf[3 * 1024], *linebuf = stackbuf;
+
    dReturn_if_fail ( y < height );
 
+   /* The line buffer belongs to this call, so decoders may run in any
+    * thread. Only converted lines need one. */
+   if (type == DILLO_IMG_TYPE_CMYK_INV && 3 * width > sizeof(stackbuf))
+      linebuf = dNew(uchar_t, 3 * width);
+
    /* Decode 'buf' and copy it into the imgbuf */
-   uchar_t *newbuf = Imgbuf_rgb_line(buf, type, cmap, width, y);
-   ((Imgbuf*)v_imgbuf)->copyRow(y, (byte *)newbuf);
+   const uchar_t *newbuf = Imgbuf_rgb_line(buf, type, width, linebuf);
+   ((Imgbuf*)v_imgbuf)->copyRow(y, (const byte *)newbuf);
+
+   if (linebuf != stackbuf)
+      dFree(linebuf);
 }
 
 /*
@@ -137,3 +198,27 @@ void a_Imgbuf_new_scan(void *v_imgbuf)
    ((Imgbuf*)v_imgbuf)->newScan();
 }
 
+/*
+ * Bytes held by the scaled copies of an imgbuf.
+ */
+size_t a_Imgbuf_scaled_size(void *v_imgbuf)
+{
+   return (size_t)((Imgbuf*)v_imgbuf)->getScaledSize();
+}
+
+/*
+ * When was the imgbuf last drawn? (larger is more recent)
+ */
+ulong_t a_Imgbuf_last_drawn(void *v_imgbuf)
+{
+   return ((Imgbuf*)v_imgbuf)->getLastDrawn();
+}
+
+/*
+ * Free the scaled copies' pixel data; they are scaled again when drawn.
+ * Return value: bytes freed.
+ */
+size_t a_Imgbuf_release_scaled(void *v_imgbuf)
+{
+   return (size_t)((Imgbuf*)v_imgbuf)->releaseScaled();
+}
@@ -16,12 +16,17 @@ extern "C" {
  */
 void a_Imgbuf_ref(void *v_imgbuf);
 void a_Imgbuf_unref(void *v_imgbuf);
-void *a_Imgbuf_new(void *v_ir, int img_type, uint_t width, uint_t height,
-                   double gamma);
+void *a_Imgbuf_new(void *v_ir, DilloImgType img_type, uint_t width,
+                   uint_t height, double gamma);
 int a_Imgbuf_last_reference(void *v_imgbuf);
+void a_Imgbuf_set_cmap(void *v_imgbuf, const uchar_t *cmap,
+                       uint_t num_colors);
 void a_Imgbuf_update(void *v_imgbuf, const uchar_t *buf, DilloImgType type,
-                     uchar_t *cmap, uint_t width, uint_t height, uint_t y);
+                     uint_t width, uint_t height, uint_t y);
 void a_Imgbuf_new_scan(void *v_imgbuf);
+size_t a_Imgbuf_scaled_size(void *v_imgbuf);
+ulong_t a_Imgbuf_last_drawn(void *v_imgbuf);
+size_t a_Imgbuf_release_scaled(void *v_imgbuf);
 
 #ifdef __cplusplus
 }
@@ -33,7 +33,6 @@
 #include "image.hh"
 #include "cache.h"
 #include "dicache.h"
-#include "capi.h"       /* get cache entry status */
 #include "msg.h"
 
 typedef enum {
@@ -65,6 +64,7 @@ struct DilloJpeg {
    DilloImage *Image;
    DilloUrl *url;
    int version;
+   uint_t req_width, req_height;  /* Display size (zero: unknown) */
 
    my_source_mgr Src;
 
@@ -184,7 +184,8 @@ static void term_source()
 {
 }
 
-void *a_Jpeg_new(DilloImage *Image, DilloUrl *url, int version)
+void *a_Jpeg_new(DilloImage *Image, DilloUrl *url, int version,
+                 uint_t req_width, uint_t req_height)
 {
    my_source_mgr *src;
    DilloJpeg *jpeg = dMalloc(sizeof(*jpeg));
@@ -193,6 +194,8 @@ void *a_Jpeg_new(DilloImage *Image, DilloUrl *url, int version)
    jpeg->Image = Image;
    jpeg->url = url;
    jpeg->version = version;
+   jpeg->req_width = req_width;
+   jpeg->req_height = req_height;
 
    jpeg->state = DILLO_JPEG_INIT;
    jpeg->Start_Ofs = 0;
@@ -234,6 +237,51 @@ void a_Jpeg_callback(int Op, void *data)
    }
 }
 
+/*
+ * Let libjpeg reduce the image by 1/2, 1/4 or 1/8 in the DCT when it will
+ * be displayed that small anyway (it's never reduced below the display
+ * size, so the imgbuf scales it down the rest of the way).
+ * This also sets the output dimensions.
+ */
+static void Jpeg_set_scale(DilloJpeg *jpeg)
+{
+   uint_t denom, w = jpeg->cinfo.image_width, h = jpeg->cinfo.image_height;
+
+   denom = 1;
+   if (jpeg->req_width || jpeg->req_height)
+      for (denom = 8; denom > 1; denom /= 2)
+         if ((w + denom - 1) / denom >= jpeg->req_width &&
+             (h + denom - 1) / denom >= jpeg->req_height)
+            break;
+   jpeg->cinfo.scale_num = 1;
+   jpeg->cinfo.scale_denom = denom;
+   jpeg_calc_output_dimensions(&jpeg->cinfo);
+   _MSG("Jpeg_set_scale: %ux%u -> 1/%u (%ux%u) for %ux%u\n", w, h, denom,
+        (uint_t)jpeg->cinfo.output_width, (uint_t)jpeg->cinfo.output_height,
+        jpeg->req_width, jpeg->req_height);
+}
+
+/*
+ * Start the output of a scan of a progressive jpeg. When the whole image
+ * is expected soon, the input is consumed up to the end instead, so that
+ * the final scan is the only one shown.
+ * Return value: FALSE when out of input.
+ */
+static bool_t Jpeg_begin_scan(DilloJpeg *jpeg)
+{
+   int ret;
+
+   if (a_Dicache_skip_passes(jpeg->url, jpeg->version)) {
+      while ((ret = jpeg_consume_input(&jpeg->cinfo)) != JPEG_REACHED_EOI)
+         if (ret == JPEG_SUSPENDED)
+            return FALSE;
+   }
+   if (!jpeg_start_output(&jpeg->cinfo, jpeg->cinfo.input_scan_number))
+      return FALSE;
+   a_Dicache_new_scan(jpeg->url, jpeg->version);
+   return TRUE;
+}
+
 /*
  * Receive and process new chunks of JPEG image data
  */
@@ -284,7 +332,7 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
           * use progressive display, updating as it arrives.
           */
          if (jpeg_has_multiple_scans(&jpeg->cinfo) &&
-             !(a_Capi_get_flags(jpeg->url) & CAPI_Completed))
+             !a_Dicache_data_complete(jpeg->url))
             jpeg->cinfo.buffered_image = TRUE;
 
          /* check max image size */
@@ -298,10 +346,12 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
             return;
          }
 
+         Jpeg_set_scale(jpeg);
+
          /** \todo Gamma for JPEG? */
          a_Dicache_set_parms(jpeg->url, jpeg->version, jpeg->Image,
-                             (uint_t)jpeg->cinfo.image_width,
-                             (uint_t)jpeg->cinfo.image_height,
+                             (uint_t)jpeg->cinfo.output_width,
+                             (uint_t)jpeg->cinfo.output_height,
                              type, 1 / 2.2);
          jpeg->Image = NULL; /* safeguard: may be freed by its owner later */
 
@@ -335,14 +385,12 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
    }
 
    if (jpeg->state == DILLO_JPEG_READ_BEGIN_SCAN) {
-      if (jpeg_start_output(&jpeg->cinfo, jpeg->cinfo.input_scan_number)) {
-         a_Dicache_new_scan(jpeg->url, jpeg->version);
+      if (Jpeg_begin_scan(jpeg))
          jpeg->state = DILLO_JPEG_READ_IN_SCAN;
-      }
    }
 
    if (jpeg->state == DILLO_JPEG_READ_IN_SCAN) {
-      linebuf = dMalloc(jpeg->cinfo.image_width *
+      linebuf = dMalloc(jpeg->cinfo.output_width *
                          jpeg->cinfo.num_components);
       array[0] = linebuf;
 
@@ -356,7 +404,7 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
 
          jpeg->y++;
 
-         if (jpeg->y == jpeg->cinfo.image_height) {
+         if (jpeg->y == jpeg->cinfo.output_height) {
             /* end of scan */
             if (!jpeg->cinfo.buffered_image) {
                /* single scan */
@@ -389,12 +437,10 @@ static void Jpeg_write(DilloJpeg *jpeg, void *Buf, uint_t BufSize)
                      jpeg->state = DILLO_JPEG_READ_BEGIN_SCAN;
                   }
                }
-               if (!jpeg_start_output(&jpeg->cinfo,
-                                      jpeg->cinfo.input_scan_number)) {
+               if (!Jpeg_begin_scan(jpeg)) {
                   /* out of input */
                   break;
                }
-               a_Dicache_new_scan(jpeg->url, jpeg->version);
                jpeg->state = DILLO_JPEG_READ_IN_SCAN;
             }
          }
@@ -110,6 +110,7 @@ static const ContentType_t MimeTypes[] = {
    { "image/gif", 9 },
    { "image/png", 9 },
    { "image/jpeg", 10 },
+   { "image/webp", 10 },
    { NULL, 0 }
 };
 
@@ -121,6 +122,7 @@ typedef enum {
    DT_IMAGE_GIF,
    DT_IMAGE_PNG,
    DT_IMAGE_JPG,
+   DT_IMAGE_WEBP,
 } DetectedContentType;
 
 /*
@@ -163,6 +165,10 @@ int a_Misc_get_content_type_from_data(void *Data, size_t Size, const char **PT)
        * at the character representation should be machine independent. */
       Type = DT_IMAGE_JPG;
       st = 0;
+   } else if (Size >= 12 && !strncmp(p, "RIFF", 4) &&
+              !strncmp(p + 8, "WEBP", 4)) {
+      Type = DT_IMAGE_WEBP;
+      st = 0;
 
    /* Text */
    } else {
@@ -301,6 +307,139 @@ int a_Misc_content_type_cmp(const char *ct1, const char *ct2)
    return ret;
 }
 
+/* How far a_Misc_prescan_charset() looks */
+#define MISC_PRESCAN_SIZE 1024
+
+/*
+ * Does the tag at p[i..size) have this name? (-1 when it's cut off)
+ */
+static int Misc_prescan_is_tag(const char *p, size_t i, size_t size,
+                               const char *name)
+{
+   size_t len = strlen(name);
+
+   if (i + 1 + len >= size)
+      return -1;
+   return (!dStrnAsciiCasecmp(p + i + 1, name, len) &&
+           (dIsspace(p[i + 1 + len]) || p[i + 1 + len] == '/' ||
+            p[i + 1 + len] == '>'));
+}
+
+/*
+ * Read the attribute at p[i..size): its name and value, as offsets.
+ * Return the index after it.
+ */
+static size_t Misc_prescan_attr(const char *p, size_t i, size_t size,
+                                size_t *name, size_t *name_len,
+                                size_t *val, size_t *val_len)
+{
+   char q;
+
+   for (*name = i; i < size && !dIsspace(p[i]) && p[i] != '/' &&
+        p[i] != '>' && p[i] != '='; ++i) ;
+   *name_len = i - *name;
+   for ( ; i < size && dIsspace(p[i]); ++i) ;
+   *val = i;
+   *val_len = 0;
+   if (i < size && p[i] == '=') {
+      for (++i; i < size && dIsspace(p[i]); ++i) ;
+      if (i < size && (p[i] == '"' || p[i] == '\'')) {
+         q = p[i++];
+         for (*val = i; i < size && p[i] != q; ++i) ;
+         *val_len = i - *val;
+         if (i < size)
+            ++i;
+      } else {
+         for (*val = i; i < size && !dIsspace(p[i]) && p[i] != '>'; ++i) ;
+         *val_len = i - *val;
+      }
+   }
+   return i;
+}
+
+/*
+ * Look for the charset that a <meta> declares in the first bytes of an
+ * HTML document, before it's parsed (as in the HTML5 prescan, simplified).
+ * '*PType' gets a content type with it, like the parser would set, or NULL.
+ *
+ * Return value: (0 when done, 2 on lack of data).
+ */
+int a_Misc_prescan_charset(const char *Data, size_t Size, char **PType)
+{
+   const char *p = Data;
+   size_t i, n, name, name_len, val, val_len;
+   char *charset, *content, *value;
+   int st = 2, is_meta, http_equiv;
+
+   *PType = NULL;
+   n = MIN(Size, MISC_PRESCAN_SIZE);
+   for (i = 0; i < n && st; ) {
+      for ( ; i < n && p[i] != '<'; ++i) ;
+      if (n - i < 4) {
+         break;
+      } else if (!strncmp(p + i, "<!--", 4)) {
+         for (i += 4; i + 3 <= n && strncmp(p + i, "-->", 3); ++i) ;
+         i += 3;
+         continue;
+      } else if (!isalpha((uchar_t)p[i + 1])) {
+         /* end tag, DOCTYPE, processing instruction... */
+         for ( ; i < n && p[i] != '>'; ++i) ;
+         i++;
+         continue;
+      } else if ((is_meta = Misc_prescan_is_tag(p, i, n, "meta")) == -1 ||
+                 Misc_prescan_is_tag(p, i, n, "body") == 1) {
+         /* cut off, or the HEAD is over */
+         st = is_meta == -1 ? 2 : 0;
+         break;
+      }
+
+      charset = content = NULL;
+      http_equiv = 0;
+      for (++i; i < n && !dIsspace(p[i]) && p[i] != '/' && p[i] != '>'; ++i) ;
+      while (i < n && p[i] != '>') {
+         if (dIsspace(p[i]) || p[i] == '/' || p[i] == '=') {
+            ++i;
+            continue;
+         }
+         i = Misc_prescan_attr(p, i, n, &name, &name_len, &val, &val_len);
+         if (is_meta) {
+            value = dStrndup(p + val, val_len);
+            if (name_len == 7 && !dStrnAsciiCasecmp(p + name, "charset", 7) &&
+                !charset) {
+               charset = value;
+            } else if (name_len == 7 &&
+                       !dStrnAsciiCasecmp(p + name, "content", 7) &&
+                       !content) {
+               content = value;
+            } else {
+               if (name_len == 10 &&
+                   !dStrnAsciiCasecmp(p + name, "http-equiv", 10))
+                  http_equiv = !dStrAsciiCasecmp(value, "content-type");
+               dFree(value);
+            }
+         }
+      }
+      if (i < n) {
+         ++i;
+         if (charset && *charset) {
+            *PType = dStrconcat("text/html; charset=", charset, NULL);
+         } else if (http_equiv && content) {
+            a_Misc_parse_content_type(content, NULL, NULL, &value);
+            if (value)
+               *PType = dStrdup(content);
+            dFree(value);
+         }
+         if (*PType)
+            st = 0;
+      }
+      dFree(charset);
+      dFree(content);
+   }
+   if (Size >= MISC_PRESCAN_SIZE)
+      st = 0;
+   return st;
+}
+
 /*
  * Check the server-supplied 'Content-Type' against our detected type.
  * (some servers seem to default to "text/plain").
@@ -14,26 +14,26 @@
  */
 
 #include "msg.h"
-#include "prefs.h"
 #include "cache.h"
+#include "capi.h"
 #include "bw.h"
 #include "web.hh"
-#include "misc.h"
+#include "plain.hh"
 #include "styleengine.hh"
 
 #include "uicmd.hh"
 
 #include "dw/core.hh"
-#include "dw/textblock.hh"
+#include "dw/plaintext.hh"
 
-// Dw to Textblock
-#define DW2TB(dw)  ((Textblock*)dw)
+// Dw to PlainText
+#define DW2PT(dw)  ((PlainText*)dw)
 
 using namespace dw;
 using namespace dw::core;
 
 
-class DilloPlain {
+class DilloPlain: public PlainText::Source {
 private:
    class PlainLinkReceiver: public dw::core::Layout::LinkReceiver {
    public:
@@ -43,20 +43,22 @@ private:
    };
    PlainLinkReceiver plainReceiver;
 
-   void addLine(char *Buf, uint_t BufSize);
-
 public:
    BrowserWindow *bw;
+   DilloUrl *url;       /* Whose cache data we hold; NULL once it's gone */
 
    Widget *dw;
    style::Style *widgetStyle;
    size_t Start_Ofs;    /* Offset of where to start reading next */
    int state;
+   bool Complete;       /* Has all the data arrived? */
 
-   DilloPlain(BrowserWindow *bw);
+   DilloPlain(BrowserWindow *bw, const DilloUrl *url);
    ~DilloPlain();
 
+   const char *getText(size_t *size);
    void write(void *Buf, uint_t BufSize, int Eof);
+   void reread();
 };
 
 /* FSM states */
@@ -79,20 +81,35 @@ void *a_Plain_text(const char *type, void *P, CA_Callback_t *Call,void **Data);
 static void Plain_callback(int Op, CacheClient_t *Client);
 void a_Plain_free(void *data);
 
+/*
+ * The live documents, for the cache to find those showing its data.
+ */
+static Dlist *PlainDocs = NULL;
+
 
 /*
  * Diplain constructor.
  */
-DilloPlain::DilloPlain(BrowserWindow *p_bw)
+DilloPlain::DilloPlain(BrowserWindow *p_bw, const DilloUrl *p_url)
 {
+   char *buf;
+   int size;
+
    /* Init event receiver */
    plainReceiver.plain = this;
 
    /* Init internal variables */
    bw = p_bw;
-   dw = new Textblock (prefs.limit_text_width);
    Start_Ofs = 0;
    state = ST_SeekingEol;
+   Complete = false;
+
+   /* The widget draws from the cache data: keep it (and its charset
+    * decoding) until we go */
+   url = a_Capi_get_buf(p_url, &buf, &size) ? a_Url_dup(p_url) : NULL;
+   if (!PlainDocs)
+      PlainDocs = dList_new(4);
+   dList_append(PlainDocs, this);
 
    Layout *layout = (Layout*) bw->render_layout;
    // TODO (1x) No URL?
@@ -103,6 +120,8 @@ DilloPlain::DilloPlain(BrowserWindow *p_bw)
    widgetStyle = styleEngine.wordStyle (bw);
    widgetStyle->ref ();
 
+   dw = new PlainText (widgetStyle, this);
+
    /* The context menu */
    layout->connectLink (&plainReceiver);
 
@@ -117,6 +136,15 @@ DilloPlain::~DilloPlain()
 {
    _MSG("::~DilloPlain()\n");
    widgetStyle->unref();
+   if (url) {
+      a_Capi_unref_buf(url);
+      a_Url_free(url);
+   }
+   dList_remove(PlainDocs, this);
+   if (dList_length(PlainDocs) == 0) {
+      dList_free(PlainDocs);
+      PlainDocs = NULL;
+   }
 }
 
 /*
@@ -134,26 +162,22 @@ bool DilloPlain::PlainLinkReceiver::press (Widget *widget, int, int, int, int,
    return false;
 }
 
-void DilloPlain::addLine(char *Buf, uint_t BufSize)
+/*
+ * Give the widget the cache data. It moves as data arrives, so it's looked
+ * up each time; our reference keeps the lookup from decoding it again.
+ */
+const char *DilloPlain::getText(size_t *size)
 {
+   char *buf;
    int len;
-   char buf[129];
-   char *end = Buf + BufSize;
-
-   if (BufSize > 0) {
-      // Limit word length to avoid X11 coordinate
-      // overflow with extremely long lines.
-      while ((len = a_Misc_expand_tabs(&Buf, end, buf, sizeof(buf) - 1))) {
-         assert ((uint_t)len < sizeof(buf));
-         buf[len] = '\0';
-         DW2TB(dw)->addText(buf, len, widgetStyle);
-      }
-   } else {
-      // Add dummy word for empty lines - otherwise the parbreak is ignored.
-      DW2TB(dw)->addText("", 0, widgetStyle);
-   }
 
-   DW2TB(dw)->addParbreak(0, widgetStyle);
+   if (!url || !a_Capi_get_buf(url, &buf, &len)) {
+      *size = 0;
+      return NULL;
+   }
+   a_Capi_unref_buf(url);
+   *size = len;
+   return buf;
 }
 
 /*
@@ -180,9 +204,9 @@ void DilloPlain::write(void *Buf, uint_t BufSize, int Eof)
          }
          break;
       case ST_Eol:
-         addLine(Start + i - len, len);
          if (Start[i] == '\r' && Start[i + 1] == '\n') ++i;
          if (i < MaxBytes) ++i;
+         DW2PT(dw)->addLine(Start_Ofs + i);
          state = ST_SeekingEol;
          len = 0;
          break;
@@ -190,11 +214,28 @@ void DilloPlain::write(void *Buf, uint_t BufSize, int Eof)
    }
    Start_Ofs += i - len;
    if (Eof && len) {
-      addLine(Start + i - len, len);
       Start_Ofs += len;
+      DW2PT(dw)->addLine(Start_Ofs);
    }
 
-   DW2TB(dw)->flush();
+   DW2PT(dw)->flush();
+}
+
+/*
+ * The cache data was decoded again (charset change): index it anew.
+ */
+void DilloPlain::reread()
+{
+   const char *buf;
+   size_t size;
+
+   Start_Ofs = 0;
+   state = ST_SeekingEol;
+   DW2PT(dw)->clear();
+   if ((buf = getText(&size)))
+      write((void*)buf, size, Complete);
+   else
+      DW2PT(dw)->flush();
 }
 
 /*
@@ -203,7 +244,7 @@ void DilloPlain::write(void *Buf, uint_t BufSize, int Eof)
 void *a_Plain_text(const char *type, void *P, CA_Callback_t *Call, void **Data)
 {
    DilloWeb *web = (DilloWeb*)P;
-   DilloPlain *plain = new DilloPlain(web->bw);
+   DilloPlain *plain = new DilloPlain(web->bw, web->url);
 
    *Call = (CA_Callback_t)Plain_callback;
    *Data = (void*)plain;
@@ -226,6 +267,7 @@ static void Plain_callback(int Op, CacheClient_t *Client)
 
    if (Op) {
       /* Do the last line: */
+      plain->Complete = true;
       plain->write(Client->Buf, Client->BufSize, 1);
       /* remove this client from our active list */
       a_Bw_close_client(plain->bw, Client->Key);
@@ -234,3 +276,32 @@ static void Plain_callback(int Op, CacheClient_t *Client)
    }
 }
 
+
+/*
+ * The cache is freeing the data of this URL: stop drawing from it.
+ */
+void a_Plain_release_data(const DilloUrl *url)
+{
+   DilloPlain *plain;
+
+   for (int i = 0; (plain = (DilloPlain*)dList_nth_data(PlainDocs, i)); ++i)
+      if (plain->url && !a_Url_cmp(plain->url, url)) {
+         /* our reference goes with the entry */
+         a_Url_free(plain->url);
+         plain->url = NULL;
+         DW2PT(plain->dw)->clear();
+         DW2PT(plain->dw)->flush();
+      }
+}
+
+/*
+ * The cache data of this URL is decoded with another charset now.
+ */
+void a_Plain_reread_data(const DilloUrl *url)
+{
+   DilloPlain *plain;
+
+   for (int i = 0; (plain = (DilloPlain*)dList_nth_data(PlainDocs, i)); ++i)
+      if (plain->url && !a_Url_cmp(plain->url, url))
+         plain->reread();
+}
@@ -0,0 +1,21 @@
+#ifndef __PLAIN_HH__
+#define __PLAIN_HH__
+
+#include "url.h"               // for DilloUrl
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Exported functions
+ */
+void a_Plain_release_data(const DilloUrl *url);
+void a_Plain_reread_data(const DilloUrl *url);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __PLAIN_HH__ */
@@ -72,9 +72,11 @@ typedef struct {
    uchar_t **row_pointers;      /* pntr to row starts    */
    jmp_buf jmpbuf;              /* png error processing */
    int error;                   /* error flag */
-   png_uint_32 previous_row;
+   bool_t interlaced;
+   bitvec_t *scan_rows;         /* Rows written in the current scan */
    int rowbytes;                /* No. bytes in image row */
    short channels;              /* No. image channels */
+   DilloImgType type;           /* As stored in the dicache */
 
 /*
  * 0                                              last byte
@@ -143,12 +145,25 @@ Png_datainfo_callback(png_structp png_ptr, png_infop info_ptr)
         "Png_datainfo_callback: png->height = %lu\n",
         (ulong_t) png->width, (ulong_t) png->height);
 
-   /* we need RGB/RGBA in the end */
-   if (color_type == PNG_COLOR_TYPE_PALETTE && bit_depth <= 8) {
+   /* Opaque gray and palette images are kept at one byte per pixel,
+    * the rest is converted to RGB/RGBA */
+   png->type = DILLO_IMG_TYPE_RGB;
+   if (!png_get_valid (png_ptr, info_ptr, PNG_INFO_tRNS)) {
+      if (color_type == PNG_COLOR_TYPE_GRAY)
+         png->type = DILLO_IMG_TYPE_GRAY;
+      else if (color_type == PNG_COLOR_TYPE_PALETTE && bit_depth <= 8)
+         png->type = DILLO_IMG_TYPE_INDEXED;
+   }
+
+   if (png->type == DILLO_IMG_TYPE_INDEXED) {
+      /* One index per byte */
+      if (bit_depth < 8)
+         png_set_packing (png_ptr);
+   } else if (color_type == PNG_COLOR_TYPE_PALETTE && bit_depth <= 8) {
       /* Convert indexed images to RGB */
       png_set_expand (png_ptr);
    } else if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
-      /* Convert grayscale to RGB */
+      /* Convert grayscale to 8 bits */
       png_set_expand (png_ptr);
    } else if (png_get_valid (png_ptr, info_ptr, PNG_INFO_tRNS)) {
       /* We have transparency header, convert it to alpha channel */
@@ -168,14 +183,16 @@ Png_datainfo_callback(png_structp png_ptr, png_infop info_ptr)
       png_set_gamma(png_ptr, 2.2, file_gamma);
 
    /* Convert gray scale to RGB */
-   if (color_type == PNG_COLOR_TYPE_GRAY ||
-       color_type == PNG_COLOR_TYPE_GRAY_ALPHA) {
+   if (png->type == DILLO_IMG_TYPE_RGB &&
+       (color_type == PNG_COLOR_TYPE_GRAY ||
+        color_type == PNG_COLOR_TYPE_GRAY_ALPHA)) {
       png_set_gray_to_rgb(png_ptr);
    }
 
    /* Interlaced */
    if (interlace_type != PNG_INTERLACE_NONE) {
       png_set_interlace_handling(png_ptr);
+      png->interlaced = TRUE;
    }
 
    /* get libpng to update its state */
@@ -200,12 +217,43 @@ Png_datainfo_callback(png_structp png_ptr, png_infop info_ptr)
       png->row_pointers[i] = png->image_data + (i * png->rowbytes);
 
    png->linebuf = dMalloc(3 * png->width);
+   png->scan_rows = a_Bitvec_new(png->height);
 
    /* Initialize the dicache-entry here */
    a_Dicache_set_parms(png->url, png->version, png->Image,
                        (uint_t)png->width, (uint_t)png->height,
-                       DILLO_IMG_TYPE_RGB, file_gamma);
+                       png->type, file_gamma);
    png->Image = NULL; /* safeguard: hereafter it may be freed by its owner */
+
+   if (png->type == DILLO_IMG_TYPE_INDEXED) {
+      png_colorp palette;
+      int num_palette = 0;
+      uchar_t cmap[3 * 256];
+
+      /* (libpng has gamma-corrected the palette, if needed) */
+      png_get_PLTE(png_ptr, info_ptr, &palette, &num_palette);
+      num_palette = MIN(num_palette, 256);
+      for (i = 0; i < (uint_t)num_palette; i++) {
+         cmap[3 * i] = palette[i].red;
+         cmap[3 * i + 1] = palette[i].green;
+         cmap[3 * i + 2] = palette[i].blue;
+      }
+      a_Dicache_set_cmap(png->url, png->version, png->bgcolor, cmap,
+                         (uint_t)num_palette, 256, -1);
+   }
+}
+
+/*
+ * The last Adam7 pass with pixels in a row.
+ */
+static int Png_last_pass(png_uint_32 width, png_uint_32 row_num)
+{
+   if (row_num & 1)
+      return 6;
+   if (width > 1)
+      return 5;
+   /* a single column: passes 0, 2, 4 start at rows 0, 4, 2 */
+   return (row_num & 2) ? 4 : (row_num & 4) ? 2 : 0;
 }
 
 static void
@@ -224,13 +272,22 @@ static void
 
    png_progressive_combine_row(png_ptr, png->row_pointers[row_num], new_row);
 
-   _MSG("png: row_num=%u previous_row=%u\n", row_num, png->previous_row);
-   if (row_num < png->previous_row) {
+   /* Unless the whole image is expected soon; then only complete rows
+    * are written, and the intermediate passes are skipped. */
+   if (png->interlaced && pass < Png_last_pass(png->width, row_num) &&
+       a_Dicache_skip_passes(png->url, png->version))
+      return;
+
+   /* A row coming again starts a new scan */
+   _MSG("png: row_num=%u pass=%d\n", row_num, pass);
+   if (a_Bitvec_get_bit(png->scan_rows, (int)row_num)) {
       a_Dicache_new_scan(png->url, png->version);
+      a_Bitvec_clear(png->scan_rows);
    }
-   png->previous_row = row_num;
+   a_Bitvec_set_bit(png->scan_rows, (int)row_num);
 
    switch (png->channels) {
+   case 1:
    case 3:
       a_Dicache_write(png->url, png->version,
                       png->image_data + (row_num * png->rowbytes),
@@ -302,6 +359,7 @@ static void Png_free(DilloPng *png)
    dFree(png->image_data);
    dFree(png->row_pointers);
    dFree(png->linebuf);
+   a_Bitvec_free(png->scan_rows);
    if (setjmp(png->jmpbuf))
       MSG_WARN("PNG: can't destroy read structure\n");
    else if (png->png_ptr)
@@ -444,7 +502,8 @@ void *a_Png_new(DilloImage *Image, DilloUrl *url, int version)
    png->linebuf = NULL;
    png->image_data = NULL;
    png->row_pointers = NULL;
-   png->previous_row = 0;
+   png->interlaced = FALSE;
+   png->scan_rows = NULL;
 
    return png;
 }
@@ -72,6 +72,11 @@ void a_Prefs_init(void)
    prefs.adjust_min_width = TRUE;
    prefs.adjust_table_min_width = TRUE;
    prefs.load_images=TRUE;
+   prefs.image_memory_budget = 64;
+   prefs.lazy_images = FALSE;
+   prefs.lazy_images_distance = 1250;
+   prefs.progressive_image_budget = 100;
+   prefs.parse_time_slice = 40;
    prefs.load_background_images=FALSE;
    prefs.load_stylesheets=TRUE;
    prefs.middle_click_drags_page = TRUE;
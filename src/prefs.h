@@ -89,6 +89,11 @@ typedef struct {
    bool_t show_quit_dialog;
    bool_t fullwindow_start;
    bool_t load_images;
+   int32_t image_memory_budget;
+   bool_t lazy_images;
+   int32_t lazy_images_distance;
+   int32_t progressive_image_budget;
+   int32_t parse_time_slice;
    bool_t load_background_images;
    bool_t load_stylesheets;
    bool_t parse_embedded_css;
@@ -178,6 +178,12 @@ void PrefsParser::parse(FILE *fp)
       { "adjust_min_width", &prefs.adjust_min_width, PREFS_BOOL, 0 },
       { "adjust_table_min_width", &prefs.adjust_table_min_width, PREFS_BOOL, 0 },
       { "load_images", &prefs.load_images, PREFS_BOOL, 0 },
+      { "image_memory_budget", &prefs.image_memory_budget, PREFS_INT32, 0 },
+      { "lazy_images", &prefs.lazy_images, PREFS_BOOL, 0 },
+      { "lazy_images_distance", &prefs.lazy_images_distance, PREFS_INT32, 0 },
+      { "progressive_image_budget", &prefs.progressive_image_budget,
+        PREFS_INT32, 0 },
+      { "parse_time_slice", &prefs.parse_time_slice, PREFS_INT32, 0 },
       { "load_background_images", &prefs.load_background_images, PREFS_BOOL, 0 },
       { "load_stylesheets", &prefs.load_stylesheets, PREFS_BOOL, 0 },
       { "middle_click_drags_page", &prefs.middle_click_drags_page,
@@ -13,6 +13,7 @@
 #include "msg.h"
 #include "prefs.h"
 #include "misc.h"
+#include "atom.h"
 #include "html_common.hh"
 #include "styleengine.hh"
 #include "web.hh"
@@ -157,24 +158,32 @@ void StyleEngine::startElement (const char *tagname, BrowserWindow *bw) {
 void StyleEngine::setId (const char *id) {
    DoctreeNode *dn = doctree->top ();
    assert (dn->id == NULL);
-   dn->id = dStrdup (id);
+   dn->id = a_Atom_intern (id);
 }
 
 /**
- * \brief split a string at sep chars and return a SimpleVector of strings
+ * \brief split a string at sep chars into atoms, listed in the doctree's zone
  */
-static lout::misc::SimpleVector<char *> *splitStr (const char *str, char sep) {
+static DoctreeClasses *splitStr (Doctree *doctree, const char *str, char sep)
+{
+   DoctreeClasses *list =
+      (DoctreeClasses *) doctree->alloc (sizeof (DoctreeClasses));
    const char *p1 = NULL;
-   lout::misc::SimpleVector<char *> *list =
-      new lout::misc::SimpleVector<char *> (1);
+   int n = 0;
+
+   for (const char *s = str; *s; s++)
+      if (*s != sep && (s == str || s[-1] == sep))
+         n++;
+
+   list->num = 0;
+   list->names = (const char **) doctree->alloc (n * sizeof (char *));
 
    for (;; str++) {
       if (*str != '\0' && *str != sep) {
          if (!p1)
             p1 = str;
       } else if (p1) {
-         list->increase ();
-         list->set (list->size () - 1, dStrndup (p1, str - p1));
+         list->names[list->num++] = a_Atom_intern_l (p1, str - p1);
          p1 = NULL;
       }
 
@@ -188,7 +197,7 @@ static lout::misc::SimpleVector<char *> *splitStr (const char *str, char sep) {
 void StyleEngine::setClass (const char *klass) {
    DoctreeNode *dn = doctree->top ();
    assert (dn->klass == NULL);
-   dn->klass = splitStr (klass, ' ');
+   dn->klass = splitStr (doctree, klass, ' ');
 }
 
 void StyleEngine::setStyle (const char *styleAttr) {
@@ -74,6 +74,9 @@ class StyleEngine {
 
       void parse (DilloHtml *html, DilloUrl *url, const char *buf, int buflen,
                   CssOrigin origin);
+      inline void setQuirksMode (bool quirks) {
+         doctree->setQuirksMode (quirks);
+      };
       void startElement (int tag, BrowserWindow *bw);
       void startElement (const char *tagname, BrowserWindow *bw);
       void setId (const char *id);
@@ -1454,7 +1454,8 @@ void a_UIcmd_set_buttons_sens(BrowserWindow *bw)
    int sens;
 
    // Stop
-   sens = (dList_length(bw->ImageClients) || dList_length(bw->RootClients));
+   sens = (dList_length(bw->ImageClients) || dList_length(bw->RootClients) ||
+           dList_length(bw->PreloadClients));
    BW2UI(bw)->button_set_sens(UI_STOP, sens);
    // Back
    sens = (a_Nav_stack_ptr(bw) > 0);
@@ -199,6 +199,41 @@ static DilloUrl *Url_object_new(const char *uri_str)
    return url;
 }
 
+/*
+ * Free a list of DilloUrlDataFile
+ */
+static void Url_data_files_free(Dlist *files)
+{
+   DilloUrlDataFile *f;
+
+   while ((f = dList_nth_data(files, 0))) {
+      dList_remove_fast(files, f);
+      dFree(f->path);
+      dFree(f);
+   }
+   dList_free(files);
+}
+
+/*
+ * Compare two lists of DilloUrlDataFile
+ */
+static int Url_data_files_cmp(Dlist *A, Dlist *B)
+{
+   int i, st, n = dList_length(A);
+
+   if ((st = n - dList_length(B)))
+      return st;
+   for (i = 0; i < n; i++) {
+      DilloUrlDataFile *a = dList_nth_data(A, i), *b = dList_nth_data(B, i);
+
+      if ((st = a->offset - b->offset) ||
+          (st = (a->size > b->size) - (a->size < b->size)) ||
+          (st = strcmp(a->path, b->path)))
+         return st;
+   }
+   return 0;
+}
+
 /*
  *  Free a DilloUrl
  *  Do nothing if the argument is NULL
@@ -212,6 +247,7 @@ void a_Url_free(DilloUrl *url)
          dFree((char *)url->hostname);
       dFree((char *)url->buffer);
       dStr_free(url->data, 1);
+      Url_data_files_free(url->data_files);
       dFree(url);
    }
 }
@@ -469,6 +505,17 @@ DilloUrl* a_Url_dup(const DilloUrl *ori)
    url->illegal_chars_spc    = ori->illegal_chars_spc;
    url->data                 = dStr_sized_new(URL_DATA(ori)->len);
    dStr_append_l(url->data, URL_DATA(ori)->str, URL_DATA(ori)->len);
+   if (ori->data_files) {
+      int i, n = dList_length(ori->data_files);
+
+      url->data_files = dList_new(n);
+      for (i = 0; i < n; i++) {
+         DilloUrlDataFile *f = dNew(DilloUrlDataFile, 1);
+         *f = *(DilloUrlDataFile *)dList_nth_data(ori->data_files, i);
+         f->path = dStrdup(f->path);
+         dList_append(url->data_files, f);
+      }
+   }
    return url;
 }
 
@@ -496,6 +543,7 @@ int a_Url_cmp(const DilloUrl *A, const DilloUrl *B)
         //(st = URL_STR_FIELD_CMP(A->path, B->path)) == 0 &&
         (st = URL_STR_FIELD_CMP(A->query, B->query)) == 0 &&
         (st = dStr_cmp(A->data, B->data)) == 0 &&
+        (st = Url_data_files_cmp(A->data_files, B->data_files)) == 0 &&
         (st = URL_STR_FIELD_I_CMP(A->scheme, B->scheme)) == 0))
       return 0;
    return st;
@@ -522,6 +570,31 @@ void a_Url_set_data(DilloUrl *u, Dstr **data)
    }
 }
 
+/*
+ * Set the files that go inside DilloUrl data (multipart POST)
+ */
+void a_Url_set_data_files(DilloUrl *u, Dlist **files)
+{
+   if (u) {
+      Url_data_files_free(u->data_files);
+      u->data_files = *files;
+      *files = NULL;
+   }
+}
+
+/*
+ * Return the full length of DilloUrl data, including its file parts
+ */
+long a_Url_data_len(const DilloUrl *u)
+{
+   long len = URL_DATA(u)->len;
+   int i, n = dList_length(u->data_files);
+
+   for (i = 0; i < n; i++)
+      len += ((DilloUrlDataFile *)dList_nth_data(u->data_files, i))->size;
+   return len;
+}
+
 /*
  * Set DilloUrl ismap coordinates
  * (this is optimized for not hogging the CPU)
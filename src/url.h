@@ -82,6 +82,16 @@
 extern "C" {
 #endif /* __cplusplus */
 
+/*
+ * A file whose contents belong inside DilloUrl->data at 'offset'.
+ * (Used to stream multipart uploads from disk instead of holding them)
+ */
+typedef struct {
+   int offset;                    /* insertion point within data */
+   char *path;
+   long size;                     /* size at submit time */
+} DilloUrlDataFile;
+
 typedef struct {
    Dstr  *url_string;
    const char *buffer;
@@ -94,6 +104,7 @@ typedef struct {
    int port;
    int flags;
    Dstr *data;                    /* POST */
+   Dlist *data_files;             /* POST file parts (may be NULL) */
    int ismap_url_len;             /* Used by server side image maps */
    int illegal_chars;             /* number of illegal chars */
    int illegal_chars_spc;         /* number of illegal space chars */
@@ -108,6 +119,8 @@ DilloUrl* a_Url_dup(const DilloUrl *u);
 int a_Url_cmp(const DilloUrl *A, const DilloUrl *B);
 void a_Url_set_flags(DilloUrl *u, int flags);
 void a_Url_set_data(DilloUrl *u, Dstr **data);
+void a_Url_set_data_files(DilloUrl *u, Dlist **files);
+long a_Url_data_len(const DilloUrl *u);
 void a_Url_set_ismap_coords(DilloUrl *u, char *coord_str);
 char *a_Url_decode_hex_str(const char *str);
 char *a_Url_encode_hex_str(const char *str);
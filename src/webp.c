@@ -0,0 +1,255 @@
+/*
+ * File: webp.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ */
+
+/*
+ * The webp decoder for dillo. It is responsible for decoding WebP data
+ * and transferring it to the dicache. It uses libwebp's incremental
+ * decoder, so rows are written as soon as they are decoded.
+ */
+
+#include <config.h>
+#ifdef ENABLE_WEBP
+
+#include <webp/decode.h>
+
+#include "msg.h"
+#include "image.hh"
+#include "cache.h"
+#include "dicache.h"
+
+enum prog_state {
+   IS_finished, IS_init, IS_nextdata
+};
+
+typedef struct {
+   DilloImage *Image;           /* Image meta data */
+   DilloUrl *url;               /* Primary Key for the dicache */
+   int version;                 /* Secondary Key for the dicache */
+   int bgcolor;                 /* Parent widget background color */
+
+   WebPDecoderConfig config;    /* libwebp output buffer and features */
+   WebPIDecoder *idec;          /* libwebp incremental decoder */
+   int width;
+   int height;
+   int y;                       /* Next row to be written */
+   bool_t has_alpha;
+
+   enum prog_state state;       /* FSM current state  */
+
+   uchar_t *linebuf;            /* o/p raster data, for RGBA images */
+} DilloWebp;
+
+
+/*
+ * Free up the resources for this image.
+ */
+static void Webp_free(DilloWebp *webp)
+{
+   _MSG("Webp_free: webp=%p\n", webp);
+
+   if (webp->idec)
+      WebPIDelete(webp->idec);
+   WebPFreeDecBuffer(&webp->config.output);
+   dFree(webp->linebuf);
+   dFree(webp);
+}
+
+/*
+ * Finish the decoding process (and free the memory)
+ */
+static void Webp_close(DilloWebp *webp, CacheClient_t *Client)
+{
+   _MSG("Webp_close\n");
+   /* Let dicache know decoding is over */
+   a_Dicache_close(webp->url, webp->version, Client);
+   Webp_free(webp);
+}
+
+/*
+ * Read the image size from the header and set up the decoder.
+ * Return FALSE while the header is incomplete.
+ */
+static bool_t Webp_init(DilloWebp *webp, const uchar_t *Buf, uint_t BufSize)
+{
+   WebPBitstreamFeatures *features = &webp->config.input;
+   VP8StatusCode status;
+
+   status = WebPGetFeatures(Buf, BufSize, features);
+   if (status == VP8_STATUS_NOT_ENOUGH_DATA)
+      return FALSE;
+
+   webp->state = IS_finished;
+   if (status != VP8_STATUS_OK) {
+      MSG_WARN("\"%s\" is not a WebP file.\n", URL_STR(webp->url));
+      return TRUE;
+   }
+   if (features->has_animation) {
+      /* The incremental decoder only handles still images */
+      MSG("Webp_init: %s: animated WebP is not supported\n",
+          URL_STR(webp->url));
+      return TRUE;
+   }
+
+   webp->width = features->width;
+   webp->height = features->height;
+   /* check max image size */
+   if (webp->width <= 0 || webp->height <= 0 ||
+       webp->width > IMAGE_MAX_AREA / webp->height) {
+      MSG("Webp_init: suspicious image size request %d x %d\n",
+          webp->width, webp->height);
+      return TRUE;
+   }
+
+   /* Transparent pixels get the background color while writing rows */
+   webp->has_alpha = features->has_alpha ? TRUE : FALSE;
+   webp->config.output.colorspace = webp->has_alpha ? MODE_RGBA : MODE_RGB;
+   webp->idec = WebPINewDecoder(&webp->config.output);
+   if (!webp->idec) {
+      MSG("Webp_init: %s: can't create decoder\n", URL_STR(webp->url));
+      return TRUE;
+   }
+   if (webp->has_alpha)
+      webp->linebuf = dNew(uchar_t, 3 * webp->width);
+
+   /* Initialize the dicache-entry here */
+   a_Dicache_set_parms(webp->url, webp->version, webp->Image,
+                       (uint_t)webp->width, (uint_t)webp->height,
+                       DILLO_IMG_TYPE_RGB, 1 / 2.2);
+   webp->Image = NULL; /* safeguard: hereafter it may be freed by its owner */
+
+   webp->state = IS_nextdata;
+   return TRUE;
+}
+
+/*
+ * Write the rows that have been decoded since the last call.
+ */
+static void Webp_write_rows(DilloWebp *webp)
+{
+   int last_y, width, height, stride, x;
+   const uchar_t *bg = NULL;
+   uchar_t bgrgb[3];
+   uint8_t *rgb;
+
+   rgb = WebPIDecGetRGB(webp->idec, &last_y, &width, &height, &stride);
+   if (!rgb)
+      return;
+
+   if (webp->has_alpha) {
+      bgrgb[0] = (webp->bgcolor >> 16) & 0xFF;
+      bgrgb[1] = (webp->bgcolor >> 8) & 0xFF;
+      bgrgb[2] = webp->bgcolor & 0xFF;
+      bg = bgrgb;
+   }
+
+   for (; webp->y < last_y; webp->y++) {
+      const uchar_t *data = rgb + webp->y * stride;
+
+      if (bg) {
+         uchar_t *pl = webp->linebuf;
+
+         for (x = 0; x < width; x++, data += 4, pl += 3) {
+            int a = data[3];
+
+            if (a == 255) {
+               pl[0] = data[0];
+               pl[1] = data[1];
+               pl[2] = data[2];
+            } else {
+               pl[0] = (data[0] * a + bg[0] * (255 - a) + 127) / 255;
+               pl[1] = (data[1] * a + bg[1] * (255 - a) + 127) / 255;
+               pl[2] = (data[2] * a + bg[2] * (255 - a) + 127) / 255;
+            }
+         }
+         data = webp->linebuf;
+      }
+      a_Dicache_write(webp->url, webp->version, data, (uint_t)webp->y);
+   }
+}
+
+/*
+ * Receive and process new chunks of WebP image data
+ */
+static void Webp_write(DilloWebp *webp, void *Buf, uint_t BufSize)
+{
+   VP8StatusCode status;
+
+   dReturn_if_fail ( Buf != NULL && BufSize > 0 );
+
+   if (webp->state == IS_init && !Webp_init(webp, Buf, BufSize))
+      return;                   /* need MORE data */
+   if (webp->state != IS_nextdata)
+      return;
+
+   /* Buf holds all the data received so far, and it may have moved since
+    * the last call: WebPIUpdate() is told so, and it doesn't copy it. */
+   status = WebPIUpdate(webp->idec, Buf, BufSize);
+   if (status != VP8_STATUS_OK && status != VP8_STATUS_SUSPENDED) {
+      MSG("Webp_write: %s: decoding error %d\n", URL_STR(webp->url), status);
+      webp->state = IS_finished;
+   } else {
+      Webp_write_rows(webp);
+      if (status == VP8_STATUS_OK)
+         webp->state = IS_finished;
+   }
+}
+
+/*
+ * Op:  Operation to perform.
+ *   If (Op == 0)
+ *      start or continue processing an image if image data exists.
+ *   else
+ *       terminate processing, cleanup any allocated memory,
+ *       close down the decoding process.
+ *
+ * Client->CbData  : pointer to previously allocated DilloWebp work area.
+ *  This holds the current state of the image processing and is kept
+ *  across calls to this routine.
+ * Client->Buf     : Pointer to data start.
+ * Client->BufSize : the size of the data buffer.
+ */
+void a_Webp_callback(int Op, void *data)
+{
+   if (Op == CA_Send) {
+      CacheClient_t *Client = data;
+      Webp_write(Client->CbData, Client->Buf, Client->BufSize);
+   } else if (Op == CA_Close) {
+      CacheClient_t *Client = data;
+      Webp_close(Client->CbData, Client);
+   } else if (Op == CA_Abort) {
+      Webp_free(data);
+   }
+}
+
+/*
+ * Create the image state data that must be kept between calls
+ */
+void *a_Webp_new(DilloImage *Image, DilloUrl *url, int version)
+{
+   DilloWebp *webp = dNew0(DilloWebp, 1);
+   _MSG("a_Webp_new: webp=%p\n", webp);
+
+   webp->Image = Image;
+   webp->url = url;
+   webp->version = version;
+   webp->bgcolor = Image->bg_color;
+   webp->state = IS_init;
+   webp->idec = NULL;
+   webp->linebuf = NULL;
+   WebPInitDecoderConfig(&webp->config);
+
+   return webp;
+}
+
+#else /* ENABLE_WEBP */
+
+void *a_Webp_new() { return 0; }
+void a_Webp_callback() { return; }
+
+#endif /* ENABLE_WEBP */
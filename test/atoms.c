@@ -0,0 +1,200 @@
+/*
+ * Atom table test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Interns and releases names in a random order, growing and shrinking
+ * the table, and deletes from a probe cluster that wraps around its end.
+ * The table's own statics are checked too, so atom.c is included here.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../src/atom.c"
+
+#define NUM_NAMES 20000
+#define NUM_OPS 2000000
+
+static uint_t failed = 0;
+static uint_t passed = 0;
+
+static void check(int lineno, int cond, const char *what)
+{
+   if (!cond) {
+      printf("line %d: FAILED: %s\n", lineno, what);
+      failed++;
+   } else {
+      passed++;
+   }
+}
+
+/*
+ * Return the slot holding an atom, or -1.
+ */
+static int slot_of(const char *atom)
+{
+   uint_t i;
+
+   for (i = 0; i < NumSlots; i++)
+      if (Slots[i] && Slots[i]->str == atom)
+         return i;
+   return -1;
+}
+
+/*
+ * Interning an atom's string again must give back the atom.
+ */
+static int still_found(const char *atom)
+{
+   const char *again = a_Atom_intern(atom);
+
+   a_Atom_unref(again);
+   return again == atom;
+}
+
+/*
+ * Intern a lowercase name, from *n on, whose home is the given slot.
+ */
+static const char *intern_at(uint_t slot, int *n)
+{
+   char name[32];
+
+   do
+      snprintf(name, sizeof(name), "w%d", (*n)++);
+   while ((Atom_hash(name, strlen(name)) & (NumSlots - 1)) != slot);
+   return a_Atom_intern(name);
+}
+
+/*
+ * A cluster from the last slot into the first ones: a, b, c are at home
+ * in the last slot, d in slot 0, so they land in slots last, 0, 1, 2.
+ */
+static void test_wrap_around(void)
+{
+   const char *pad, *a, *b, *c, *d;
+   int n = 0;
+   uint_t last;
+
+   pad = a_Atom_intern("pad");
+   last = NumSlots - 1;
+   a = intern_at(last, &n);
+   b = intern_at(last, &n);
+   c = intern_at(last, &n);
+   d = intern_at(0, &n);
+   check(__LINE__, slot_of(a) == (int)last && slot_of(b) == 0 &&
+         slot_of(c) == 1 && slot_of(d) == 2, "cluster wraps around");
+
+   /* Deleting the first one moves b and c back, across the end */
+   a_Atom_unref(a);
+   check(__LINE__, slot_of(b) == (int)last && slot_of(c) == 0,
+         "b and c move back across the end");
+   check(__LINE__, slot_of(d) == 1, "d moves back to its home");
+   check(__LINE__, still_found(b) && still_found(c) && still_found(d),
+         "lookups after deleting at the end");
+
+   /* Deleting at slot 0: c can't move before its home, d can */
+   a_Atom_unref(b);
+   check(__LINE__, slot_of(c) == (int)last && slot_of(d) == 0,
+         "c fills the end, d its home");
+   a_Atom_unref(c);
+   check(__LINE__, Slots[last] == NULL && slot_of(d) == 0,
+         "d stays at home");
+   check(__LINE__, still_found(d), "lookup after the cluster is gone");
+   a_Atom_unref(d);
+   a_Atom_unref(pad);
+   check(__LINE__, NumAtoms == 0 && Slots == NULL, "wrap-around: empty");
+}
+
+/*
+ * Random interns and releases, half of them of names with capitals.
+ */
+static void test_random(void)
+{
+   static const char *atoms[NUM_NAMES];
+   static int refs[NUM_NAMES];
+   const char *atom, *lower;
+   char name[32];
+   int i, k, bad_ptr = 0, bad_fold = 0, bad_count = 0, max_slots = 0;
+
+   srand(1);
+   for (i = 0; i < NUM_OPS; i++) {
+      k = rand() % NUM_NAMES;
+      if (refs[k] == 0 || rand() % 2) {
+         snprintf(name, sizeof(name), k % 2 ? "Cls%d" : "cls%d", k);
+         atom = a_Atom_intern(name);
+         if (refs[k] && atom != atoms[k])
+            bad_ptr++;
+         atoms[k] = atom;
+         refs[k]++;
+
+         /* The fold is the lowercase atom, and the same every time */
+         name[0] = 'c';
+         lower = a_Atom_intern(name);
+         if (a_Atom_fold(atom) != lower ||
+             a_Atom_fold(lower) != lower ||
+             a_Atom_fold(atom) != a_Atom_fold(atoms[k]))
+            bad_fold++;
+         a_Atom_unref(lower);
+      } else {
+         a_Atom_unref(atoms[k]);
+         refs[k]--;
+      }
+      if (NumSlots > (uint_t)max_slots)
+         max_slots = NumSlots;
+      if (i % 1000 == 0) {
+         int distinct = 0;
+
+         for (k = 0; k < NUM_NAMES; k++)
+            if (refs[k])
+               distinct += 1 + (k % 2);  /* and its lowercase atom */
+         if ((int)NumAtoms != distinct)
+            bad_count++;
+      }
+   }
+   check(__LINE__, bad_ptr == 0, "equal strings give equal pointers");
+   check(__LINE__, bad_fold == 0, "a_Atom_fold() is stable");
+   check(__LINE__, bad_count == 0, "one atom per name in use");
+   check(__LINE__, max_slots > ATOM_MIN_SLOTS, "the table grew");
+
+   for (k = 0; k < NUM_NAMES; k++)
+      for ( ; refs[k]; refs[k]--)
+         a_Atom_unref(atoms[k]);
+   check(__LINE__, NumAtoms == 0 && NumSlots == 0 && Slots == NULL,
+         "the table ends empty");
+   a_Atom_unref(NULL);
+}
+
+int main(void)
+{
+   const char *a, *b;
+
+   a = a_Atom_intern("Foo");
+   b = a_Atom_intern_l("Foobar", 3);
+   check(__LINE__, a == b, "intern and intern_l agree");
+   check(__LINE__, a_Atom_fold(a) == a_Atom_fold(b) &&
+         !strcmp(a_Atom_fold(a), "foo"), "fold of Foo is foo");
+   check(__LINE__, NumAtoms == 2, "Foo and foo");
+   a_Atom_unref(a);
+   a_Atom_unref(b);
+   check(__LINE__, NumAtoms == 0 && Slots == NULL, "Foo: empty");
+
+   test_wrap_around();
+   test_random();
+
+   printf("TESTS: passed: %u failed: %u\n", passed, failed);
+   return failed ? 1 : 0;
+}
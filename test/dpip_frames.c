@@ -0,0 +1,165 @@
+/*
+ * Dpip binary frames test
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Negotiates binary framing over a socket pair, writes frames with
+ * a_Dpip_dsh_writev() and reads them back with a_Dpip_dsh_read_frame():
+ * frames split across reads, frames bigger than the caller's buffer,
+ * frames left in the read buffer by a tag read, and EOF.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../dlib/dlib.h"
+#include "../dpip/dpip.h"
+
+static uint_t failed = 0;
+static uint_t passed = 0;
+
+static void check(int lineno, int cond, const char *what)
+{
+   if (!cond) {
+      printf("line %d: FAILED: %s\n", lineno, what);
+      failed++;
+   } else {
+      passed++;
+   }
+}
+
+/*
+ * Read up to 'size' bytes with a_Dpip_dsh_read_frame(), in 'chunk'-sized
+ * calls, until it has them all or gets nothing.
+ * Return value: the number of bytes read.
+ */
+static int read_all(Dsh *dsh, int blocking, char *buf, int size, int chunk)
+{
+   int n, got = 0;
+
+   while (got < size &&
+          (n = a_Dpip_dsh_read_frame(dsh, blocking, buf + got,
+                                     MIN(chunk, size - got))) > 0) {
+      if (n > chunk)
+         return -1;
+      got += n;
+   }
+   return got;
+}
+
+/*
+ * Write raw bytes to the socket, bypassing the Dsh.
+ */
+static void raw_write(int fd, const char *buf, int size)
+{
+   if (write(fd, buf, size) != size)
+      perror("write");
+}
+
+int main(void)
+{
+   int fds[2], i, n;
+   Dsh *browser, *dpi;
+   char *tok, buf[64], big[40000], in[40000];
+   char hdr[DPIP_FRAME_HDR_SZ] = {0, 0, 0, 6};
+   struct iovec iov[3];
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+      perror("socketpair");
+      return 1;
+   }
+   browser = a_Dpip_dsh_new(fds[0], fds[0], 8 * 1024);
+   dpi = a_Dpip_dsh_new(fds[1], fds[1], 8 * 1024);
+
+   /* The browser asks for binary framing, the dpi agrees */
+   tok = a_Dpip_build_cmd("cmd=%s url=%s framing=%s",
+                          "open_url", "test:frames", "bin");
+   a_Dpip_dsh_write_str(browser, 1, tok);
+   dFree(tok);
+   tok = a_Dpip_dsh_read_token(dpi, 1);
+   check(__LINE__, tok != NULL, "open_url received");
+   dFree(tok);
+   check(__LINE__, (dpi->mode & DPIP_BIN_OK) != 0, "dpi may send frames");
+   a_Dpip_dsh_start_send_page(dpi, 1, "test:frames");
+   check(__LINE__, (dpi->mode & DPIP_BIN_OUT) != 0, "dpi sends frames");
+
+   /* A frame gathered from three buffers, sent along with the tag, so
+    * that reading the tag leaves it in the read buffer */
+   iov[0].iov_base = (char *)"Hel";
+   iov[0].iov_len = 3;
+   iov[1].iov_base = (char *)"lo, ";
+   iov[1].iov_len = 4;
+   iov[2].iov_base = (char *)"world";
+   iov[2].iov_len = 5;
+   a_Dpip_dsh_writev(dpi, 1, iov, 3);
+   tok = a_Dpip_dsh_read_token(browser, 1);
+   check(__LINE__, tok && strstr(tok, "framing='bin'"),
+         "start_send_page asks for frames");
+   dFree(tok);
+   n = a_Dpip_dsh_read_frame(browser, 1, buf, sizeof(buf));
+   check(__LINE__, n == 12 && !memcmp(buf, "Hello, world", 12),
+         "buffered frame");
+   check(__LINE__, (browser->mode & DPIP_BIN) != 0, "browser reads frames");
+
+   /* An empty write sends no frame */
+   a_Dpip_dsh_write(dpi, 1, "", 0);
+   n = recv(fds[0], buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+   check(__LINE__, n < 0, "no empty frame");
+   raw_write(fds[1], hdr, 4);
+   raw_write(fds[1], "abcdef", 6);
+   n = a_Dpip_dsh_read_frame(browser, 1, buf, sizeof(buf));
+   check(__LINE__, n == 6 && !memcmp(buf, "abcdef", 6), "hand-made frame");
+
+   /* A frame bigger than the caller's buffer (and than one socket read),
+    * read straight into the caller's buffer */
+   for (i = 0; i < (int)sizeof(big); i++)
+      big[i] = (char)(i * 7);
+   a_Dpip_dsh_write(dpi, 1, big, 20000);
+   a_Dpip_dsh_write(dpi, 1, big + 20000, 20000);
+   n = read_all(browser, 1, in, sizeof(in), 100);
+   check(__LINE__, n == (int)sizeof(in) && !memcmp(in, big, sizeof(in)),
+         "oversized frames, 100-byte reads");
+
+   /* A frame split inside its header and inside its payload */
+   raw_write(fds[1], hdr, 2);
+   n = a_Dpip_dsh_read_frame(browser, 0, buf, sizeof(buf));
+   check(__LINE__, n == -1, "half a header: eagain");
+   raw_write(fds[1], hdr + 2, 2);
+   raw_write(fds[1], "xyz", 3);
+   n = a_Dpip_dsh_read_frame(browser, 0, buf, sizeof(buf));
+   check(__LINE__, n == 3 && !memcmp(buf, "xyz", 3), "half a payload");
+   n = a_Dpip_dsh_read_frame(browser, 0, buf, sizeof(buf));
+   check(__LINE__, n == -1, "rest of the payload: eagain");
+   raw_write(fds[1], "uvw", 3);
+   a_Dpip_dsh_write(dpi, 1, "next", 4);
+   n = read_all(browser, 0, buf, 7, sizeof(buf));
+   check(__LINE__, n == 7 && !memcmp(buf, "uvwnext", 7),
+         "rest of the payload, then the next frame");
+
+   /* EOF */
+   a_Dpip_dsh_close(dpi);
+   a_Dpip_dsh_free(dpi);
+   n = a_Dpip_dsh_read_frame(browser, 1, buf, sizeof(buf));
+   check(__LINE__, n == 0, "EOF");
+
+   a_Dpip_dsh_close(browser);
+   a_Dpip_dsh_free(browser);
+
+   printf("TESTS: passed: %u failed: %u\n", passed, failed);
+   return failed ? 1 : 0;
+}
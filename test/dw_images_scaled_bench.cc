@@ -0,0 +1,109 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark for image scaling (see dw_images_scaled.cc for the visual
+ * test): a root buffer is filled row by row, as a decoder does, while
+ * several scaled buffers (down and up, as on pages with responsive
+ * images) are attached to it.
+ *
+ * Usage: dw-images-scaled-bench [rootWidth rootHeight [rounds]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../dw/core.hh"
+#include "../dw/fltkcore.hh"
+
+using namespace dw::core;
+using namespace dw::fltk;
+
+static double now ()
+{
+   struct timeval tv;
+   gettimeofday (&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double bench (Layout *layout, int width, int height, int rounds,
+                     int scaledWidth, int scaledHeight)
+{
+   byte *row = new byte[3 * width];
+   double total = 0;
+
+   for (int r = 0; r < rounds; r++) {
+      Imgbuf *rootbuf = layout->createImgbuf (Imgbuf::RGB, width, height,
+                                              1 / 2.2);
+      Imgbuf *scaledbuf = NULL;
+
+      if (scaledWidth != width || scaledHeight != height)
+         scaledbuf = rootbuf->getScaledBuf (scaledWidth, scaledHeight);
+
+      double start = now ();
+      for (int y = 0; y < height; y++) {
+         for (int x = 0; x < 3 * width; x++)
+            row[x] = (x * 7 + y * 13 + r) & 0xff;
+         rootbuf->copyRow (y, row);
+      }
+      total += now () - start;
+
+      if (scaledbuf)
+         scaledbuf->unref ();
+      rootbuf->unref ();
+   }
+
+   delete[] row;
+   return total / rounds;
+}
+
+int main (int argc, char **argv)
+{
+   int width = 1600, height = 1200, rounds = 5;
+
+   if (argc >= 3) {
+      width = atoi (argv[1]);
+      height = atoi (argv[2]);
+   }
+   if (argc >= 4)
+      rounds = atoi (argv[3]);
+
+   FltkPlatform *platform = new FltkPlatform ();
+   Layout *layout = new Layout (platform);
+
+   static const int scales[][2] = {   // in percent of the root size
+      { 100, 100 }, { 50, 50 }, { 25, 25 }, { 12, 12 }, { 37, 50 },
+      { 150, 150 }, { 250, 250 }, { 200, 75 }
+   };
+
+   double base = 0;
+   for (unsigned int i = 0; i < sizeof (scales) / sizeof (scales[0]); i++) {
+      int sw = lout::misc::max (1, width * scales[i][0] / 100);
+      int sh = lout::misc::max (1, height * scales[i][1] / 100);
+      double t = bench (layout, width, height, rounds, sw, sh);
+
+      if (i == 0)
+         base = t;
+      printf ("%5dx%-5d -> %5dx%-5d %8.2f ms (scaling: %8.2f ms)\n",
+              width, height, sw, sh, t * 1e3, (t - base) * 1e3);
+   }
+
+   delete layout;
+
+   return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark for the pixel format conversions done while an image is
+ * decoded: lines are passed to a_Imgbuf_update() as the decoders do, so
+ * CMYK lines are converted to RGB, and indexed lines are expanded through
+ * the colormap for a scaled buffer. RGB lines give the baseline.
+ *
+ * Usage: dw-imgbuf-convert-bench [width height [rounds]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "../dw/core.hh"
+#include "../dw/fltkcore.hh"
+#include "../src/prefs.h"
+#include "../src/imgbuf.hh"
+
+using namespace dw::core;
+using namespace dw::fltk;
+
+DilloPrefs prefs;
+
+static double now ()
+{
+   struct timeval tv;
+   gettimeofday (&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double bench (Layout *layout, DilloImgType type, int bpp, bool scaled,
+                     int width, int height, int rounds)
+{
+   uchar_t *row = new uchar_t[bpp * width];
+   uchar_t cmap[3 * 256];
+   double total = 0;
+
+   for (int i = 0; i < 3 * 256; i++)
+      cmap[i] = (i * 37) & 0xff;
+
+   for (int r = 0; r < rounds; r++) {
+      void *imgbuf = a_Imgbuf_new (layout, type, width, height, 1 / 2.2);
+      Imgbuf *scaledbuf = NULL;
+
+      if (type == DILLO_IMG_TYPE_INDEXED)
+         a_Imgbuf_set_cmap (imgbuf, cmap, 256);
+      if (scaled)
+         scaledbuf = ((Imgbuf*)imgbuf)->getScaledBuf (width / 2, height / 2);
+
+      double start = now ();
+      for (int y = 0; y < height; y++) {
+         for (int x = 0; x < bpp * width; x++)
+            row[x] = (x * 7 + y * 13 + r) & 0xff;
+         a_Imgbuf_update (imgbuf, row, type, width, height, y);
+      }
+      total += now () - start;
+
+      if (scaledbuf)
+         scaledbuf->unref ();
+      a_Imgbuf_unref (imgbuf);
+   }
+
+   delete[] row;
+   return total / rounds;
+}
+
+int main (int argc, char **argv)
+{
+   int width = 1600, height = 1200, rounds = 5;
+
+   if (argc >= 3) {
+      width = atoi (argv[1]);
+      height = atoi (argv[2]);
+   }
+   if (argc >= 4)
+      rounds = atoi (argv[3]);
+
+   FltkPlatform *platform = new FltkPlatform ();
+   Layout *layout = new Layout (platform);
+
+   static const struct {
+      const char *name;
+      DilloImgType type;
+      int bpp;
+      bool scaled;
+   } cases[] = {
+      { "rgb", DILLO_IMG_TYPE_RGB, 3, false },
+      { "cmyk", DILLO_IMG_TYPE_CMYK_INV, 4, false },
+      { "rgb, scaled", DILLO_IMG_TYPE_RGB, 3, true },
+      { "indexed, scaled", DILLO_IMG_TYPE_INDEXED, 1, true },
+   };
+
+   for (unsigned int i = 0; i < sizeof (cases) / sizeof (cases[0]); i++) {
+      double t = bench (layout, cases[i].type, cases[i].bpp, cases[i].scaled,
+                        width, height, rounds);
+      printf ("%5dx%-5d %-16s %8.2f ms %8.1f Mpixel/s\n", width, height,
+              cases[i].name, t * 1e3, width * height / t / 1e6);
+   }
+
+   delete layout;
+
+   return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * Dillo Widget
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Shows a text file with dw::PlainText, and searches it.
+ *
+ *    dw-plaintext-test FILE [KEY]
+ *
+ * Try it with a log of some hundred megabytes: the time it takes to load
+ * is printed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <FL/Fl.H>
+#include <FL/Fl_Window.H>
+#include <FL/Fl_Box.H>
+#include "../dw/core.hh"
+#include "../dw/fltkcore.hh"
+#include "../dw/fltkviewport.hh"
+#include "../dw/plaintext.hh"
+
+using namespace dw;
+using namespace dw::core;
+using namespace dw::core::style;
+using namespace dw::fltk;
+
+static FltkPlatform *platform;
+static Layout *layout;
+static Fl_Window *window;
+static FltkViewport *viewport;
+static Fl_Button *findButton, *resetButton;
+static Fl_Widget *resultLabel;
+static const char *key = "error";
+
+static void findCallback (Fl_Widget *widget, void *data)
+{
+   switch(layout->search (key, false, false)) {
+       case FindtextState::SUCCESS:
+          resultLabel->label("SUCCESS");
+          break;
+
+       case FindtextState::RESTART:
+          resultLabel->label("RESTART");
+          break;
+
+       case FindtextState::NOT_FOUND:
+          resultLabel->label("NOT_FOUND");
+          break;
+   }
+
+   resultLabel->redraw ();
+}
+
+static void resetCallback (Fl_Widget *widget, void *data)
+{
+   layout->resetSearch ();
+   resultLabel->label("---");
+   resultLabel->redraw ();
+}
+
+static double now ()
+{
+   struct timeval tv;
+
+   gettimeofday (&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+class FileSource: public PlainText::Source
+{
+public:
+   lout::misc::SimpleVector <char> text;
+
+   FileSource () : text (64 * 1024) { }
+   const char *getText (size_t *size)
+   { *size = text.size (); return text.getArray (); }
+};
+
+static FileSource source;
+
+static void load (PlainText *plainText, FILE *file)
+{
+   static char buf[64 * 1024];
+   size_t n, lineStart = 0;
+   int lines = 0;
+   double t0 = now ();
+
+   while ((n = fread (buf, 1, sizeof (buf), file)) > 0) {
+      size_t old = source.text.size ();
+
+      source.text.setSize (old + n);
+      memcpy (source.text.getArray () + old, buf, n);
+      for (size_t i = old; i < old + n; i++) {
+         if (buf[i - old] == '\n') {
+            plainText->addLine (i + 1);
+            lineStart = i + 1;
+            lines++;
+         }
+      }
+      plainText->flush ();
+   }
+   if (lineStart < (size_t)source.text.size ()) {
+      plainText->addLine (source.text.size ());
+      lines++;
+   }
+   plainText->flush ();
+
+   printf ("%d lines loaded in %.3f s\n", lines, now () - t0);
+}
+
+int main(int argc, char **argv)
+{
+   FILE *file;
+
+   if (argc < 2) {
+      fprintf (stderr, "Usage: %s FILE [KEY]\n", argv[0]);
+      return 1;
+   }
+   if (!(file = fopen (argv[1], "r"))) {
+      perror (argv[1]);
+      return 1;
+   }
+   if (argc > 2)
+      key = argv[2];
+
+   platform = new FltkPlatform ();
+   layout = new Layout (platform);
+
+   window = new Fl_Window(600, 400, "Dw PlainText Test");
+   window->box(FL_NO_BOX);
+   window->begin();
+
+   viewport = new FltkViewport (0, 0, 600, 380);
+   viewport->end();
+   layout->attachView (viewport);
+
+   findButton = new Fl_Button(0, 380, 50, 20, "Find");
+   findButton->callback (findCallback, NULL);
+   findButton->when (FL_WHEN_RELEASE);
+   findButton->clear_visible_focus ();
+
+   resetButton = new Fl_Button(50, 380, 50, 20, "Reset");
+   resetButton->callback (resetCallback, NULL);
+   resetButton->when (FL_WHEN_RELEASE);
+   resetButton->clear_visible_focus ();
+
+   resultLabel = new Fl_Box(100, 380, 100, 20, "---");
+   resultLabel->box(FL_FLAT_BOX);
+
+   FontAttrs fontAttrs;
+   fontAttrs.name = "DejaVu Sans Mono";
+   fontAttrs.size = 14;
+   fontAttrs.weight = 400;
+   fontAttrs.style = FONT_STYLE_NORMAL;
+   fontAttrs.letterSpacing = 0;
+   fontAttrs.fontVariant = FONT_VARIANT_NORMAL;
+
+   StyleAttrs styleAttrs;
+   styleAttrs.initValues ();
+   styleAttrs.font = dw::core::style::Font::create (layout, &fontAttrs);
+   styleAttrs.margin.setVal (5);
+   styleAttrs.color = Color::create (layout, 0x000000);
+   styleAttrs.backgroundColor = Color::create (layout, 0xffffff);
+   Style *widgetStyle = Style::create (&styleAttrs);
+
+   styleAttrs.margin.setVal (0);
+   styleAttrs.backgroundColor = NULL;
+   Style *textStyle = Style::create (&styleAttrs);
+
+   PlainText *plainText = new PlainText (textStyle, &source);
+   plainText->setStyle (widgetStyle);
+   layout->setWidget (plainText);
+
+   load (plainText, file);
+   fclose (file);
+
+   widgetStyle->unref ();
+   textStyle->unref ();
+
+   window->resizable(viewport);
+   window->show();
+   int errorCode = Fl::run();
+
+   delete layout;
+
+   return errorCode;
+}
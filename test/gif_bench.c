@@ -0,0 +1,170 @@
+/*
+ * Dillo GIF decoder benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Feeds each GIF file of a corpus to src/gif.c the way the cache does
+ * (in network-sized chunks), and reports the decoding speed in MB/s of
+ * compressed input, along with a checksum of the decoded rows, so that
+ * different versions of the decoder can be compared.
+ *
+ * Usage: gif-bench [-r rounds] [-c chunksize] file.gif...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "../src/image.hh"
+#include "../src/cache.h"
+#include "../src/prefs.h"
+#include "../src/dgif.h"
+
+DilloPrefs prefs;
+
+static uint_t Checksum;
+static uint_t Rows;
+
+/*
+ * dicache stubs: the decoder's output just goes into the checksum.
+ */
+void a_Dicache_set_parms(DilloUrl *url, int version, DilloImage *Image,
+                         uint_t width, uint_t height, DilloImgType type,
+                         double gamma)
+{
+   /* Later frames of an animation come with no Image */
+   if (Image)
+      Image->width = width;
+}
+
+void a_Dicache_set_cmap(DilloUrl *url, int version, int bg_color,
+                        const uchar_t *cmap, uint_t num_colors,
+                        int num_colors_max, int bg_index)
+{
+}
+
+void a_Dicache_write(DilloUrl *url, int version, const uchar_t *buf,
+                     uint_t Y)
+{
+   DilloImage *Image = (DilloImage *)url;  /* see Gif_bench_file() */
+   uint_t x;
+
+   for (x = 0; x < Image->width; x++)
+      Checksum = Checksum * 31 + buf[x];
+   Checksum += Y;
+   Rows++;
+}
+
+void a_Dicache_close(DilloUrl *url, int version, CacheClient_t *Client)
+{
+}
+
+char *a_Url_str(const DilloUrl *url)
+{
+   return "(gif-bench)";
+}
+
+static double Gif_bench_now(void)
+{
+   struct timeval tv;
+   gettimeofday(&tv, NULL);
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Decode a whole file once; return the time taken.
+ */
+static double Gif_bench_file(const char *data, size_t size, size_t chunk)
+{
+   DilloImage Image;
+   CacheClient_t Client;
+   void *gif;
+   double start;
+
+   memset(&Image, 0, sizeof(Image));
+   memset(&Client, 0, sizeof(Client));
+   /* The URL is only passed back to the dicache, so it carries Image */
+   gif = a_Gif_new(&Image, (DilloUrl *)&Image, 1);
+   Client.CbData = gif;
+   Client.Buf = (void *)data;
+
+   start = Gif_bench_now();
+   for (Client.BufSize = 0; Client.BufSize < size; ) {
+      Client.BufSize = MIN(Client.BufSize + chunk, size);
+      a_Gif_callback(CA_Send, &Client);
+   }
+   a_Gif_callback(CA_Close, &Client);
+   return Gif_bench_now() - start;
+}
+
+int main(int argc, char **argv)
+{
+   int i, r, rounds = 20;
+   size_t chunk = 16384, total_size = 0;
+   double t, total_time = 0;
+
+   for (i = 1; i < argc && argv[i][0] == '-'; i += 2) {
+      if (i + 1 >= argc)
+         break;
+      if (!strcmp(argv[i], "-r"))
+         rounds = atoi(argv[i + 1]);
+      else if (!strcmp(argv[i], "-c"))
+         chunk = atoi(argv[i + 1]);
+   }
+   if (i >= argc || rounds < 1 || chunk < 1) {
+      fprintf(stderr, "Usage: %s [-r rounds] [-c chunksize] file.gif...\n",
+              argv[0]);
+      return 1;
+   }
+
+   for (; i < argc; i++) {
+      FILE *fp = fopen(argv[i], "rb");
+      char *data;
+      long size;
+
+      if (!fp) {
+         perror(argv[i]);
+         continue;
+      }
+      fseek(fp, 0, SEEK_END);
+      size = ftell(fp);
+      rewind(fp);
+      data = malloc(size);
+      if (fread(data, 1, size, fp) != (size_t)size) {
+         perror(argv[i]);
+         fclose(fp);
+         free(data);
+         continue;
+      }
+      fclose(fp);
+
+      t = 0;
+      for (r = 0; r < rounds; r++) {
+         Checksum = Rows = 0;
+         t += Gif_bench_file(data, size, chunk);
+      }
+      printf("%-40s %8ld bytes %6u rows %8.2f MB/s  checksum %08x\n",
+             argv[i], size, Rows, size * rounds / t / 1e6, Checksum);
+      total_size += size * rounds;
+      total_time += t;
+      free(data);
+   }
+   if (total_time > 0)
+      printf("total: %.2f MB/s\n", total_size / total_time / 1e6);
+
+   return 0;
+}